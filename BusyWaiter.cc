@@ -0,0 +1,158 @@
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include "tbb/enumerable_thread_specific.h"
+#include "EventIdentifier.h"
+#include "DataProductRetriever.h"
+#include "TaskHolder.h"
+#include "WaiterBase.h"
+#include "WaiterFactory.h"
+
+
+namespace cce::tf {
+  /*
+   Instead of sleeping, this waiter keeps the CPU busy by running a compute kernel for the requested time.
+   The kernel is calibrated at construction to determine the number of iterations per microsecond.
+   If a working set size is given, each iteration also updates the next cache line of a per thread buffer
+   of that size so the kernel also consumes memory bandwidth.
+   */
+  class BusyWaiter : public WaiterBase {
+  public:
+
+    BusyWaiter(double iScaleFactor, std::vector<double> iEventTimes, std::size_t iNDataProducts, std::size_t iWorkingSetSize, bool iVerbose):
+      scale_{iScaleFactor},
+      eventTimes_(std::move(iEventTimes)),
+      nDataProducts_{iNDataProducts},
+      workingSetSize_{iWorkingSetSize},
+      buffers_{[iWorkingSetSize]() { return WorkingSet{std::vector<char>(iWorkingSetSize,0), 0}; }}
+    {
+      iterationsPerMicrosecond_ = calibrate();
+      if(iVerbose) {
+        std::cout <<"BusyWaiter calibration: "<<iterationsPerMicrosecond_<<" iterations/us"<<std::endl;
+      }
+    }
+
+    void waitAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, long iEventIndex,
+                   std::vector<DataProductRetriever> const& iRetrievers, unsigned int index,
+                   TaskHolder iCallback) const final {
+      double time;
+      if(eventTimes_.empty()) {
+        time = scale_*iRetrievers[index].size();
+      } else {
+        time = eventTimes_[iEventIndex % eventTimes_.size()]/nDataProducts_;
+      }
+      std::size_t iterations = time*iterationsPerMicrosecond_;
+      if(iterations == 0) {
+        return;
+      }
+      iCallback.group()->run([iCallback, iterations, this]() {
+          burn(iterations);
+        });
+    }
+
+  private:
+    struct WorkingSet {
+      std::vector<char> buffer_;
+      std::size_t offset_;
+    };
+
+    static constexpr std::size_t kCacheLineSize = 64;
+    static constexpr unsigned int kOpsPerIteration = 16;
+
+    void burn(std::size_t iIterations) const {
+      double value = 1.;
+      if(workingSetSize_ == 0) {
+        for(std::size_t i = 0; i < iIterations; ++i) {
+          for(unsigned int op = 0; op < kOpsPerIteration; ++op) {
+            value = value*1.0000001 + 1.e-7;
+          }
+        }
+      } else {
+        auto& workingSet = buffers_.local();
+        char* buffer = workingSet.buffer_.data();
+        auto offset = workingSet.offset_;
+        for(std::size_t i = 0; i < iIterations; ++i) {
+          for(unsigned int op = 0; op < kOpsPerIteration; ++op) {
+            value = value*1.0000001 + 1.e-7;
+          }
+          buffer[offset] += static_cast<char>(value);
+          offset += kCacheLineSize;
+          if(offset >= workingSetSize_) {
+            offset = 0;
+          }
+        }
+        workingSet.offset_ = offset;
+      }
+      //keep the compiler from removing the loops
+      sink_.store(value, std::memory_order_relaxed);
+    }
+
+    double calibrate() const {
+      using namespace std::chrono_literals;
+      //make sure the working set has been paged in before timing
+      burn(workingSetSize_/kCacheLineSize);
+      std::size_t iterations = 1024;
+      while(true) {
+        auto start = std::chrono::steady_clock::now();
+        burn(iterations);
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        if(time > 20ms) {
+          return double(iterations)/time.count();
+        }
+        iterations *= 2;
+      }
+    }
+
+    double scale_;
+    std::vector<double> eventTimes_;
+    std::size_t nDataProducts_;
+    std::size_t workingSetSize_;
+    double iterationsPerMicrosecond_;
+    mutable tbb::enumerable_thread_specific<WorkingSet> buffers_;
+    mutable std::atomic<double> sink_{0.};
+  };
+}
+
+namespace {
+
+  using namespace cce::tf;
+  class Maker : public WaiterMakerBase {
+  public:
+    Maker(): WaiterMakerBase("BusyWaiter") {}
+
+    std::unique_ptr<WaiterBase> create(unsigned int iNLanes, std::size_t iNDataProducts, ConfigurationParameters const& params) const final {
+
+      auto scale = params.get<float>("scale");
+      auto filename = params.get<std::string>("filename");
+      if(scale and filename) {
+        std::cout <<"BusyWaiter can not use both 'scale' and 'filename'"<<std::endl;
+        return {};
+      }
+      auto workingSet = params.get<std::size_t>("workingSet", 0);
+
+      std::vector<double> eventTimes;
+      if(filename) {
+        std::ifstream file(*filename);
+        if(not file.is_open()) {
+          std::cout <<"unable to open file "<<*filename<<" with event times";
+          return {};
+        }
+        double value;
+        while(file >> value) {
+          eventTimes.push_back(value);
+        }
+        if(eventTimes.empty()) {
+          std::cout <<"file "<<*filename<<" contained no event times"<<std::endl;
+          return {};
+        }
+      }
+
+      return std::make_unique<BusyWaiter>(scale.value_or(0.), std::move(eventTimes), iNDataProducts, workingSet, params.get<bool>("verbose", false));
+    }
+
+  };
+
+  Maker s_maker;
+}
@@ -0,0 +1,106 @@
+#if !defined(EventOrderBuffer_h)
+#define EventOrderBuffer_h
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+
+#include "TaskHolder.h"
+
+namespace cce::tf {
+  /*
+   Passes on items, e.g. serialized events, in the order of their index even though
+   they are inserted in any order. The indices must start at 0 and have no gaps.
+   An item waiting for an earlier index is held in memory. Once the number of held items
+   or their bytes reaches the limits, the TaskHolder given with a new item is kept until
+   that item is passed on, which stalls the lane which delivered it.
+   */
+  template<typename T>
+  class EventOrderBuffer {
+  public:
+    EventOrderBuffer(std::size_t iMaxEvents, std::size_t iMaxBytes): maxEvents_{iMaxEvents}, maxBytes_{iMaxBytes} {}
+
+    //iRelease is called in index order for each item which can now be passed on.
+    // The calls are made while holding a lock so iRelease must be quick.
+    template<typename F>
+    void insert(unsigned long long iIndex, T iItem, std::size_t iBytes, TaskHolder iCallback, F&& iRelease) {
+      std::vector<TaskHolder> released;
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if(iIndex == nextIndex_) {
+          ++nextIndex_;
+          iRelease(std::move(iItem));
+        } else {
+          bool const hold = waiting_.size() >= maxEvents_ or bytes_ + iBytes > maxBytes_;
+          if(hold) {
+            ++nStalls_;
+            waiting_.emplace(iIndex, Entry{std::move(iItem), iBytes, true, std::move(iCallback), std::chrono::high_resolution_clock::now()});
+          } else {
+            waiting_.emplace(iIndex, Entry{std::move(iItem), iBytes, false, TaskHolder(), {}});
+          }
+          bytes_ += iBytes;
+          maxHeldEvents_ = std::max(maxHeldEvents_, waiting_.size());
+          maxHeldBytes_ = std::max(maxHeldBytes_, bytes_);
+        }
+        auto it = waiting_.begin();
+        while(it != waiting_.end() and it->first == nextIndex_) {
+          ++nextIndex_;
+          release(it->second, released);
+          iRelease(std::move(it->second.item_));
+          it = waiting_.erase(it);
+        }
+      }
+      //destroying the TaskHolders lets the stalled lanes continue
+    }
+
+    //passes on all held items in index order, used at the end of the job
+    template<typename F>
+    void flush(F&& iRelease) {
+      std::vector<TaskHolder> released;
+      std::lock_guard<std::mutex> guard(mutex_);
+      for(auto& [index, entry]: waiting_) {
+        release(entry, released);
+        iRelease(std::move(entry.item_));
+        nextIndex_ = index+1;
+      }
+      waiting_.clear();
+    }
+
+    std::size_t maxHeldEvents() const { return maxHeldEvents_; }
+    std::size_t maxHeldBytes() const { return maxHeldBytes_; }
+    unsigned long long nStalls() const { return nStalls_; }
+    std::chrono::microseconds stallTime() const { return stallTime_; }
+
+  private:
+    struct Entry {
+      T item_;
+      std::size_t bytes_;
+      bool held_;
+      TaskHolder callback_;
+      std::chrono::high_resolution_clock::time_point heldSince_;
+    };
+
+    void release(Entry& iEntry, std::vector<TaskHolder>& oReleased) {
+      bytes_ -= iEntry.bytes_;
+      if(iEntry.held_) {
+        stallTime_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - iEntry.heldSince_);
+        oReleased.emplace_back(std::move(iEntry.callback_));
+      }
+    }
+
+    std::mutex mutex_;
+    std::map<unsigned long long, Entry> waiting_;
+    unsigned long long nextIndex_ = 0;
+    std::size_t bytes_ = 0;
+    const std::size_t maxEvents_;
+    const std::size_t maxBytes_;
+    std::size_t maxHeldEvents_ = 0;
+    std::size_t maxHeldBytes_ = 0;
+    unsigned long long nStalls_ = 0;
+    std::chrono::microseconds stallTime_ = std::chrono::microseconds::zero();
+  };
+}
+#endif
@@ -8,19 +8,27 @@
 #include "TaskHolder.h"
 #include "WaiterBase.h"
 #include "WaiterFactory.h"
+#include "TimerService.h"
 
 
 namespace cce::tf {
   class EventSleepWaiter : public WaiterBase {
  public:
 
-    EventSleepWaiter(std::vector<double> iEventSleepTimes, std::size_t iNDataProducts):
+    EventSleepWaiter(std::vector<double> iEventSleepTimes, std::size_t iNDataProducts, bool iBlocking):
       sleepTimes_(std::move(iEventSleepTimes)),
-      nDataProducts_{iNDataProducts} {}
+      nDataProducts_{iNDataProducts},
+      timer_{iBlocking ? nullptr : std::make_unique<TimerService>()} {}
 
     void waitAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, long iEventIndex,
                    std::vector<DataProductRetriever> const& iRetrievers, unsigned int index, 
                    TaskHolder iCallback) const final {
+      if(timer_) {
+        using namespace std::chrono_literals;
+        auto sleep = std::chrono::duration_cast<std::chrono::microseconds>((sleepTimes_[iEventIndex % sleepTimes_.size()]/nDataProducts_)*1us);
+        timer_->releaseAfter(sleep, std::move(iCallback));
+        return;
+      }
       iCallback.group()->run([iCallback, iEventIndex, this]() {
 	  using namespace std::chrono_literals;
           auto index = iEventIndex % sleepTimes_.size();
@@ -34,6 +42,7 @@ namespace cce::tf {
  private:
     std::vector<double> sleepTimes_;
     std::size_t nDataProducts_;
+    std::unique_ptr<TimerService> timer_;
 };
 }
 
@@ -67,7 +76,9 @@ namespace {
         return {};
       }
 
-      return std::make_unique<EventSleepWaiter>(std::move(sleepTimes), iNDataProducts);
+      auto blocking = params.get<bool>("blocking", false);
+
+      return std::make_unique<EventSleepWaiter>(std::move(sleepTimes), iNDataProducts, blocking);
     }
     
   };
@@ -8,21 +8,27 @@
 #include "TaskHolder.h"
 #include "WaiterBase.h"
 #include "WaiterFactory.h"
+#include "TimerService.h"
 
 
 namespace cce::tf {
   class EventUnevenSleepWaiter : public WaiterBase {
  public:
 
-    EventUnevenSleepWaiter(std::vector<double> iEventSleepTimes, unsigned int iDivideBetween, std::size_t iNDataProducts):
+    EventUnevenSleepWaiter(std::vector<double> iEventSleepTimes, unsigned int iDivideBetween, std::size_t iNDataProducts, bool iBlocking):
       sleepTimes_(std::move(iEventSleepTimes)),
       divideBetween_(iDivideBetween),
-      nDataProducts_{iNDataProducts} {}
+      nDataProducts_{iNDataProducts},
+      timer_{iBlocking ? nullptr : std::make_unique<TimerService>()} {}
 
     void waitAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, long iEventIndex,
                    std::vector<DataProductRetriever> const& iRetrievers, unsigned int index, 
                    TaskHolder iCallback) const final {
-      if(index < divideBetween_) {
+      if(index < divideBetween_ and timer_) {
+        using namespace std::chrono_literals;
+        auto sleep = std::chrono::duration_cast<std::chrono::microseconds>((sleepTimes_[iEventIndex % sleepTimes_.size()]/divideBetween_)*1us);
+        timer_->releaseAfter(sleep, std::move(iCallback));
+      } else if(index < divideBetween_) {
         iCallback.group()->run([iCallback, iEventIndex, this]() {
             using namespace std::chrono_literals;
             auto index = iEventIndex % sleepTimes_.size();
@@ -38,6 +44,7 @@ namespace cce::tf {
     std::vector<double> sleepTimes_;
     unsigned int divideBetween_;
     std::size_t nDataProducts_;
+    std::unique_ptr<TimerService> timer_;
 };
 }
 
@@ -81,7 +88,9 @@ namespace {
         return {};
       }     
 
-      return std::make_unique<EventUnevenSleepWaiter>(std::move(sleepTimes), divideBetween, iNDataProducts);
+      auto blocking = params.get<bool>("blocking", false);
+
+      return std::make_unique<EventUnevenSleepWaiter>(std::move(sleepTimes), divideBetween, iNDataProducts, blocking);
     }
     
   };
@@ -1,186 +1,229 @@
 #include "H5Timing.h"
+#include <atomic>
 
-#ifdef H5_TIMING_ENABLE
+static std::atomic<H5TimerClass*> timer_class{nullptr};
 
-static H5TimerClass* timer_class;
+/* the name and start of the dataset presently being timed by this thread */
+typedef struct H5PendingTimer{
+    const char *name;
+    double start;
+} H5PendingTimer;
 
-int init_timers() {
-    struct timeval temp_time;
-
-    timer_class = (H5TimerClass*) malloc(sizeof(H5TimerClass));
+static thread_local H5PendingTimer pending_dataset_timer;
+static thread_local H5PendingTimer pending_dataset_sz_timer;
+static thread_local H5PendingTimer pending_dataset_read_timer;
+static thread_local H5PendingTimer pending_dataset_sz_read_timer;
 
+static double now() {
+    struct timeval temp_time;
     gettimeofday(&temp_time, NULL);
-    timer_class->total_start_time = (temp_time.tv_usec + temp_time.tv_sec * 1000000) + .0;
+    return (temp_time.tv_usec + temp_time.tv_sec * 1000000) + .0;
+}
 
-    timer_class->dataset_timers = new std::vector<H5Timer>;
-    timer_class->dataset_sz_timers = new std::vector<H5Timer>;
-    timer_class->dataset_read_timers = new std::vector<H5Timer>;
-    timer_class->dataset_sz_read_timers = new std::vector<H5Timer>;
+int init_timers() {
+    if ( timer_class.load() != nullptr ) {
+        return 0;
+    }
+    H5TimerClass *timers = new H5TimerClass();
+
+    timers->total_start_time = now();
 
-    timer_class->H5Dwrite_count = 0;
-    timer_class->H5Dread_count = 0;
+    timers->H5Dwrite_count = 0;
+    timers->H5Dread_count = 0;
 
-    timer_class->H5Dwrite_time = .0;
-    timer_class->H5Dread_time = .0;
-    timer_class->wrap_requests_time = .0;
-    timer_class->merge_requests_time = .0;
-    timer_class->H5Dclose_time = .0;
+    timers->H5Dwrite_time = .0;
+    timers->H5Dread_time = .0;
+    timers->wrap_requests_time = .0;
+    timers->merge_requests_time = .0;
+    timers->H5Dclose_time = .0;
 
+    H5TimerClass *expected = nullptr;
+    if ( not timer_class.compare_exchange_strong(expected, timers) ) {
+        delete timers;
+    }
     return 0;
 }
 
-// timers are C++ std::vector<H5Timer>
-#define TIMER_START(timers) {                                   \
-    struct timeval temp_time;                                       \
-    H5Timer temp;                              \
-    gettimeofday(&temp_time, NULL); \
-    temp.start = (temp_time.tv_usec + temp_time.tv_sec * 1000000) + .0; \
-    temp.name = strdup(name); \
-    timers->push_back(temp);          \
+int timers_enabled() {
+    return timer_class.load() != nullptr;
+}
+
+#define TIMER_START(pending) {                                   \
+    if ( timer_class.load() == nullptr ) {                      \
+        return 0;                                               \
+    }                                                           \
+    pending.name = name;                                        \
+    pending.start = now();                                      \
 }
 
-#define TIMER_END(timers, data_size) { \
-    struct timeval temp_time;     \
-    gettimeofday(&temp_time, NULL); \
-    timers->back().end = (temp_time.tv_usec + temp_time.tv_sec * 1000000) + .0; \
-    timers->back().data_size = data_size; \
+// the name passed to the start call must still be valid here where it is copied
+#define TIMER_END(timers, pending, data_size) {                 \
+    H5TimerClass *t = timer_class.load();                       \
+    if ( t == nullptr or pending.name == nullptr ) {            \
+        return 0;                                               \
+    }                                                           \
+    double elapse = now() - pending.start;                      \
+    std::lock_guard<std::mutex> guard(t->mutex);                \
+    H5DatasetTimes& times = t->timers[pending.name];            \
+    times.calls++;                                              \
+    times.time += elapse;                                       \
+    times.data_size += data_size;                               \
+}
+
+#define ADD_TIME(member) {                                      \
+    H5TimerClass *t = timer_class.load();                       \
+    if ( t == nullptr ) {                                       \
+        return 0;                                               \
+    }                                                           \
+    double elapse = now() - start_time;                         \
+    std::lock_guard<std::mutex> guard(t->mutex);                \
+    t->member += elapse;                                        \
 }
 
 int register_timer_start(double *start_time) {
-    struct timeval temp_time;
-    gettimeofday(&temp_time, NULL);
-    *start_time = (temp_time.tv_usec + temp_time.tv_sec * 1000000);
+    if ( timer_class.load() == nullptr ) {
+        *start_time = .0;
+        return 0;
+    }
+    *start_time = now();
     return 0;
 }
 
 int register_H5Dclose_timer_end(double start_time) {
-    struct timeval temp_time;
-    gettimeofday(&temp_time, NULL);
-    timer_class->H5Dclose_time += (temp_time.tv_usec + temp_time.tv_sec * 1000000) - start_time;
+    ADD_TIME(H5Dclose_time);
     return 0;
 }
 
 int register_merge_requests_timer_end(double start_time) {
-    struct timeval temp_time;
-    gettimeofday(&temp_time, NULL);
-    timer_class->merge_requests_time += (temp_time.tv_usec + temp_time.tv_sec * 1000000) - start_time;
+    ADD_TIME(merge_requests_time);
     return 0;
 }
 int register_wrap_requests_timer_end(double start_time) {
-    struct timeval temp_time;
-    gettimeofday(&temp_time, NULL);
-    timer_class->wrap_requests_time += (temp_time.tv_usec + temp_time.tv_sec * 1000000) - start_time;
+    ADD_TIME(wrap_requests_time);
     return 0;
 }
 
 int register_H5Dwrite_timer_end(double start_time) {
-    struct timeval temp_time;
-    gettimeofday(&temp_time, NULL);
-    timer_class->H5Dwrite_time += (temp_time.tv_usec + temp_time.tv_sec * 1000000) - start_time;
+    ADD_TIME(H5Dwrite_time);
+    return 0;
+}
+
+int register_H5Dread_timer_end(double start_time) {
+    ADD_TIME(H5Dread_time);
     return 0;
 }
 
 int register_dataset_timer_start(const char *name) {
-    TIMER_START(timer_class->dataset_timers);
+    TIMER_START(pending_dataset_timer);
     return 0;
 }
 int register_dataset_timer_end(size_t data_size) {
-    TIMER_END(timer_class->dataset_timers, data_size);
+    TIMER_END(dataset_timers, pending_dataset_timer, data_size);
     return 0;
 }
 
 int register_dataset_sz_timer_start(const char *name) {
-    TIMER_START(timer_class->dataset_sz_timers);
+    TIMER_START(pending_dataset_sz_timer);
     return 0;
 }
 
 int register_dataset_sz_timer_end(size_t data_size) {
-    TIMER_END(timer_class->dataset_sz_timers, data_size);
+    TIMER_END(dataset_sz_timers, pending_dataset_sz_timer, data_size);
     return 0;
 }
 
 int register_dataset_read_timer_start(const char *name) {
-    TIMER_START(timer_class->dataset_read_timers);
+    TIMER_START(pending_dataset_read_timer);
     return 0;
 }
 int register_dataset_read_timer_end(size_t data_size) {
-    TIMER_END(timer_class->dataset_read_timers, data_size);
+    TIMER_END(dataset_read_timers, pending_dataset_read_timer, data_size);
     return 0;
 }
 
 int register_dataset_sz_read_timer_start(const char *name) {
-    TIMER_START(timer_class->dataset_sz_read_timers);
+    TIMER_START(pending_dataset_sz_read_timer);
     return 0;
 }
 
 int register_dataset_sz_read_timer_end(size_t data_size) {
-    TIMER_END(timer_class->dataset_sz_read_timers, data_size);
+    TIMER_END(dataset_sz_read_timers, pending_dataset_sz_read_timer, data_size);
     return 0;
 }
 
 int increment_H5Dwrite() {
-    timer_class->H5Dwrite_count++;
+    H5TimerClass *t = timer_class.load();
+    if ( t != nullptr ) {
+        std::lock_guard<std::mutex> guard(t->mutex);
+        t->H5Dwrite_count++;
+    }
     return 0;
 }
 
 int increment_H5Dread() {
-    timer_class->H5Dread_count++;
-    return 0;
-}
-
-static int record_timer(std::vector<H5Timer> *timer, const char* filename) {
-    FILE *stream;
-    size_t i, total_mem_size;
-    double total_time = 0, min_time = -1, max_time = -1;
-    stream = fopen(filename, "w");
-    fprintf(stream, "dataset_name,start,end,elapse,data_size\n");
-    total_mem_size = 0;
-    for ( i = 0; i < timer->size(); ++i ) {
-        fprintf(stream, "%s, %lf, %lf, %lf, %zu\n", timer[0][i].name, timer[0][i].start, timer[0][i].end, (timer[0][i].end - timer[0][i].start)/1000000, timer[0][i].data_size);
-        total_time += (timer[0][i].end - timer[0][i].start)/1000000;
-        if (min_time == -1 || min_time > timer[0][i].start) {
-            min_time = timer[0][i].start;
-        }
-        if (max_time == -1 || max_time < timer[0][i].end) {
-            max_time = timer[0][i].end;
-        }
-        total_mem_size += timer[0][i].data_size;
-	free(timer[0][i].name);
+    H5TimerClass *t = timer_class.load();
+    if ( t != nullptr ) {
+        std::lock_guard<std::mutex> guard(t->mutex);
+        t->H5Dread_count++;
     }
-    fprintf(stream, "total,%lf,%lf,%lf,%zu\n", min_time, max_time, total_time, total_mem_size);
-    fclose(stream);
-    timer->clear();
     return 0;
 }
 
-static int output_results() {
-    printf("total H5Dwrite calls = %d, H5Dread calls = %d\n", timer_class->H5Dwrite_count, timer_class->H5Dread_count);
-    if ( timer_class->dataset_timers->size() ) {
-        record_timer(timer_class->dataset_timers, "dataset_write_record.csv");
+static H5DatasetTimes print_timers(std::map<std::string, H5DatasetTimes> const& timers) {
+    H5DatasetTimes total = {0, .0, 0};
+    for ( auto const& [name, times]: timers ) {
+        printf("    %s: %llu calls, %.0lfus, %zu bytes\n", name.c_str(), times.calls, times.time, times.data_size);
+        total.calls += times.calls;
+        total.time += times.time;
+        total.data_size += times.data_size;
     }
-    if ( timer_class->dataset_sz_timers->size() ) {
-        record_timer(timer_class->dataset_sz_timers, "dataset_sz_write_record.csv");
+    return total;
+}
+
+static int print_split(const char *label, std::map<std::string, H5DatasetTimes> const& raw, std::map<std::string, H5DatasetTimes> const& metadata) {
+    printf("  HDF5 %s timing per dataset\n", label);
+    H5DatasetTimes raw_total = print_timers(raw);
+    H5DatasetTimes metadata_total = print_timers(metadata);
+    printf("   raw data: %.0lfus, %zu bytes\n", raw_total.time, raw_total.data_size);
+    printf("   metadata: %.0lfus, %zu bytes\n", metadata_total.time, metadata_total.data_size);
+    return 0;
+}
+
+int print_write_timers() {
+    H5TimerClass *t = timer_class.load();
+    if ( t == nullptr ) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(t->mutex);
+    print_split("write", t->dataset_timers, t->dataset_sz_timers);
+    if ( t->H5Dwrite_count != 0 ) {
+        printf("   multi-dataset: H5Dwrite calls = %d, H5Dwrite time = %.0lfus, merge requests time = %.0lfus, wrap requests time = %.0lfus, H5Dclose = %.0lfus\n",
+               t->H5Dwrite_count, t->H5Dwrite_time, t->merge_requests_time, t->wrap_requests_time, t->H5Dclose_time);
     }
-    if ( timer_class->dataset_read_timers->size() ) {
-        record_timer(timer_class->dataset_read_timers, "dataset_read_record.csv");
+    fflush(stdout);
+    return 0;
+}
+
+int print_read_timers() {
+    H5TimerClass *t = timer_class.load();
+    if ( t == nullptr ) {
+        return 0;
     }
-    if ( timer_class->dataset_sz_read_timers->size() ) {
-        record_timer(timer_class->dataset_sz_read_timers, "dataset_sz_read_record.csv");
+    std::lock_guard<std::mutex> guard(t->mutex);
+    print_split("read", t->dataset_read_timers, t->dataset_sz_read_timers);
+    if ( t->H5Dread_count != 0 ) {
+        printf("   H5Dread calls = %d, H5Dread time = %.0lfus\n", t->H5Dread_count, t->H5Dread_time);
     }
+    fflush(stdout);
     return 0;
 }
 
 int finalize_timers() {
-    size_t i;
-    struct timeval temp_time;
-    output_results();
-
-    gettimeofday(&temp_time, NULL);
-    timer_class->total_end_time = (temp_time.tv_usec + temp_time.tv_sec * 1000000) + .0;
-    printf("total program time is %lf, H5Dwrite time = %lf, H5Dread time = %lf\n", (timer_class->total_end_time - timer_class->total_start_time) / 1000000, timer_class->H5Dwrite_time / 1000000, timer_class->H5Dread_time / 1000000);
-    printf("merge requests time = %lf, wrap requests time = %lf, H5Dclose = %lf\n", timer_class->merge_requests_time / 1000000, timer_class->wrap_requests_time / 1000000, timer_class->H5Dclose_time / 1000000);
-
-    free(timer_class);
+    H5TimerClass *t = timer_class.exchange(nullptr);
+    if ( t == nullptr ) {
+        return 0;
+    }
+    t->total_end_time = now();
+    delete t;
     return 0;
 }
-#endif
@@ -9,21 +9,28 @@
 #include <vector>
 #include <map>
 #include <string>
-#undef H5_TIMING_ENABLE
+#include <mutex>
 
-#ifdef H5_TIMING_ENABLE
-typedef struct H5Timer{
-    double start;
-    double end;
+/*
+ Timing of the HDF5 calls made by the HDF outputers and sources. Nothing is recorded
+ until init_timers has been called, before that every register function only checks
+ a flag and returns. The timers can be used from several threads.
+
+ Datasets holding the data products are counted as raw data. Datasets holding
+ event ids, offsets and sizes are counted as metadata (the _sz timers).
+ */
+typedef struct H5DatasetTimes{
+    unsigned long long calls;
+    double time;
     size_t data_size;
-    char *name;
-} H5Timer;
+} H5DatasetTimes;
 
 typedef struct H5TimerClass{
-    std::vector<H5Timer> *dataset_timers;
-    std::vector<H5Timer> *dataset_sz_timers;
-    std::vector<H5Timer> *dataset_read_timers;
-    std::vector<H5Timer> *dataset_sz_read_timers;
+    std::mutex mutex;
+    std::map<std::string, H5DatasetTimes> dataset_timers;
+    std::map<std::string, H5DatasetTimes> dataset_sz_timers;
+    std::map<std::string, H5DatasetTimes> dataset_read_timers;
+    std::map<std::string, H5DatasetTimes> dataset_sz_read_timers;
     int H5Dwrite_count;
     int H5Dread_count;
 
@@ -37,11 +44,13 @@ typedef struct H5TimerClass{
 } H5TimerClass;
 
 int init_timers();
+int timers_enabled();
 int register_timer_start(double *start_time);
 int register_merge_requests_timer_end(double start_time);
 int register_wrap_requests_timer_end(double start_time);
 int register_H5Dclose_timer_end(double start_time);
 int register_H5Dwrite_timer_end(double start_time);
+int register_H5Dread_timer_end(double start_time);
 
 int register_dataset_timer_start(const char *name);
 int register_dataset_timer_end(size_t data_size);
@@ -53,7 +62,9 @@ int register_dataset_sz_read_timer_start(const char *name);
 int register_dataset_sz_read_timer_end(size_t data_size);
 int increment_H5Dwrite();
 int increment_H5Dread();
+/* print the per dataset times and bytes and the raw data/metadata split */
+int print_write_timers();
+int print_read_timers();
 int finalize_timers();
-#endif
 
 #endif
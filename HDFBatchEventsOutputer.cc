@@ -4,12 +4,15 @@
 #include "UnrolledSerializerWrapper.h"
 #include "SerializerWrapper.h"
 #include "summarize_serializers.h"
+#include "H5Timing.h"
 #include "FunctorTask.h"
 #include <memory>
 #include <iostream>
 #include <cstring>
 #include <cmath>
 #include <set>
+#include <charconv>
+#include <limits>
 
 using namespace cce::tf;
 using namespace cce::tf::pds;
@@ -18,17 +21,30 @@ namespace {
   constexpr const char* const PRODUCTS_DSNAME="Products";
   constexpr const char* const EVENTS_DSNAME="EventIDs";
   constexpr const char* const OFFSETS_DSNAME="Offsets";
+  constexpr const char* const BATCHES_DSNAME="Batches";
   constexpr const char* const GNAME="Lumi";
   constexpr const char* const RUN_ANAME="run";
   constexpr const char* const LUMISEC_ANAME="lumisec";
   constexpr const char* const COMPRESSION_ANAME="Compression";
   constexpr const char* const COMPRESSION_LEVEL_ANAME="CompressionLevel";
   constexpr const char* const COMPRESSION_CHOICE_ANAME="CompressionChoice";
+  constexpr const char* const SERIALIZATION_ANAME="Serialization";
+  constexpr const char* const PRODUCT_NAMES_ANAME="ProductNames";
+  constexpr const char* const CHUNK_TARGET_BYTES_ANAME="ChunkTargetBytes";
+  constexpr const char* const BYTES_PER_EVENT_ANAME="BytesPerEvent";
+  constexpr const char* const EVENTS_PER_CHUNK_ANAME="EventsPerChunk";
   template <typename T> 
   void 
   write_ds(hid_t gid, 
            std::string const& dsname, 
            std::vector<T> const& data) {
+    //the data products are raw data, everything else is metadata
+    bool const isRawData = dsname == PRODUCTS_DSNAME;
+    if(isRawData) {
+      register_dataset_timer_start(dsname.c_str());
+    } else {
+      register_dataset_sz_timer_start(dsname.c_str());
+    }
     constexpr hsize_t ndims = 1;
     auto dset = hdf5::Dataset::open(gid, dsname.c_str()); 
     auto old_fspace = hdf5::Dataspace::get_space(dset);
@@ -46,32 +62,51 @@ namespace {
     new_fspace.select_hyperslab(old_dims, slab_size);
     auto mem_space = hdf5::Dataspace::create_simple(ndims, slab_size, max_dims);
     dset.write<T>(mem_space, new_fspace, data); //H5Dwrite
+    if(isRawData) {
+      register_dataset_timer_end(data.size()*sizeof(T));
+    } else {
+      register_dataset_sz_timer_end(data.size()*sizeof(T));
+    }
   }
 }
 
-HDFBatchEventsOutputer::HDFBatchEventsOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, pds::Compression iCompression, int iCompressionLevel, CompressionChoice iChoice, pds::Serialization iSerialization, uint32_t iBatchSize) : 
+HDFBatchEventsOutputer::HDFBatchEventsOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, unsigned long long iChunkTargetBytes, pds::Compression iCompression, int iCompressionLevel, CompressionChoice iChoice, pds::Serialization iSerialization, uint32_t iBatchSize, std::size_t iBatchBytes, bool iDirectChunk, bool iH5Timing, unsigned int iWriterCredits, bool iEventOrder, std::size_t iOrderMaxEvents, std::size_t iOrderMaxBytes) : 
   file_(hdf5::File::create(iFileName.c_str())),
   group_(hdf5::Group::create(file_, GNAME)),
   chunkSize_{iChunkSize},
+  chunkTargetBytes_{iChunkTargetBytes},
   serializers_{std::size_t(iNLanes)},
   eventBatches_{iNLanes},
   waitingEventsInBatch_(iNLanes),
   presentEventEntry_(0),
   batchSize_(iBatchSize),
+  batchBytes_(iBatchBytes),
   compression_{iCompression},
   compressionLevel_{iCompressionLevel},
   compressionChoice_{iChoice},
   serialization_{iSerialization},
+  directChunk_{iDirectChunk},
   serialTime_{std::chrono::microseconds::zero()},
-  parallelTime_{0}
+  parallelTime_{0},
+  laneEventIndex_(iNLanes, 0)
   {
+    if(iEventOrder) {
+      eventOrder_ = std::make_unique<EventOrderBuffer<EventInfo>>(iOrderMaxEvents, iOrderMaxBytes);
+      //at most one batch per lane can wait so there is no need to stall
+      batchOrder_ = std::make_unique<EventOrderBuffer<Batch>>(std::numeric_limits<std::size_t>::max(), std::numeric_limits<std::size_t>::max());
+    }
     for(auto& v: waitingEventsInBatch_) {
       v.store(0);
     }
     for(auto& v:eventBatches_) {
       v.store(nullptr);
     }
-    
+    if(iH5Timing) {
+      init_timers();
+    }
+    if(iWriterCredits != 0) {
+      writer_ = std::make_unique<HDFWriterThread>(iWriterCredits);
+    }
   }
 
 
@@ -98,10 +133,28 @@ void HDFBatchEventsOutputer::productReadyAsync(unsigned int iLaneIndex, DataProd
   laneSerializers[iDataProduct.index()].doWorkAsync(*group, iDataProduct.address(), std::move(iCallback));
 }
 
+void HDFBatchEventsOutputer::setEventIndex(unsigned int iLaneIndex, long iEventIndex) const {
+  laneEventIndex_[iLaneIndex] = iEventIndex;
+}
+
 void HDFBatchEventsOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const {
   auto start = std::chrono::high_resolution_clock::now();
   auto [offsets, buffer] = writeDataProductsToOutputBuffer(serializers_[iLaneIndex]);
 
+  if(eventOrder_) {
+    const_cast<HDFBatchEventsOutputer*>(this)->outputInOrderAsync(laneEventIndex_[iLaneIndex], EventInfo(iEventID, std::move(offsets), std::move(buffer)), std::move(iCallback));
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    parallelTime_ += time.count();
+    return;
+  }
+
+  if(batchBytes_ != 0) {
+    const_cast<HDFBatchEventsOutputer*>(this)->outputSizedBatchAsync(EventInfo(iEventID, std::move(offsets), std::move(buffer)), std::move(iCallback));
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    parallelTime_ += time.count();
+    return;
+  }
+
   auto eventIndex = presentEventEntry_++;
   auto batchIndex = (eventIndex/batchSize_) % eventBatches_.size();
 
@@ -140,6 +193,11 @@ void HDFBatchEventsOutputer::printSummary() const  {
     
     {
       TaskHolder th(group, make_functor_task([](){}));
+      if(eventOrder_) {
+        const_cast<HDFBatchEventsOutputer*>(this)->finishInOrder(th);
+      } else if(batchBytes_ != 0) {
+        const_cast<HDFBatchEventsOutputer*>(this)->finishSizedBatch(th);
+      }
       for( int index=0; index < waitingEventsInBatch_.size();++index) {
         if(0 != waitingEventsInBatch_[index].load()) {
           const_cast<HDFBatchEventsOutputer*>(this)->finishBatchAsync(index, th);
@@ -149,12 +207,35 @@ void HDFBatchEventsOutputer::printSummary() const  {
     
     group.wait();
   }
+  if(writer_) {
+    writer_->drain();
+  }
+  if(not datasetsCreated_) {
+    const_cast<HDFBatchEventsOutputer*>(this)->finishSampling();
+  }
+  if(chunkWriter_) {
+    chunkWriter_->finish();
+  }
   auto writeTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
 
   std::cout <<"HDFBatchEventsOutputer\n  total serial time at end event: "<<serialTime_.count()<<"us\n"
     "  total parallel time at end event: "<<parallelTime_.load()<<"us\n";
   std::cout << "  end of job file write time: "<<writeTime.count()<<"us\n";
+  if(chunkWriter_) {
+    std::cout <<"  direct chunk writes: "<<chunkWriter_->nChunks()<<" chunks\n"
+      "   chunk compress time: "<<chunkWriter_->compressTime().count()<<"us\n"
+      "   chunk write time: "<<chunkWriter_->writeTime().count()<<"us\n";
+  }
+  if(writer_) {
+    std::cout <<"  writer thread busy time: "<<writer_->busyTime().count()<<"us\n"
+      "  writer thread stalls: "<<writer_->nStalls()<<"\n";
+  }
+  if(eventOrder_) {
+    std::cout << "  event order: max held events "<<eventOrder_->maxHeldEvents()<<", max held bytes "<<eventOrder_->maxHeldBytes()<<"\n"
+      "   lanes stalled "<<eventOrder_->nStalls()<<" times for "<<eventOrder_->stallTime().count()<<"us\n";
+  }
 
+  print_write_timers();
   summarize_serializers(serializers_);
 }
 
@@ -164,30 +245,42 @@ void HDFBatchEventsOutputer::finishBatchAsync(unsigned int iBatchIndex, TaskHold
   auto eventsInBatch = waitingEventsInBatch_[iBatchIndex].load();
   waitingEventsInBatch_[iBatchIndex] = 0;
 
+  writeBatchAsync(combineBatch(*batch, eventsInBatch), std::move(iCallback));
+}
+
+HDFBatchEventsOutputer::Batch HDFBatchEventsOutputer::combineBatch(std::vector<EventInfo>& iEvents, uint32_t iNEvents) const {
+  //batch can be smaller than usual. Can happen at end of job
+  auto const nEvents = std::min<std::size_t>(iNEvents, iEvents.size());
+
+  //size the buffers exactly so they are never reallocated while appending
+  //one extra offset per event to put the final blob size. This is either the
+  // compressed size or the uncompressed size depending on the compression choice
+  std::size_t nOffsets = nEvents;
+  std::size_t nBytes = 0;
+  for(std::size_t index = 0; index < nEvents; ++index) {
+    nOffsets += std::get<1>(iEvents[index]).size();
+    nBytes += std::get<2>(iEvents[index]).size();
+  }
+
   std::vector<EventIdentifier> batchEventIDs;
-  batchEventIDs.reserve(batch->size());
+  batchEventIDs.reserve(nEvents);
 
   std::vector<uint32_t> batchOffsets;
-  batchOffsets.reserve(batch->size() * (serializers_.size()+2));
-  //one extra size to but the final blob size. This is either the
-  // compressed size or the uncompressed size depending on the compression choice
+  batchOffsets.reserve(nOffsets);
 
   std::vector<char> batchBlob;
+  batchBlob.reserve(nBytes);
 
-  int index = 0;
-  for(auto& [id, offsets, blob]: *batch) {
-    if(index++ == eventsInBatch) {
-      //batch was smaller than usual. Can happen at end of job
-      break;
-    }
+  for(std::size_t index = 0; index < nEvents; ++index) {
+    auto& [id, offsets, blob] = iEvents[index];
     batchEventIDs.push_back(id);
 
-    std::copy(offsets.begin(), offsets.end(), std::back_inserter(batchOffsets));
+    batchOffsets.insert(batchOffsets.end(), offsets.begin(), offsets.end());
 
     //record the size of the blob as the final offset. Needed to decompress
     // the event during reading
     batchOffsets.push_back(blob.size());
-    std::copy(blob.begin(), blob.end(), std::back_inserter(batchBlob));
+    batchBlob.insert(batchBlob.end(), blob.begin(), blob.end());
 
     //release memory
     blob = {};
@@ -200,18 +293,111 @@ void HDFBatchEventsOutputer::finishBatchAsync(unsigned int iBatchIndex, TaskHold
   } else {
     bufferToWrite = std::move(batchBlob);
   }
+  return {std::move(batchEventIDs), std::move(batchOffsets), std::move(bufferToWrite)};
+}
 
+void HDFBatchEventsOutputer::writeBatchAsync(Batch iBatch, TaskHolder iCallback) {
+  auto& [batchEventIDs, batchOffsets, bufferToWrite] = iBatch;
+  if(writer_) {
+    writer_->push([this, eventIDs=std::move(batchEventIDs), offsets = std::move(batchOffsets), buffer = std::move(bufferToWrite)]() mutable {
+        auto start = std::chrono::high_resolution_clock::now();
+        output(std::move(eventIDs), std::move(buffer), std::move(offsets));
+        serialTime_ += std::chrono::duration_cast<decltype(serialTime_)>(std::chrono::high_resolution_clock::now() - start);
+      }, std::move(iCallback));
+    return;
+  }
   
   queue_.push(*iCallback.group(), [this, eventIDs=std::move(batchEventIDs), offsets = std::move(batchOffsets), buffer = std::move(bufferToWrite),  callback=std::move(iCallback)]() mutable {
       auto start = std::chrono::high_resolution_clock::now();
-      const_cast<HDFBatchEventsOutputer*>(this)->output(std::move(eventIDs), std::move(buffer), std::move(offsets));
+      auto appends = const_cast<HDFBatchEventsOutputer*>(this)->output(std::move(eventIDs), std::move(buffer), std::move(offsets));
         serialTime_ += std::chrono::duration_cast<decltype(serialTime_)>(std::chrono::high_resolution_clock::now() - start);
+      if(not appends.empty()) {
+        chunkWriter_->writeAsync(std::move(appends), queue_, callback);
+      }
       callback.doneWaiting();
     });
   
 }
 
-void 
+bool HDFBatchEventsOutputer::batchIsFull(std::size_t iNEvents, std::size_t iBytes) const {
+  if(batchBytes_ != 0) {
+    return iBytes >= batchBytes_;
+  }
+  return iNEvents == batchSize_;
+}
+
+void HDFBatchEventsOutputer::outputSizedBatchAsync(EventInfo iEvent, TaskHolder iCallback) {
+  std::vector<EventInfo> fullBatch;
+  {
+    std::lock_guard<std::mutex> guard(sizedBatchMutex_);
+    sizedBatchBytes_ += std::get<2>(iEvent).size();
+    sizedBatch_.push_back(std::move(iEvent));
+    if(batchIsFull(sizedBatch_.size(), sizedBatchBytes_)) {
+      std::swap(fullBatch, sizedBatch_);
+      sizedBatchBytes_ = 0;
+    }
+  }
+  //combining and compressing is done outside the lock so other lanes can keep adding events
+  if(not fullBatch.empty()) {
+    writeBatchAsync(combineBatch(fullBatch, fullBatch.size()), std::move(iCallback));
+  }
+}
+
+void HDFBatchEventsOutputer::finishSizedBatch(TaskHolder iCallback) {
+  if(not sizedBatch_.empty()) {
+    writeBatchAsync(combineBatch(sizedBatch_, sizedBatch_.size()), std::move(iCallback));
+    sizedBatch_.clear();
+    sizedBatchBytes_ = 0;
+  }
+}
+
+void HDFBatchEventsOutputer::outputInOrderAsync(long iEventIndex, EventInfo iEvent, TaskHolder iCallback) {
+  auto const bytes = std::get<2>(iEvent).size();
+  std::vector<std::pair<unsigned long long, std::vector<EventInfo>>> fullBatches;
+  eventOrder_->insert(iEventIndex, std::move(iEvent), bytes, iCallback, [this, &fullBatches](EventInfo&& iReady) {
+      addOrderedEvent(std::move(iReady), fullBatches);
+    });
+  //batches are combined concurrently but must also be written in order
+  for(auto& [batchNumber, events]: fullBatches) {
+    auto batch = combineBatch(events, events.size());
+    auto const batchBytes = std::get<2>(batch).size();
+    batchOrder_->insert(batchNumber, std::move(batch), batchBytes, iCallback, [this, &iCallback](Batch&& iReady) {
+        writeBatchAsync(std::move(iReady), iCallback);
+      });
+  }
+}
+
+void HDFBatchEventsOutputer::addOrderedEvent(EventInfo&& iEvent, std::vector<std::pair<unsigned long long, std::vector<EventInfo>>>& oFullBatches) {
+  orderedBytes_ += std::get<2>(iEvent).size();
+  orderedEvents_.push_back(std::move(iEvent));
+  if(batchIsFull(orderedEvents_.size(), orderedBytes_)) {
+    oFullBatches.emplace_back(nOrderedBatches_++, std::move(orderedEvents_));
+    orderedEvents_ = std::vector<EventInfo>();
+    orderedBytes_ = 0;
+  }
+}
+
+void HDFBatchEventsOutputer::finishInOrder(TaskHolder iCallback) {
+  std::vector<std::pair<unsigned long long, std::vector<EventInfo>>> fullBatches;
+  eventOrder_->flush([this, &fullBatches](EventInfo&& iReady) {
+      addOrderedEvent(std::move(iReady), fullBatches);
+    });
+  if(not orderedEvents_.empty()) {
+    fullBatches.emplace_back(nOrderedBatches_++, std::move(orderedEvents_));
+    orderedEvents_ = std::vector<EventInfo>();
+  }
+  auto write = [this, &iCallback](Batch&& iReady) {
+    writeBatchAsync(std::move(iReady), iCallback);
+  };
+  for(auto& [batchNumber, events]: fullBatches) {
+    auto batch = combineBatch(events, events.size());
+    auto const batchBytes = std::get<2>(batch).size();
+    batchOrder_->insert(batchNumber, std::move(batch), batchBytes, iCallback, write);
+  }
+  batchOrder_->flush(write);
+}
+
+std::vector<HDFDirectChunkWriter::Append>
 HDFBatchEventsOutputer::output(std::vector<EventIdentifier> iEventIDs, 
                          std::vector<char> iBuffer,
                          std::vector<uint32_t> iOffsets ) {
@@ -232,25 +418,112 @@ HDFBatchEventsOutputer::output(std::vector<EventIdentifier> iEventIDs,
   std::vector<unsigned long long> ids;
   ids.reserve(iEventIDs.size());
   std::transform(iEventIDs.begin(), iEventIDs.end(), std::back_inserter(ids), [](auto const&id) {return id.event;});
+  if(not datasetsCreated_) {
+    nSampledEvents_ += ids.size();
+    sampledBatches_.emplace_back(std::move(ids), std::move(iBuffer), std::move(iOffsets));
+    if(nSampledEvents_ < kEventsToSample) {
+      return {};
+    }
+    return writeSampledBatches();
+  }
+  return write(ids, std::move(iBuffer), iOffsets);
+}
+
+std::vector<HDFDirectChunkWriter::Append>
+HDFBatchEventsOutputer::write(std::vector<unsigned long long> const& ids,
+                              std::vector<char> iBuffer,
+                              std::vector<uint32_t> const& iOffsets) {
   //std::cout <<" ids "<<ids.size()<<std::endl;
   write_ds<unsigned long long>(group_, EVENTS_DSNAME, ids);
   //std::cout <<"wrote ids"<<std::endl;
-  write_ds<char>(group_, PRODUCTS_DSNAME, iBuffer);
+  //number of events and number of bytes stored for the batch
+  std::vector<uint32_t> batch = {static_cast<uint32_t>(ids.size()), static_cast<uint32_t>(iBuffer.size())};
+  std::vector<HDFDirectChunkWriter::Append> appends;
+  if(chunkWriter_) {
+    appends.push_back(chunkWriter_->append(std::move(iBuffer)));
+  } else {
+    write_ds<char>(group_, PRODUCTS_DSNAME, iBuffer);
+  }
   write_ds<uint32_t>(group_, OFFSETS_DSNAME, iOffsets); 
+  write_ds<uint32_t>(group_, BATCHES_DSNAME, batch);
+  return appends;
 }
 
-void 
-HDFBatchEventsOutputer::writeFileHeader(SerializeStrategy const& iSerializers) {
+std::vector<HDFDirectChunkWriter::Append>
+HDFBatchEventsOutputer::writeSampledBatches() {
+  unsigned long long bytes = 0;
+  for(auto const& batch: sampledBatches_) {
+    bytes += std::get<1>(batch).size();
+  }
+  unsigned long long const bytesPerEvent = std::max<unsigned long long>(1, bytes/std::max<size_t>(1, nSampledEvents_));
+  hsize_t const eventsPerChunk = std::max<unsigned long long>(1, chunkTargetBytes_/bytesPerEvent);
+  //batches may hold a varying number of events when using batchBytes
+  hsize_t const eventsPerBatch = std::max<size_t>(1, nSampledEvents_/std::max<size_t>(1, sampledBatches_.size()));
+  //keep the same events together in the chunks of all datasets
+  createDatasets(eventsPerChunk*bytesPerEvent, eventsPerChunk, eventsPerChunk*(nProducts_+2), 2*std::max<hsize_t>(1, eventsPerChunk/eventsPerBatch));
+
+  const auto scalar_space  = hdf5::Dataspace::create_scalar();
+  hdf5::Attribute::create<unsigned long long>(group_, CHUNK_TARGET_BYTES_ANAME, scalar_space).write(chunkTargetBytes_);
+  hdf5::Attribute::create<unsigned long long>(group_, BYTES_PER_EVENT_ANAME, scalar_space).write(bytesPerEvent);
+  hdf5::Attribute::create<unsigned long long>(group_, EVENTS_PER_CHUNK_ANAME, scalar_space).write(static_cast<unsigned long long>(eventsPerChunk));
+
+  std::vector<HDFDirectChunkWriter::Append> appends;
+  for(auto& [eventNumbers, buffer, offsets]: sampledBatches_) {
+    auto placed = write(eventNumbers, std::move(buffer), offsets);
+    std::move(placed.begin(), placed.end(), std::back_inserter(appends));
+  }
+  sampledBatches_ = decltype(sampledBatches_)();
+  return appends;
+}
+
+void
+HDFBatchEventsOutputer::finishSampling() {
+  //the job ended before enough events were seen
+  tbb::task_group group;
+  {
+    TaskHolder th(group, make_functor_task([](){}));
+    auto appends = writeSampledBatches();
+    if(not appends.empty()) {
+      chunkWriter_->writeAsync(std::move(appends), queue_, th);
+    }
+  }
+  group.wait();
+}
+
+void
+HDFBatchEventsOutputer::createDatasets(hsize_t iProductsChunk, hsize_t iEventsChunk, hsize_t iOffsetsChunk, hsize_t iBatchesChunk) {
   constexpr hsize_t ndims = 1;
   constexpr hsize_t dims[ndims] = {0};
-  hsize_t chunk_dims[ndims] = {static_cast<hsize_t>(chunkSize_)};
   constexpr hsize_t  max_dims[ndims] = {H5S_UNLIMITED};
   auto space = hdf5::Dataspace::create_simple (ndims, dims, max_dims); 
-  auto prop   = hdf5::Property::create();
-  prop.set_chunk(ndims, chunk_dims);
-  hdf5::Dataset::create<int>(group_, EVENTS_DSNAME, space, prop);
-  hdf5::Dataset::create<char>(group_, PRODUCTS_DSNAME, space, prop);
-  hdf5::Dataset::create<int>(group_, OFFSETS_DSNAME, space, prop);
+  auto events_prop = hdf5::Property::create();
+  events_prop.set_chunk(ndims, &iEventsChunk);
+  hdf5::Dataset::create<int>(group_, EVENTS_DSNAME, space, events_prop);
+  auto products_prop = hdf5::Property::create();
+  products_prop.set_chunk(ndims, &iProductsChunk);
+  if(directChunk_) {
+    HDFDirectChunkWriter::setZstdFilter(products_prop, compressionLevel_);
+    hdf5::Dataset::create<char>(group_, PRODUCTS_DSNAME, space, products_prop);
+    chunkWriter_ = std::make_unique<HDFDirectChunkWriter>(group_, PRODUCTS_DSNAME, iProductsChunk, compressionLevel_);
+  } else {
+    hdf5::Dataset::create<char>(group_, PRODUCTS_DSNAME, space, products_prop);
+  }
+  auto offsets_prop = hdf5::Property::create();
+  offsets_prop.set_chunk(ndims, &iOffsetsChunk);
+  hdf5::Dataset::create<int>(group_, OFFSETS_DSNAME, space, offsets_prop);
+  auto batches_prop = hdf5::Property::create();
+  batches_prop.set_chunk(ndims, &iBatchesChunk);
+  hdf5::Dataset::create<int>(group_, BATCHES_DSNAME, space, batches_prop);
+  datasetsCreated_ = true;
+}
+
+void 
+HDFBatchEventsOutputer::writeFileHeader(SerializeStrategy const& iSerializers) {
+  constexpr hsize_t ndims = 1;
+  nProducts_ = iSerializers.size();
+  if(chunkSize_ != 0) {
+    createDatasets(chunkSize_, chunkSize_, chunkSize_, chunkSize_);
+  }
 
   const auto scalar_space  = hdf5::Dataspace::create_scalar();
   hdf5::Attribute::create<int>(group_, RUN_ANAME, scalar_space);
@@ -262,11 +535,22 @@ HDFBatchEventsOutputer::writeFileHeader(SerializeStrategy const& iSerializers) {
   H5Tset_size(attr_type, H5T_VARIABLE);
   auto const attr_space  = H5Screate(H5S_SCALAR);
   hdf5::Attribute compression = hdf5::Attribute::create<std::string>(group_,COMPRESSION_ANAME, attr_space); 
+  hdf5::Attribute serialization = hdf5::Attribute::create<std::string>(group_,SERIALIZATION_ANAME, attr_space); 
+  serialization.write<std::string>(serialization_ == pds::Serialization::kRoot ? "ROOT" : "ROOTUnrolled");
+  std::vector<std::string> productNames;
   for(auto const& s: iSerializers) {
     std::string const type(s.className());
     std::string const name(s.name());
     hdf5::Attribute prod_name = hdf5::Attribute::create<std::string>(group_, name.c_str(), attr_space); 
     prod_name.write<std::string>(type);
+    productNames.push_back(name);
+  }
+  //the order of the data products within each event
+  hsize_t nProducts = productNames.size();
+  auto names_space = hdf5::Dataspace::create_simple(ndims, &nProducts, NULL);
+  hdf5::Attribute names = hdf5::Attribute::create<std::string>(group_, PRODUCT_NAMES_ANAME, names_space);
+  if(not productNames.empty()) {
+    names.write_strings(productNames);
   }
 }
 
@@ -314,7 +598,18 @@ namespace {
         return {};
       }
 
-      auto chunkSize = params.get<int>("hdfchunkSize", 10485760);
+      //'auto' chooses the chunk sizes from the first events
+      auto chunkSizeName = params.get<std::string>("hdfchunkSize", "10485760");
+      int chunkSize = 0;
+      if(chunkSizeName != "auto") {
+        auto end = chunkSizeName.data()+chunkSizeName.size();
+        auto result = std::from_chars(chunkSizeName.data(), end, chunkSize);
+        if(result.ec != std::errc() or result.ptr != end or chunkSize <= 0) {
+          std::cout <<"hdfchunkSize must be 'auto' or greater than 0"<<std::endl;
+          return {};
+        }
+      }
+      auto chunkTargetBytes = params.get<std::size_t>("chunkTargetBytes", 1048576);
       int compressionLevel = params.get<int>("compressionLevel", 18);
       auto compressionName = params.get<std::string>("compressionAlgorithm", "ZSTD");
       auto compression = pds::toCompression(compressionName);
@@ -343,8 +638,35 @@ namespace {
       }
 
       auto batchSize = params.get<int>("batchSize",1);
+      auto batchBytes = params.get<std::size_t>("batchBytes",0);
+
+      auto directChunk = params.get<bool>("directChunk", false);
+      if(directChunk) {
+        //the chunks are compressed instead of the events or batches
+        if(*compression != pds::Compression::kZSTD) {
+          std::cout <<"directChunk requires compressionAlgorithm=ZSTD"<<std::endl;
+          return {};
+        }
+        compressionChoice = HDFBatchEventsOutputer::CompressionChoice::kNone;
+      }
+      unsigned int writerCredits = 0;
+      if(params.get<bool>("writerThread", false)) {
+        if(directChunk) {
+          std::cout <<"writerThread can not be used with directChunk"<<std::endl;
+          return {};
+        }
+        writerCredits = params.get<unsigned int>("writerCredits", 4);
+        if(writerCredits == 0) {
+          std::cout <<"writerCredits must be greater than 0"<<std::endl;
+          return {};
+        }
+      }
+
+      auto eventOrder = params.get<bool>("eventOrder", false);
+      auto orderMaxEvents = params.get<std::size_t>("orderMaxEvents", 64);
+      auto orderMaxBytes = params.get<std::size_t>("orderMaxBytes", 104857600);
 
-      return std::make_unique<HDFBatchEventsOutputer>(*fileName, iNLanes, chunkSize, *compression, compressionLevel, compressionChoice, *serialization, batchSize);
+      return std::make_unique<HDFBatchEventsOutputer>(*fileName, iNLanes, chunkSize, chunkTargetBytes, *compression, compressionLevel, compressionChoice, *serialization, batchSize, batchBytes, directChunk, params.get<bool>("h5Timing", false), writerCredits, eventOrder, orderMaxEvents, orderMaxBytes);
     }
   };
 
@@ -6,6 +6,9 @@
 #include <string>
 #include <cstdint>
 #include <fstream>
+#include <memory>
+#include <tuple>
+#include <mutex>
 
 
 #include "OutputerBase.h"
@@ -17,6 +20,9 @@
 #include "SerialTaskQueue.h"
 
 #include "HDFCxx.h"
+#include "HDFDirectChunkWriter.h"
+#include "HDFWriterThread.h"
+#include "EventOrderBuffer.h"
 
 
 namespace cce::tf {
@@ -29,7 +35,12 @@ namespace cce::tf {
         kBoth
     };
 
-    HDFBatchEventsOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, pds::Compression iCompression, int iCompressionLevel, CompressionChoice iChoice, pds::Serialization iSerialization, uint32_t iBatchSize);
+    //an iWriterCredits of 0 does the HDF5 calls in a SerialTaskQueue instead of on a dedicated thread
+    //an iChunkSize of 0 chooses the chunk sizes from the first events to be near iChunkTargetBytes
+    HDFBatchEventsOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, unsigned long long iChunkTargetBytes, pds::Compression iCompression, int iCompressionLevel, CompressionChoice iChoice, pds::Serialization iSerialization, uint32_t iBatchSize, std::size_t iBatchBytes, bool iDirectChunk, bool iH5Timing, unsigned int iWriterCredits, bool iEventOrder, std::size_t iOrderMaxEvents, std::size_t iOrderMaxBytes);
+
+    //minimum number of events used to find the bytes per event when choosing the chunk sizes
+    static constexpr unsigned int kEventsToSample = 16;
     HDFBatchEventsOutputer(HDFBatchEventsOutputer&&) = default;
     HDFBatchEventsOutputer(HDFBatchEventsOutputer const&) = default;
 
@@ -38,15 +49,36 @@ namespace cce::tf {
   void productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const& iDataProduct, TaskHolder iCallback) const final;
   bool usesProductReadyAsync() const final {return true;}
 
+  void setEventIndex(unsigned int iLaneIndex, long iEventIndex) const final;
+
   void outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const final;
   
   void printSummary() const final;
 
  private:
+  using EventInfo = std::tuple<EventIdentifier, std::vector<uint32_t>, std::vector<char>>;
+  //event identifiers, offsets and blob of all events in a batch
+  using Batch = std::tuple<std::vector<EventIdentifier>, std::vector<uint32_t>, std::vector<char>>;
 
   void finishBatchAsync(unsigned int iBatchIndex, TaskHolder iCallback);
-
-  void output(std::vector<EventIdentifier> iEventID, std::vector<char> iBuffer, std::vector<uint32_t> iOffset);
+  Batch combineBatch(std::vector<EventInfo>& iEvents, uint32_t iNEvents) const;
+  void writeBatchAsync(Batch iBatch, TaskHolder iCallback);
+
+  //when using batchBytes_ a batch is closed once its events reach that many bytes
+  bool batchIsFull(std::size_t iNEvents, std::size_t iBytes) const;
+  void outputSizedBatchAsync(EventInfo iEvent, TaskHolder iCallback);
+  void finishSizedBatch(TaskHolder iCallback);
+
+  void outputInOrderAsync(long iEventIndex, EventInfo iEvent, TaskHolder iCallback);
+  void addOrderedEvent(EventInfo&& iEvent, std::vector<std::pair<unsigned long long, std::vector<EventInfo>>>& oFullBatches);
+  void finishInOrder(TaskHolder iCallback);
+
+  //returns the chunks filled when using direct chunk writes
+  std::vector<HDFDirectChunkWriter::Append> output(std::vector<EventIdentifier> iEventID, std::vector<char> iBuffer, std::vector<uint32_t> iOffset);
+  std::vector<HDFDirectChunkWriter::Append> write(std::vector<unsigned long long> const& iEventNumbers, std::vector<char> iBuffer, std::vector<uint32_t> const& iOffsets);
+  std::vector<HDFDirectChunkWriter::Append> writeSampledBatches();
+  void finishSampling();
+  void createDatasets(hsize_t iProductsChunk, hsize_t iEventsChunk, hsize_t iOffsetsChunk, hsize_t iBatchesChunk);
   void writeFileHeader(SerializeStrategy const& iSerializers);
   std::pair<std::vector<uint32_t>,std::vector<char>> writeDataProductsToOutputBuffer(SerializeStrategy const& iSerializers) const;
 
@@ -55,23 +87,47 @@ private:
   hdf5::Group group_;
   mutable SerialTaskQueue queue_;
   int chunkSize_;
+  unsigned long long chunkTargetBytes_;
+  bool datasetsCreated_ = false;
+  size_t nProducts_ = 0;
+  //batches held until the chunk sizes have been chosen
+  std::vector<std::tuple<std::vector<unsigned long long>, std::vector<char>, std::vector<uint32_t>>> sampledBatches_;
+  size_t nSampledEvents_ = 0;
   mutable std::vector<SerializeStrategy> serializers_;
 
   //This is used as a circular buffer of length nLanes but only entries being used exist
-  using EventInfo = std::tuple<EventIdentifier, std::vector<uint32_t>, std::vector<char>>;
   mutable std::vector<std::atomic<std::vector<EventInfo>*>> eventBatches_;
   mutable std::vector<std::atomic<uint32_t>> waitingEventsInBatch_;
 
   mutable std::atomic<uint64_t> presentEventEntry_;
 
   uint32_t batchSize_;
+  std::size_t batchBytes_;
+  //only used with batchBytes_
+  std::mutex sizedBatchMutex_;
+  std::vector<EventInfo> sizedBatch_;
+  std::size_t sizedBatchBytes_ = 0;
   bool firstEvent_ = true;
   pds::Compression compression_;
   int compressionLevel_;
   CompressionChoice compressionChoice_;
   pds::Serialization serialization_;
+  bool directChunk_;
+  std::unique_ptr<HDFDirectChunkWriter> chunkWriter_;
   mutable std::chrono::microseconds serialTime_;
   mutable std::atomic<std::chrono::microseconds::rep> parallelTime_;
+
+  //only used when writing the events in the order given by the source
+  mutable std::vector<long> laneEventIndex_;
+  std::unique_ptr<EventOrderBuffer<EventInfo>> eventOrder_;
+  std::unique_ptr<EventOrderBuffer<Batch>> batchOrder_;
+  //events passed on by eventOrder_ which do not yet fill a batch
+  std::vector<EventInfo> orderedEvents_;
+  std::size_t orderedBytes_ = 0;
+  unsigned long long nOrderedBatches_ = 0;
+
+  //declared after file_ so pending writes are done before the file is closed
+  std::unique_ptr<HDFWriterThread> writer_;
   };    
 }
 #endif
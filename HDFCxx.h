@@ -3,6 +3,7 @@
 
 #include "hdf5.h"
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace cce::tf::hdf5 {
@@ -40,8 +41,13 @@ class File {
     static File open(const char *name) {
       return File(H5Fopen(name, H5F_ACC_RDONLY, H5P_DEFAULT));
     }
+    File(File&& iOther): file_(iOther.file_) { iOther.file_ = -1; }
+    File(File const&) = delete;
+    File& operator=(File const&) = delete;
     ~File() {
-      H5Fclose(file_);
+      if (file_ >= 0) {
+        H5Fclose(file_);
+      }
     }
     operator hid_t() const {return file_;}
   private:
@@ -61,8 +67,13 @@ class Group {
     static Group open(hid_t id, const char *name) {
       return Group(H5Gopen2(id, name, H5P_DEFAULT));
     }
+    Group(Group&& iOther): group_(iOther.group_) { iOther.group_ = -1; }
+    Group(Group const&) = delete;
+    Group& operator=(Group const&) = delete;
     ~Group() {
-      H5Gclose(group_);
+      if (group_ >= 0) {
+        H5Gclose(group_);
+      }
     }
     operator hid_t() const {return group_;}
   private:
@@ -84,8 +95,15 @@ class Dataset {
     } 
     static Dataset open(hid_t id, const char *name){
       return Dataset(H5Dopen2(id, name, H5P_DEFAULT));}
+    static Dataset open(hid_t id, const char *name, hid_t dapl_id){
+      return Dataset(H5Dopen2(id, name, dapl_id));}
+    Dataset(Dataset&& iOther): dataset_(iOther.dataset_) { iOther.dataset_ = -1; }
+    Dataset(Dataset const&) = delete;
+    Dataset& operator=(Dataset const&) = delete;
     ~Dataset() { 
-       H5Dclose(dataset_);
+      if (dataset_ >= 0) {
+        H5Dclose(dataset_);
+      }
     }
     operator hid_t() const {return dataset_;}
     
@@ -129,6 +147,50 @@ class Attribute {
     auto write(T const & data){
         return H5Awrite(attribute_, H5memtype_for<T>, &data);
     } 
+    auto write_strings(std::vector<std::string> const& data) {
+      std::vector<char const*> pointers;
+      pointers.reserve(data.size());
+      for (auto const& d: data) {
+        pointers.push_back(d.c_str());
+      }
+      return H5Awrite(attribute_, H5memtype_for<std::string>, pointers.data());
+    }
+
+    template<typename T>
+    auto read(T& data) const {
+      return H5Aread(attribute_, H5memtype_for<T>, &data);
+    }
+    std::string read_string() const {
+      char* value = nullptr;
+      if (H5Aread(attribute_, H5memtype_for<std::string>, &value) < 0) {
+        throw std::runtime_error("Unable to read the attribute\n");
+      }
+      if (value == nullptr) {
+        return std::string();
+      }
+      std::string s(value);
+      H5free_memory(value);
+      return s;
+    }
+    std::vector<std::string> read_strings() const {
+      auto space = H5Aget_space(attribute_);
+      auto n = H5Sget_simple_extent_npoints(space);
+      H5Sclose(space);
+      std::vector<std::string> strings;
+      if (n <= 0) {
+        return strings;
+      }
+      std::vector<char*> values(n, nullptr);
+      if (H5Aread(attribute_, H5memtype_for<std::string>, values.data()) < 0) {
+        throw std::runtime_error("Unable to read the attribute\n");
+      }
+      strings.reserve(n);
+      for (auto v: values) {
+        strings.emplace_back(v ? v : "");
+        H5free_memory(v);
+      }
+      return strings;
+    }
    private: 
      explicit Attribute(hid_t a_id):attribute_(a_id) {
        if (attribute_ < 0) {
@@ -159,8 +221,13 @@ class Dataspace {
         throw std::runtime_error("Unable to select hyperslab\n");
       }
     } 
+    Dataspace(Dataspace&& iOther): dspace_(iOther.dspace_) { iOther.dspace_ = -1; }
+    Dataspace(Dataspace const&) = delete;
+    Dataspace& operator=(Dataspace const&) = delete;
     ~Dataspace() {
-      H5Sclose(dspace_);
+      if (dspace_ >= 0) {
+        H5Sclose(dspace_);
+      }
     }
     operator hid_t() const {return dspace_;}
   private:
@@ -181,12 +248,21 @@ class Property {
     static Property create() {
       return Property(H5Pcreate(H5P_DATASET_CREATE));
     }
+    static Property create_access() {
+      return Property(H5Pcreate(H5P_DATASET_ACCESS));
+    }
     void set_chunk(hsize_t ndims, hsize_t const *dims) {
       auto err = H5Pset_chunk(prop_, ndims, dims);
       if (err < 0) {
         throw std::runtime_error("Unable to set chunk size\n");
       }
     } 
+    void set_chunk_cache(size_t nslots, size_t nbytes, double w0) {
+      auto err = H5Pset_chunk_cache(prop_, nslots, nbytes, w0);
+      if (err < 0) {
+        throw std::runtime_error("Unable to set chunk cache\n");
+      }
+    }
     ~Property() {
       H5Pclose(prop_);
     }
@@ -199,5 +275,32 @@ class Property {
     }
     hid_t prop_;
 };
+
+//size in bytes of the chunks of a 1D dataset, 0 if the dataset is not chunked
+inline hsize_t chunk_bytes(hid_t dataset) {
+  hsize_t dims[1] = {0};
+  auto plist = H5Dget_create_plist(dataset);
+  if (H5Pget_layout(plist) == H5D_CHUNKED) {
+    H5Pget_chunk(plist, 1, dims);
+  }
+  H5Pclose(plist);
+  auto type = H5Dget_type(dataset);
+  auto size = H5Tget_size(type);
+  H5Tclose(type);
+  return dims[0]*size;
+}
+
+//reads elements [start, start+count) of a 1D dataset
+template<typename T>
+void read_slab(hid_t dataset, Dataspace& filespace, hsize_t start, hsize_t count, T* data) {
+  if (count == 0) {
+    return;
+  }
+  auto memspace = Dataspace::create_simple(1, &count, NULL);
+  filespace.select_hyperslab(&start, &count);
+  if (H5Dread(dataset, H5memtype_for<T>, memspace, filespace, H5P_DEFAULT, data) < 0) {
+    throw std::runtime_error("Unable to read from the dataset\n");
+  }
+}
 }
 #endif
@@ -0,0 +1,180 @@
+#include "HDFDirectChunkWriter.h"
+#include "pds_writer.h"
+#include "H5Timing.h"
+
+#include "zstd.h"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace cce::tf;
+
+namespace {
+  //The HDF5 filter callback. The chunk is replaced by the result which must be allocated with
+  // H5allocate_memory. Returning 0 tells HDF5 the filter failed.
+  size_t zstdFilter(unsigned int iFlags, size_t iNValues, const unsigned int iValues[], size_t iNBytes, size_t* ioBufferSize, void** ioBuffer) {
+    void* out = nullptr;
+    size_t outSize = 0;
+    if(iFlags & H5Z_FLAG_REVERSE) {
+      auto const frameSize = ZSTD_getFrameContentSize(*ioBuffer, iNBytes);
+      if(frameSize == ZSTD_CONTENTSIZE_UNKNOWN or frameSize == ZSTD_CONTENTSIZE_ERROR) {
+        return 0;
+      }
+      out = H5allocate_memory(frameSize, false);
+      if(not out) {
+        return 0;
+      }
+      outSize = ZSTD_decompress(out, frameSize, *ioBuffer, iNBytes);
+    } else {
+      int const level = iNValues > 0 ? iValues[0] : ZSTD_CLEVEL_DEFAULT;
+      auto const bound = ZSTD_compressBound(iNBytes);
+      out = H5allocate_memory(bound, false);
+      if(not out) {
+        return 0;
+      }
+      outSize = ZSTD_compress(out, bound, *ioBuffer, iNBytes, level);
+    }
+    if(ZSTD_isError(outSize)) {
+      H5free_memory(out);
+      return 0;
+    }
+    H5free_memory(*ioBuffer);
+    *ioBuffer = out;
+    *ioBufferSize = outSize;
+    return outSize;
+  }
+}
+
+void HDFDirectChunkWriter::registerZstdFilter() {
+  static std::once_flag s_flag;
+  std::call_once(s_flag, []() {
+      if(H5Zfilter_avail(kZstdFilterID) > 0) {
+        return;
+      }
+      static const H5Z_class2_t s_class = {
+        H5Z_CLASS_T_VERS,
+        kZstdFilterID,
+        1, 1,
+        "zstd",
+        nullptr, nullptr,
+        zstdFilter
+      };
+      if(H5Zregister(&s_class) < 0) {
+        throw std::runtime_error("Unable to register the zstd filter\n");
+      }
+    });
+}
+
+void HDFDirectChunkWriter::setZstdFilter(hid_t iCreateProperties, int iCompressionLevel) {
+  unsigned int const level = iCompressionLevel;
+  //optional so the dataset can be created even if the filter plugin is not available.
+  // The chunks are compressed by us so the plugin is only needed for reading.
+  if (H5Pset_filter(iCreateProperties, kZstdFilterID, H5Z_FLAG_OPTIONAL, 1, &level) < 0) {
+    throw std::runtime_error("Unable to set the zstd filter\n");
+  }
+}
+
+HDFDirectChunkWriter::HDFDirectChunkWriter(hid_t iGroup, const char* iDatasetName, hsize_t iChunkSize, int iCompressionLevel):
+  dataset_(hdf5::Dataset::open(iGroup, iDatasetName)),
+  name_(iDatasetName),
+  chunkSize_{iChunkSize},
+  compressionLevel_{iCompressionLevel},
+  compressTime_{0},
+  writeTime_{std::chrono::microseconds::zero()}
+{
+}
+
+HDFDirectChunkWriter::Append HDFDirectChunkWriter::append(std::vector<char> iBytes) {
+  Append placed;
+  placed.offset_ = totalBytes_;
+  totalBytes_ += iBytes.size();
+  for(hsize_t index = placed.offset_/chunkSize_; index*chunkSize_ < totalBytes_; ++index) {
+    if(tail_ and tail_->index_ == index) {
+      placed.chunks_.push_back(std::move(tail_));
+    } else {
+      placed.chunks_.push_back(std::make_shared<PendingChunk>(index));
+    }
+  }
+  placed.nFilledChunks_ = totalBytes_/chunkSize_ - placed.offset_/chunkSize_;
+  if(totalBytes_ % chunkSize_ != 0) {
+    tail_ = placed.chunks_.back();
+  } else {
+    tail_.reset();
+  }
+  placed.bytes_ = std::move(iBytes);
+  return placed;
+}
+
+std::vector<HDFDirectChunkWriter::Chunk> HDFDirectChunkWriter::pack(Append const& iAppend) const {
+  std::vector<Chunk> filled;
+  hsize_t const end = iAppend.offset_ + iAppend.bytes_.size();
+  for(auto const& chunk: iAppend.chunks_) {
+    hsize_t const chunkStart = chunk->index_*chunkSize_;
+    auto const begin = std::max(iAppend.offset_, chunkStart);
+    auto const stop = std::min(end, chunkStart+chunkSize_);
+    //the padding of the last chunk must be 0
+    std::call_once(chunk->allocated_, [this, &chunk]() { chunk->bytes_.resize(chunkSize_, 0);});
+    std::copy(iAppend.bytes_.begin()+(begin-iAppend.offset_), iAppend.bytes_.begin()+(stop-iAppend.offset_),
+              chunk->bytes_.begin()+(begin-chunkStart));
+    //only the Append which copies the last bytes sees the chunk as full
+    auto const nBytes = stop - begin;
+    if(chunk->nFilled_.fetch_add(nBytes) + nBytes == chunkSize_) {
+      filled.push_back({chunk->index_, std::move(chunk->bytes_)});
+    }
+  }
+  return filled;
+}
+
+std::vector<char> HDFDirectChunkWriter::compress(std::vector<char> const& iChunk) const {
+  auto start = std::chrono::high_resolution_clock::now();
+  auto compressed = pds::compressBuffer(0, 0, pds::Compression::kZSTD, compressionLevel_, iChunk);
+  compressTime_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+  return compressed;
+}
+
+void HDFDirectChunkWriter::write(hsize_t iIndex, std::vector<char> const& iCompressed) {
+  auto start = std::chrono::high_resolution_clock::now();
+  hsize_t offset = iIndex*chunkSize_;
+  //chunks can finish compressing out of order
+  auto neededExtent = std::min(offset + chunkSize_, totalBytes_);
+  if(neededExtent > extent_) {
+    extent_ = neededExtent;
+    dataset_.set_extent(&extent_);
+  }
+  register_dataset_timer_start(name_.c_str());
+  if(H5Dwrite_chunk(dataset_, H5P_DEFAULT, 0, &offset, iCompressed.size(), iCompressed.data()) < 0) {
+    throw std::runtime_error("Unable to write the chunk\n");
+  }
+  register_dataset_timer_end(iCompressed.size());
+  ++nChunks_;
+  writeTime_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+}
+
+void HDFDirectChunkWriter::writeAsync(std::vector<Append> iAppends, SerialTaskQueue& iQueue, TaskHolder iCallback) {
+  auto group = iCallback.group();
+  for(auto& append: iAppends) {
+    group->run([this, &iQueue, group, append = std::move(append), callback = iCallback]() {
+        for(auto& chunk: pack(append)) {
+          group->run([this, &iQueue, group, chunk = std::move(chunk), callback]() {
+              auto compressed = compress(chunk.bytes_);
+              iQueue.push(*group, [this, index = chunk.index_, compressed = std::move(compressed), callback]() {
+                  write(index, compressed);
+                });
+            });
+        }
+      });
+  }
+}
+
+void HDFDirectChunkWriter::finish() {
+  if(extent_ != totalBytes_) {
+    extent_ = totalBytes_;
+    dataset_.set_extent(&extent_);
+  }
+  if(tail_) {
+    //HDF5 stores the chunk at the end of the dataset at full size
+    std::call_once(tail_->allocated_, [this]() { tail_->bytes_.resize(chunkSize_, 0);});
+    write(tail_->index_, compress(tail_->bytes_));
+    tail_.reset();
+  }
+}
@@ -0,0 +1,91 @@
+#if !defined(HDFDirectChunkWriter_h)
+#define HDFDirectChunkWriter_h
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "SerialTaskQueue.h"
+#include "TaskHolder.h"
+#include "HDFCxx.h"
+
+namespace cce::tf {
+  /*
+   Appends bytes to a 1D char dataset by filling fixed size chunks which are compressed with
+   zstd outside of HDF5 and then stored with H5Dwrite_chunk. The dataset has to be created
+   using setZstdFilter so standard HDF5 tools with the zstd filter plugin can read the chunks.
+   Only the placement of the bytes and H5Dwrite_chunk are serialized, copying the bytes into
+   the chunks and compressing them is done by tasks.
+   */
+  class HDFDirectChunkWriter {
+  public:
+    //registered HDF5 filter ID for zstandard
+    static constexpr H5Z_filter_t kZstdFilterID = 32015;
+    static void setZstdFilter(hid_t iCreateProperties, int iCompressionLevel);
+    //Registers our own zstd filter with HDF5 if no filter plugin for kZstdFilterID is available.
+    // This allows reading the datasets written here without installing the plugin.
+    static void registerZstdFilter();
+
+    HDFDirectChunkWriter(hid_t iGroup, const char* iDatasetName, hsize_t iChunkSize, int iCompressionLevel);
+
+    struct Chunk {
+      hsize_t index_;
+      std::vector<char> bytes_;
+    };
+
+    //A chunk which is being filled by one or more Appends
+    struct PendingChunk {
+      explicit PendingChunk(hsize_t iIndex): index_{iIndex} {}
+      const hsize_t index_;
+      std::once_flag allocated_;
+      std::vector<char> bytes_;
+      std::atomic<hsize_t> nFilled_{0};
+    };
+
+    //Bytes which have been given their place in the dataset but still need to be copied
+    struct Append {
+      std::vector<char> bytes_;
+      hsize_t offset_ = 0;
+      //number of chunks which have all their bytes placed once this Append is included
+      hsize_t nFilledChunks_ = 0;
+      std::vector<std::shared_ptr<PendingChunk>> chunks_;
+    };
+
+    //Must be called from within the queue passed to writeAsync. Only decides where iBytes go,
+    // the copy into the chunks is done by writeAsync.
+    Append append(std::vector<char> iBytes);
+
+    //Copies each Append into its chunks in its own task. Each chunk which gets filled is then
+    // compressed in its own task and written using iQueue.
+    void writeAsync(std::vector<Append> iAppends, SerialTaskQueue& iQueue, TaskHolder iCallback);
+
+    //Must be called once all tasks started by writeAsync have finished. Writes the partially
+    // filled last chunk and sets the final size of the dataset.
+    void finish();
+
+    std::chrono::microseconds compressTime() const { return std::chrono::microseconds(compressTime_.load());}
+    std::chrono::microseconds writeTime() const { return writeTime_;}
+    unsigned long long nChunks() const { return nChunks_;}
+
+  private:
+    std::vector<Chunk> pack(Append const& iAppend) const;
+    std::vector<char> compress(std::vector<char> const& iChunk) const;
+    void write(hsize_t iIndex, std::vector<char> const& iCompressed);
+
+    hdf5::Dataset dataset_;
+    const std::string name_;
+    const hsize_t chunkSize_;
+    const int compressionLevel_;
+    //the last chunk which is not yet completely placed
+    std::shared_ptr<PendingChunk> tail_;
+    hsize_t totalBytes_ = 0;
+    hsize_t extent_ = 0;
+    unsigned long long nChunks_ = 0;
+    mutable std::atomic<std::chrono::microseconds::rep> compressTime_;
+    std::chrono::microseconds writeTime_;
+  };
+}
+#endif
@@ -4,12 +4,15 @@
 #include "UnrolledSerializerWrapper.h"
 #include "SerializerWrapper.h"
 #include "summarize_serializers.h"
+#include "H5Timing.h"
+#include "FunctorTask.h"
 #include "lz4.h"
 #include <memory>
 #include <iostream>
 #include <cstring>
 #include <cmath>
 #include <set>
+#include <charconv>
 
 using namespace cce::tf;
 using namespace cce::tf::pds;
@@ -24,6 +27,13 @@ namespace {
   write_ds(hid_t gid, 
            std::string const& dsname, 
            std::vector<T> const& data) {
+    //the data products are raw data, everything else is metadata
+    bool const isRawData = dsname == PRODUCTS_DSNAME;
+    if(isRawData) {
+      register_dataset_timer_start(dsname.c_str());
+    } else {
+      register_dataset_sz_timer_start(dsname.c_str());
+    }
     constexpr hsize_t ndims = 1;
     auto dset = hdf5::Dataset::open(gid, dsname.c_str()); 
     auto old_fspace = hdf5::Dataspace::get_space(dset);
@@ -41,20 +51,34 @@ namespace {
     new_fspace.select_hyperslab(old_dims, slab_size);
     auto mem_space = hdf5::Dataspace::create_simple(ndims, slab_size, max_dims);
     dset.write<T>(mem_space, new_fspace, data); //H5Dwrite
+    if(isRawData) {
+      register_dataset_timer_end(data.size()*sizeof(T));
+    } else {
+      register_dataset_sz_timer_end(data.size()*sizeof(T));
+    }
   }
 }
 
-HDFEventOutputer::HDFEventOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, pds::Compression iCompression, int iCompressionLevel, pds::Serialization iSerialization) : 
+HDFEventOutputer::HDFEventOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, unsigned long long iChunkTargetBytes, pds::Compression iCompression, int iCompressionLevel, pds::Serialization iSerialization, bool iDirectChunk, bool iH5Timing, unsigned int iWriterCredits) : 
   file_(hdf5::File::create(iFileName.c_str())),
   group_(hdf5::Group::create(file_, GNAME)),
   chunkSize_{iChunkSize},
+  chunkTargetBytes_{iChunkTargetBytes},
   serializers_{std::size_t(iNLanes)},
   compression_{iCompression},
   compressionLevel_{iCompressionLevel},
   serialization_{iSerialization},
+  directChunk_{iDirectChunk},
   serialTime_{std::chrono::microseconds::zero()},
   parallelTime_{0}
-  {}
+  {
+    if(iH5Timing) {
+      init_timers();
+    }
+    if(iWriterCredits != 0) {
+      writer_ = std::make_unique<HDFWriterThread>(iWriterCredits);
+    }
+  }
 
 
 void HDFEventOutputer::setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs) {
@@ -84,10 +108,23 @@ void HDFEventOutputer::productReadyAsync(unsigned int iLaneIndex, DataProductRet
 void HDFEventOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const {
   auto start = std::chrono::high_resolution_clock::now();
   auto [offsets, buffer] = writeDataProductsToOutputBuffer(serializers_[iLaneIndex]);
+  if(writer_) {
+    writer_->push([this, iEventID, iLaneIndex, buffer = std::move(buffer), offsets = std::move(offsets)]() mutable {
+        auto start = std::chrono::high_resolution_clock::now();
+        const_cast<HDFEventOutputer*>(this)->output(iEventID, serializers_[iLaneIndex], std::move(buffer), std::move(offsets));
+        serialTime_ += std::chrono::duration_cast<decltype(serialTime_)>(std::chrono::high_resolution_clock::now() - start);
+      }, std::move(iCallback));
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    parallelTime_ += time.count();
+    return;
+  }
   queue_.push(*iCallback.group(), [this, iEventID, iLaneIndex, callback=std::move(iCallback), buffer = std::move(buffer), offsets = std::move(offsets)]() mutable {
       auto start = std::chrono::high_resolution_clock::now();
-      const_cast<HDFEventOutputer*>(this)->output(iEventID, serializers_[iLaneIndex], std::move(buffer), std::move(offsets));
+      auto appends = const_cast<HDFEventOutputer*>(this)->output(iEventID, serializers_[iLaneIndex], std::move(buffer), std::move(offsets));
         serialTime_ += std::chrono::duration_cast<decltype(serialTime_)>(std::chrono::high_resolution_clock::now() - start);
+      if(not appends.empty()) {
+        chunkWriter_->writeAsync(std::move(appends), queue_, callback);
+      }
       callback.doneWaiting();
     });
     auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
@@ -95,14 +132,33 @@ void HDFEventOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier cons
 }
 
 void HDFEventOutputer::printSummary() const  {
+  if(writer_) {
+    writer_->drain();
+  }
+  if(not datasetsCreated_) {
+    const_cast<HDFEventOutputer*>(this)->finishSampling();
+  }
+  if(chunkWriter_) {
+    const_cast<HDFEventOutputer*>(this)->finishDirectChunks();
+  }
   std::cout <<"HDFEventOutputer\n  total serial time at end event: "<<serialTime_.count()<<"us\n"
     "  total parallel time at end event: "<<parallelTime_.load()<<"us\n";
+  if(chunkWriter_) {
+    std::cout <<"  direct chunk writes: "<<chunkWriter_->nChunks()<<" chunks\n"
+      "   chunk compress time: "<<chunkWriter_->compressTime().count()<<"us\n"
+      "   chunk write time: "<<chunkWriter_->writeTime().count()<<"us\n";
+  }
+  if(writer_) {
+    std::cout <<"  writer thread busy time: "<<writer_->busyTime().count()<<"us\n"
+      "  writer thread stalls: "<<writer_->nStalls()<<"\n";
+  }
+  print_write_timers();
   summarize_serializers(serializers_);
 }
 
 
 
-void 
+std::vector<HDFDirectChunkWriter::Append>
 HDFEventOutputer::output(EventIdentifier const& iEventID, 
                          SerializeStrategy const& iSerializers,
                          std::vector<char> iBuffer,
@@ -118,24 +174,125 @@ HDFEventOutputer::output(EventIdentifier const& iEventID,
      auto level = hdf5::Attribute::open(group_, "CompressionLevel");
      level.write(compressionLevel_); 
   }
-  std::vector<unsigned long long> ids = {{iEventID.event}};
+  if(not datasetsCreated_) {
+    sampledEvents_.emplace_back(iEventID.event, std::move(iBuffer), std::move(iOffsets));
+    if(sampledEvents_.size() < kEventsToSample) {
+      return {};
+    }
+    return writeSampledEvents();
+  }
+  return write(iEventID.event, std::move(iBuffer), iOffsets);
+}
+
+std::vector<HDFDirectChunkWriter::Append>
+HDFEventOutputer::write(unsigned long long iEventNumber,
+                        std::vector<char> iBuffer,
+                        std::vector<uint32_t> const& iOffsets) {
+  if(chunkWriter_) {
+    pendingIDs_.push_back(iEventNumber);
+    pendingOffsets_.insert(pendingOffsets_.end(), iOffsets.begin(), iOffsets.end());
+    auto append = chunkWriter_->append(std::move(iBuffer));
+    if(append.nFilledChunks_ != 0) {
+      writePendingEvents();
+    }
+    std::vector<HDFDirectChunkWriter::Append> appends;
+    appends.push_back(std::move(append));
+    return appends;
+  }
+  std::vector<unsigned long long> ids = {{iEventNumber}};
   write_ds<unsigned long long>(group_, EVENTS_DSNAME, ids);
   write_ds<char>(group_, PRODUCTS_DSNAME, iBuffer);
   write_ds<uint32_t>(group_, OFFSETS_DSNAME, iOffsets); 
+  return {};
 }
 
-void 
-HDFEventOutputer::writeFileHeader(SerializeStrategy const& iSerializers) {
+void
+HDFEventOutputer::writePendingEvents() {
+  if(pendingIDs_.empty()) {
+    return;
+  }
+  write_ds<unsigned long long>(group_, EVENTS_DSNAME, pendingIDs_);
+  write_ds<uint32_t>(group_, OFFSETS_DSNAME, pendingOffsets_);
+  pendingIDs_.clear();
+  pendingOffsets_.clear();
+}
+
+std::vector<HDFDirectChunkWriter::Append>
+HDFEventOutputer::writeSampledEvents() {
+  unsigned long long bytes = 0;
+  for(auto const& event: sampledEvents_) {
+    bytes += std::get<1>(event).size();
+  }
+  unsigned long long const bytesPerEvent = std::max<unsigned long long>(1, bytes/std::max<size_t>(1, sampledEvents_.size()));
+  hsize_t const eventsPerChunk = std::max<unsigned long long>(1, chunkTargetBytes_/bytesPerEvent);
+  //keep the same events together in the chunks of all datasets
+  createDatasets(eventsPerChunk*bytesPerEvent, eventsPerChunk, eventsPerChunk*(nProducts_+2));
+
+  const auto scalar_space  = hdf5::Dataspace::create_scalar();
+  hdf5::Attribute::create<unsigned long long>(group_, "ChunkTargetBytes", scalar_space).write(chunkTargetBytes_);
+  hdf5::Attribute::create<unsigned long long>(group_, "BytesPerEvent", scalar_space).write(bytesPerEvent);
+  hdf5::Attribute::create<unsigned long long>(group_, "EventsPerChunk", scalar_space).write(static_cast<unsigned long long>(eventsPerChunk));
+
+  std::vector<HDFDirectChunkWriter::Append> appends;
+  for(auto& [eventNumber, buffer, offsets]: sampledEvents_) {
+    auto placed = write(eventNumber, std::move(buffer), offsets);
+    std::move(placed.begin(), placed.end(), std::back_inserter(appends));
+  }
+  sampledEvents_ = decltype(sampledEvents_)();
+  return appends;
+}
+
+void
+HDFEventOutputer::finishSampling() {
+  //the job ended before enough events were seen
+  tbb::task_group group;
+  {
+    TaskHolder th(group, make_functor_task([](){}));
+    auto appends = writeSampledEvents();
+    if(not appends.empty()) {
+      chunkWriter_->writeAsync(std::move(appends), queue_, th);
+    }
+  }
+  group.wait();
+}
+
+void
+HDFEventOutputer::finishDirectChunks() {
+  chunkWriter_->finish();
+  writePendingEvents();
+}
+
+void
+HDFEventOutputer::createDatasets(hsize_t iProductsChunk, hsize_t iEventsChunk, hsize_t iOffsetsChunk) {
   constexpr hsize_t ndims = 1;
   constexpr hsize_t     dims[ndims] = {0};
-  hsize_t     chunk_dims[ndims] = {static_cast<hsize_t>(chunkSize_)};
   constexpr hsize_t     max_dims[ndims] = {H5S_UNLIMITED};
   auto space = hdf5::Dataspace::create_simple (ndims, dims, max_dims); 
-  auto prop   = hdf5::Property::create();
-  prop.set_chunk(ndims, chunk_dims);
-  hdf5::Dataset::create<int>(group_, EVENTS_DSNAME, space, prop);
-  hdf5::Dataset::create<char>(group_, PRODUCTS_DSNAME, space, prop);
-  hdf5::Dataset::create<int>(group_, OFFSETS_DSNAME, space, prop);
+  auto events_prop = hdf5::Property::create();
+  events_prop.set_chunk(ndims, &iEventsChunk);
+  hdf5::Dataset::create<int>(group_, EVENTS_DSNAME, space, events_prop);
+  auto products_prop = hdf5::Property::create();
+  products_prop.set_chunk(ndims, &iProductsChunk);
+  if(directChunk_) {
+    HDFDirectChunkWriter::setZstdFilter(products_prop, compressionLevel_);
+    hdf5::Dataset::create<char>(group_, PRODUCTS_DSNAME, space, products_prop);
+    chunkWriter_ = std::make_unique<HDFDirectChunkWriter>(group_, PRODUCTS_DSNAME, iProductsChunk, compressionLevel_);
+  } else {
+    hdf5::Dataset::create<char>(group_, PRODUCTS_DSNAME, space, products_prop);
+  }
+  auto offsets_prop = hdf5::Property::create();
+  offsets_prop.set_chunk(ndims, &iOffsetsChunk);
+  hdf5::Dataset::create<int>(group_, OFFSETS_DSNAME, space, offsets_prop);
+  datasetsCreated_ = true;
+}
+
+void 
+HDFEventOutputer::writeFileHeader(SerializeStrategy const& iSerializers) {
+  constexpr hsize_t ndims = 1;
+  nProducts_ = iSerializers.size();
+  if(chunkSize_ != 0) {
+    createDatasets(chunkSize_, chunkSize_, chunkSize_);
+  }
 
   const auto scalar_space  = hdf5::Dataspace::create_scalar();
   hdf5::Attribute::create<int>(group_, "run", scalar_space);
@@ -146,11 +303,22 @@ HDFEventOutputer::writeFileHeader(SerializeStrategy const& iSerializers) {
   H5Tset_size(attr_type, H5T_VARIABLE);
   auto const attr_space  = H5Screate(H5S_SCALAR);
   hdf5::Attribute compression = hdf5::Attribute::create<std::string>(group_,"Compression" , attr_space); 
+  hdf5::Attribute serialization = hdf5::Attribute::create<std::string>(group_,"Serialization" , attr_space); 
+  serialization.write<std::string>(serialization_ == pds::Serialization::kRoot ? "ROOT" : "ROOTUnrolled");
+  std::vector<std::string> productNames;
   for(auto const& s: iSerializers) {
     std::string const type(s.className());
     std::string const name(s.name());
     hdf5::Attribute prod_name = hdf5::Attribute::create<std::string>(group_, name.c_str(), attr_space); 
     prod_name.write<std::string>(type);
+    productNames.push_back(name);
+  }
+  //the order of the data products within each event
+  hsize_t nProducts = productNames.size();
+  auto names_space = hdf5::Dataspace::create_simple(ndims, &nProducts, NULL);
+  hdf5::Attribute names = hdf5::Attribute::create<std::string>(group_, "ProductNames", names_space);
+  if(not productNames.empty()) {
+    names.write_strings(productNames);
   }
 }
 
@@ -158,7 +326,7 @@ std::pair<std::vector<uint32_t>, std::vector<char>> HDFEventOutputer::writeDataP
   //Calculate buffer size needed
   uint32_t bufferSize = 0;
   std::vector<uint32_t> offsets;
-  offsets.reserve(iSerializers.size()+1);
+  offsets.reserve(iSerializers.size()+2);
   for(auto const& s: iSerializers) {
     auto const blobSize = s.blob().size();
     offsets.push_back(bufferSize);
@@ -179,6 +347,9 @@ std::pair<std::vector<uint32_t>, std::vector<char>> HDFEventOutputer::writeDataP
   }
 
   auto cBuffer  = pds::compressBuffer(0,0, compression_, compressionLevel_, buffer);
+  //record the compressed size as the final offset. Needed to find
+  // the event in the Products dataset during reading
+  offsets.push_back(cBuffer.size());
 
   return {offsets, cBuffer};
 }
@@ -194,7 +365,18 @@ namespace {
         return {};
       }
 
-      auto chunkSize = params.get<int>("hdfchunkSize", 128);
+      //'auto' chooses the chunk sizes from the first events
+      auto chunkSizeName = params.get<std::string>("hdfchunkSize", "128");
+      int chunkSize = 0;
+      if(chunkSizeName != "auto") {
+        auto end = chunkSizeName.data()+chunkSizeName.size();
+        auto result = std::from_chars(chunkSizeName.data(), end, chunkSize);
+        if(result.ec != std::errc() or result.ptr != end or chunkSize <= 0) {
+          std::cout <<"hdfchunkSize must be 'auto' or greater than 0"<<std::endl;
+          return {};
+        }
+      }
+      auto chunkTargetBytes = params.get<std::size_t>("chunkTargetBytes", 1048576);
       int compressionLevel = params.get<int>("compressionLevel", 18);
       auto compressionName = params.get<std::string>("compressionAlgorithm", "ZSTD");
       auto compression = pds::toCompression(compressionName);
@@ -208,8 +390,34 @@ namespace {
         std::cout <<"unknown serialization "<<serializationName<<std::endl;
         return {};
       }
+      auto directChunk = params.get<bool>("directChunk", false);
+      if(directChunk) {
+        //the default of 128 bytes is far too small for a chunk compressed on its own
+        if(not params.get<std::string>("hdfchunkSize")) {
+          std::cout <<"directChunk requires hdfchunkSize to be given as a number of bytes or 'auto'"<<std::endl;
+          return {};
+        }
+        //the chunks are compressed instead of the events
+        if(*compression != pds::Compression::kZSTD) {
+          std::cout <<"directChunk requires compressionAlgorithm=ZSTD"<<std::endl;
+          return {};
+        }
+        compression = pds::Compression::kNone;
+      }
+      unsigned int writerCredits = 0;
+      if(params.get<bool>("writerThread", false)) {
+        if(directChunk) {
+          std::cout <<"writerThread can not be used with directChunk"<<std::endl;
+          return {};
+        }
+        writerCredits = params.get<unsigned int>("writerCredits", 4);
+        if(writerCredits == 0) {
+          std::cout <<"writerCredits must be greater than 0"<<std::endl;
+          return {};
+        }
+      }
 
-      return std::make_unique<HDFEventOutputer>(*fileName, iNLanes, chunkSize, *compression, compressionLevel, *serialization);
+      return std::make_unique<HDFEventOutputer>(*fileName, iNLanes, chunkSize, chunkTargetBytes, *compression, compressionLevel, *serialization, directChunk, params.get<bool>("h5Timing", false), writerCredits);
     }
   };
 
@@ -6,6 +6,8 @@
 #include <string>
 #include <cstdint>
 #include <fstream>
+#include <memory>
+#include <tuple>
 
 
 #include "OutputerBase.h"
@@ -17,12 +19,19 @@
 #include "SerialTaskQueue.h"
 
 #include "HDFCxx.h"
+#include "HDFDirectChunkWriter.h"
+#include "HDFWriterThread.h"
 
 
 namespace cce::tf {
   class HDFEventOutputer : public OutputerBase {
     public:
-    HDFEventOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, pds::Compression iCompression, int iCompressionLevel, pds::Serialization iSerialization);
+    //an iWriterCredits of 0 does the HDF5 calls in a SerialTaskQueue instead of on a dedicated thread
+    //an iChunkSize of 0 chooses the chunk sizes from the first events to be near iChunkTargetBytes
+    HDFEventOutputer(std::string const& iFileName, unsigned int iNLanes, int iChunkSize, unsigned long long iChunkTargetBytes, pds::Compression iCompression, int iCompressionLevel, pds::Serialization iSerialization, bool iDirectChunk, bool iH5Timing, unsigned int iWriterCredits);
+
+    //number of events used to find the bytes per event when choosing the chunk sizes
+    static constexpr unsigned int kEventsToSample = 16;
     HDFEventOutputer(HDFEventOutputer&&) = default;
     HDFEventOutputer(HDFEventOutputer const&) = default;
 
@@ -37,7 +46,14 @@ namespace cce::tf {
 
  private:
 
-  void output(EventIdentifier const& iEventID, SerializeStrategy const& iSerializers, std::vector<char> iBuffer, std::vector<uint32_t> iOffset);
+  //returns the chunks filled when using direct chunk writes
+  std::vector<HDFDirectChunkWriter::Append> output(EventIdentifier const& iEventID, SerializeStrategy const& iSerializers, std::vector<char> iBuffer, std::vector<uint32_t> iOffset);
+  std::vector<HDFDirectChunkWriter::Append> write(unsigned long long iEventNumber, std::vector<char> iBuffer, std::vector<uint32_t> const& iOffsets);
+  std::vector<HDFDirectChunkWriter::Append> writeSampledEvents();
+  void finishSampling();
+  void createDatasets(hsize_t iProductsChunk, hsize_t iEventsChunk, hsize_t iOffsetsChunk);
+  void writePendingEvents();
+  void finishDirectChunks();
   void writeFileHeader(SerializeStrategy const& iSerializers);
   std::pair<std::vector<uint32_t>,std::vector<char>> writeDataProductsToOutputBuffer(SerializeStrategy const& iSerializers) const;
 private:
@@ -45,14 +61,26 @@ private:
   hdf5::Group group_;
   mutable SerialTaskQueue queue_;
   int chunkSize_;
+  unsigned long long chunkTargetBytes_;
+  bool datasetsCreated_ = false;
+  size_t nProducts_ = 0;
+  //events held until the chunk sizes have been chosen
+  std::vector<std::tuple<unsigned long long, std::vector<char>, std::vector<uint32_t>>> sampledEvents_;
   mutable std::vector<SerializeStrategy> serializers_;
   mutable std::pair<std::vector<uint32_t>, std::vector<char>> offsetsAndBlob_;
   bool firstEvent_ = true;
   pds::Compression compression_;
   int compressionLevel_;
   pds::Serialization serialization_;
+  bool directChunk_;
+  std::unique_ptr<HDFDirectChunkWriter> chunkWriter_;
+  //with direct chunk writes, event ids and offsets are written once a chunk has been filled
+  std::vector<unsigned long long> pendingIDs_;
+  std::vector<uint32_t> pendingOffsets_;
   mutable std::chrono::microseconds serialTime_;
   mutable std::atomic<std::chrono::microseconds::rep> parallelTime_;
+  //declared after file_ so pending writes are done before the file is closed
+  std::unique_ptr<HDFWriterThread> writer_;
   };    
 }
 #endif
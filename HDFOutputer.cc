@@ -48,21 +48,44 @@ int append_dataset(hid_t gid, const char *name, char* data, size_t data_size, hi
   return 0;
 }
 
-int write_multidatasets(hid_t gid, const char *name, char* data, size_t data_size, hid_t mtype) {
-  register_multidataset_request_append(name, gid, data, data_size, mtype);
+int write_multidatasets(multidataset_map& iDatasets, hid_t gid, const char *name, char* data, size_t data_size, hid_t mtype) {
+  register_multidataset_request_append(iDatasets, name, gid, data, data_size, mtype);
   return 0;
 }
 
-HDFOutputer::HDFOutputer(std::string const& iFileName, unsigned int iNLanes, int iBatchSize, int iChunkSize) : 
+HDFOutputer::HDFOutputer(std::string const& iFileName, unsigned int iNLanes, int iBatchSize, int iChunkSize, WriteMethod iWriteMethod, bool iH5Timing, unsigned int iWriterCredits) : 
   file_(hdf5::File::create(iFileName.c_str())),
   chunkSize_{iChunkSize},
   maxBatchSize_{iBatchSize},
+  writeMethod_{iWriteMethod},
   serializers_{std::size_t(iNLanes)},
   serialTime_{std::chrono::microseconds::zero()},
+  batchWriteTime_{std::chrono::microseconds::zero()},
+  flushTime_{std::chrono::microseconds::zero()},
   parallelTime_{0}
-  {}
+  {
+    init_multidataset();
+    set_hdf5_method(static_cast<int>(writeMethod_));
+    if(iH5Timing) {
+      init_timers();
+    }
+    if(iWriterCredits != 0) {
+      writer_ = std::make_unique<HDFWriterThread>(iWriterCredits);
+    }
+  }
 
-HDFOutputer::~HDFOutputer() { }
+HDFOutputer::~HDFOutputer() {
+  //an outputer destroyed without printSummary, e.g. the warmup one, must still release
+  // its dataset handles or they keep the file open after file_ is destroyed
+  if(writer_) {
+    try {
+      writer_->drain();
+    } catch(...) {
+      //already reported by printSummary if it was called
+    }
+  }
+  finalize_multidataset(multiDatasets_);
+}
 
 void HDFOutputer::setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs) {
   auto& s = serializers_[iLaneIndex];
@@ -87,7 +110,7 @@ void HDFOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier const& iE
   auto start = std::chrono::high_resolution_clock::now();
   queue_.push(*iCallback.group(), [this, iEventID, iLaneIndex, callback=std::move(iCallback)]() mutable {
       auto start = std::chrono::high_resolution_clock::now();
-      const_cast<HDFOutputer*>(this)->output(iEventID, serializers_[iLaneIndex]);
+      const_cast<HDFOutputer*>(this)->output(iEventID, serializers_[iLaneIndex], callback);
         serialTime_ += std::chrono::duration_cast<decltype(serialTime_)>(std::chrono::high_resolution_clock::now() - start);
       callback.doneWaiting();
     });
@@ -100,16 +123,29 @@ void HDFOutputer::printSummary() const  {
     "  total parallel time at end event: "<<parallelTime_.load()<<"us\n";
 
   auto start = std::chrono::high_resolution_clock::now();
+  if(writer_) {
+    writer_->drain();
+  }
   if (batch_ != 0) {
     //flush the remaining data to the file
-    const_cast<HDFOutputer*>(this)->writeBatch();
+    auto nonConstThis = const_cast<HDFOutputer*>(this);
+    nonConstThis->writeBatch(nonConstThis->products_, events_);
   }
 
-  finalize_multidataset();
+  finalize_multidataset(multiDatasets_);
   auto writeTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
   
   std::cout << "  end of job file write time: "<<writeTime.count()<<"us\n";
+  std::cout << "  batch write time: "<<batchWriteTime_.count()<<"us\n";
+  if(writeMethod_ == WriteMethod::kMultiDataset) {
+    std::cout << "   multi-dataset flush time: "<<flushTime_.count()<<"us\n";
+  }
+  if(writer_) {
+    std::cout << "  writer thread busy time: "<<writer_->busyTime().count()<<"us\n"
+      "  writer thread stalls: "<<writer_->nStalls()<<"\n";
+  }
 
+  print_write_timers();
   summarize_serializers(serializers_);
 }
 
@@ -133,7 +169,8 @@ get_prods_and_sizes(std::vector<product_t> & input,
 
 void 
 HDFOutputer::output(EventIdentifier const& iEventID, 
-                    std::vector<SerializerWrapper> const& iSerializers) {
+                    std::vector<SerializerWrapper> const& iSerializers,
+                    TaskHolder iCallback) {
   if(firstTime_) {
     writeFileHeader(iEventID, iSerializers);
     firstTime_ = false;
@@ -145,7 +182,18 @@ HDFOutputer::output(EventIdentifier const& iEventID,
 
   ++batch_;
   if (batch_ == maxBatchSize_) {
-    writeBatch();
+    if(writer_) {
+      //the full batch is written on the writer thread while the next one is filled
+      writer_->push([this, products = std::move(products_), events = std::move(events_)]() mutable {
+          writeBatch(products, events);
+        }, std::move(iCallback));
+      products_ = std::vector<product_t>();
+      products_.reserve(dataProductIndices_.size() * maxBatchSize_);
+      events_ = std::vector<int>();
+      events_.reserve(maxBatchSize_);
+    } else {
+      writeBatch(products_, events_);
+    }
     batch_ = 0;
     products_.clear();
     events_.clear();
@@ -153,58 +201,49 @@ HDFOutputer::output(EventIdentifier const& iEventID,
 }
 
 void
-HDFOutputer::writeBatch() {
-  init_multidataset();
-
-  int method = get_hdf5_method();
-#ifdef H5_TIMING_ENABLE
-  size_t total_data_size = 0;
-#endif
+HDFOutputer::writeBatch(std::vector<product_t>& iProducts, std::vector<int> const& iEvents) {
+  auto start = std::chrono::high_resolution_clock::now();
+  int method = static_cast<int>(writeMethod_);
   hdf5::Group gid = hdf5::Group::open(file_, "Lumi");   
-  write_ds<int>(gid, "Event_IDs", events_);
+  register_dataset_sz_timer_start("Event_IDs");
+  if (method == 0) {
+    write_multidatasets(multiDatasets_, gid, "Event_IDs", (char*) iEvents.data(), iEvents.size(), H5T_NATIVE_INT);
+  } else {
+    write_ds<int>(gid, "Event_IDs", iEvents);
+  }
+  register_dataset_sz_timer_end(iEvents.size() * sizeof(int));
   auto const dpi_size = dataProductIndices_.size();
   for(auto & [name, index]: dataProductIndices_) {
-      auto [prods, sizes] = get_prods_and_sizes(products_, index, dpi_size);
-#ifdef H5_TIMING_ENABLE
+      auto [prods, sizes] = get_prods_and_sizes(iProducts, index, dpi_size);
       register_dataset_timer_start(name.c_str());
-#endif
       if ( method == 1 ) {
         write_ds<char>(gid, name, prods);
       } else if (method == 0 ) {
-        write_multidatasets(gid, name.c_str(), (char*) &(prods[0]), prods.size(), H5T_NATIVE_CHAR);
+        write_multidatasets(multiDatasets_, gid, name.c_str(), prods.data(), prods.size(), H5T_NATIVE_CHAR);
       } else {
         append_dataset(gid, name.c_str(), (char*) &(prods[0]), prods.size(), H5T_NATIVE_CHAR);
       }
-#ifdef H5_TIMING_ENABLE
       register_dataset_timer_end((size_t)prods.size());
-#endif
       auto s = name+"_sz";
-#ifdef H5_TIMING_ENABLE
       register_dataset_sz_timer_start(s.c_str());
-#endif
       if (method == 1) {
         write_ds<size_t>(gid, s, sizes);
       } else if ( method == 0 ) {
-        write_multidatasets(gid, s.c_str(), (char*) &(sizes[0]), sizes.size(), H5T_NATIVE_ULLONG);
+        write_multidatasets(multiDatasets_, gid, s.c_str(), (char*) sizes.data(), sizes.size(), H5T_NATIVE_ULLONG);
       } else {
         append_dataset(gid, s.c_str(), (char*) &(sizes[0]), sizes.size(), H5T_NATIVE_ULLONG);
       }
-#ifdef H5_TIMING_ENABLE
       register_dataset_sz_timer_end((size_t)sizes.size() * sizeof(size_t));
-#endif
-#ifdef H5_TIMING_ENABLE
-      total_data_size += (size_t)prods.size() + (size_t)sizes.size() * sizeof(size_t);
-#endif
   }
 
-#ifdef H5_TIMING_ENABLE
-  register_dataset_timer_start("flush_all");
-#endif
-  flush_multidatasets();
-#ifdef H5_TIMING_ENABLE
-  register_dataset_timer_end(total_data_size);
-#endif
-
+  //with the multi-dataset method the per dataset timers above only include collecting
+  // the data, the time of the actual writes is recorded by the flush
+  if (method == 0) {
+    auto flushStart = std::chrono::high_resolution_clock::now();
+    flush_multidatasets(multiDatasets_);
+    flushTime_ += std::chrono::duration_cast<decltype(flushTime_)>(std::chrono::high_resolution_clock::now() - flushStart);
+  }
+  batchWriteTime_ += std::chrono::duration_cast<decltype(batchWriteTime_)>(std::chrono::high_resolution_clock::now() - start);
 }
 
 void 
@@ -255,7 +294,40 @@ namespace {
       auto batchSize = params.get<int>("batchSize", 1);
       auto chunkSize = params.get<int>("hdfchunkSize", 1048576);
 
-      return std::make_unique<HDFOutputer>(*fileName, iNLanes, batchSize, chunkSize);
+      //the HEP_IO_TYPE environment variable is used if no method is given
+      auto writeMethod = HDFOutputer::WriteMethod::kDataset;
+      auto writeMethodName = params.get<std::string>("writeMethod");
+      if(writeMethodName) {
+        if(*writeMethodName == "Dataset") {
+        } else if(*writeMethodName == "MultiDataset") {
+          writeMethod = HDFOutputer::WriteMethod::kMultiDataset;
+        } else if(*writeMethodName == "Append") {
+          writeMethod = HDFOutputer::WriteMethod::kAppend;
+        } else {
+          std::cout <<"Unknown write method "<<*writeMethodName<<std::endl;
+          return {};
+        }
+      } else if(auto env = getenv("HEP_IO_TYPE")) {
+        auto method = atoi(env);
+        if(method < 0 or method > 2) {
+          std::cout <<"Unknown HEP_IO_TYPE "<<method<<std::endl;
+          return {};
+        }
+        writeMethod = static_cast<HDFOutputer::WriteMethod>(method);
+      }
+
+      auto h5Timing = params.get<bool>("h5Timing", false);
+
+      unsigned int writerCredits = 0;
+      if(params.get<bool>("writerThread", false)) {
+        writerCredits = params.get<unsigned int>("writerCredits", 4);
+        if(writerCredits == 0) {
+          std::cout <<"writerCredits must be greater than 0"<<std::endl;
+          return {};
+        }
+      }
+
+      return std::make_unique<HDFOutputer>(*fileName, iNLanes, batchSize, chunkSize, writeMethod, h5Timing, writerCredits);
     }
   };
 
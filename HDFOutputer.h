@@ -6,6 +6,7 @@
 #include <string>
 #include <cstdint>
 #include <fstream>
+#include <memory>
 
 
 #include "OutputerBase.h"
@@ -16,13 +17,23 @@
 #include "SerialTaskQueue.h"
 
 #include "HDFCxx.h"
+#include "HDFWriterThread.h"
+#include "multidataset_plugin.h"
 
 using product_t = std::vector<char>;
 
 namespace cce::tf {
   class HDFOutputer : public OutputerBase {
     public:
-    HDFOutputer(std::string const& iFileName, unsigned int iNLanes, int iBatchSize, int iChunkSize);
+    //how the datasets are extended at the end of each batch
+    enum class WriteMethod {
+      kMultiDataset = 0, //aggregate all datasets then write them in one flush
+      kDataset = 1, //extend then write each dataset in turn
+      kAppend = 2 //use H5DOappend for each dataset
+    };
+
+    //an iWriterCredits of 0 writes each batch in the SerialTaskQueue instead of on a dedicated thread
+    HDFOutputer(std::string const& iFileName, unsigned int iNLanes, int iBatchSize, int iChunkSize, WriteMethod iWriteMethod, bool iH5Timing, unsigned int iWriterCredits);
     HDFOutputer(HDFOutputer&&) = default;
     HDFOutputer(HDFOutputer const&) = default;
     ~HDFOutputer();
@@ -38,18 +49,19 @@ namespace cce::tf {
 
  private:
 
-  void output(EventIdentifier const& iEventID, std::vector<SerializerWrapper> const& iSerializers);
+  void output(EventIdentifier const& iEventID, std::vector<SerializerWrapper> const& iSerializers, TaskHolder iCallback);
   void writeFileHeader(EventIdentifier const& iEventID, std::vector<SerializerWrapper> const& iSerializers);
 
   std::vector<std::vector<char>> writeDataProductsToOutputBuffer(std::vector<SerializerWrapper> const& iSerializers) const;
 std::pair<product_t, std::vector<size_t>> get_prods_and_sizes(std::vector<product_t> & input,int prod_index,int stride);
 private:
- void writeBatch();
+ void writeBatch(std::vector<product_t>& iProducts, std::vector<int> const& iEvents);
 
   hdf5::File file_;
   mutable SerialTaskQueue queue_;
   int chunkSize_;
   int maxBatchSize_;
+  WriteMethod writeMethod_;
   std::vector<std::pair<std::string, uint32_t>> dataProductIndices_;
   mutable std::vector<std::vector<SerializerWrapper>> serializers_;
   bool firstTime_ = true;
@@ -60,7 +72,13 @@ private:
   std::vector<int> events_;
   
   mutable std::chrono::microseconds serialTime_;
+  std::chrono::microseconds batchWriteTime_;
+  std::chrono::microseconds flushTime_;
   mutable std::atomic<std::chrono::microseconds::rep> parallelTime_;
+  //datasets opened by the MultiDataset write method, closed before file_
+  mutable multidataset_map multiDatasets_;
+  //declared after file_ so pending writes are done before the file is closed
+  std::unique_ptr<HDFWriterThread> writer_;
   };    
 }
 #endif
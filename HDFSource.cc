@@ -1,10 +1,13 @@
 #include "HDFSource.h"
 #include "SourceFactory.h"
 #include "ReplicatedSharedSource.h"
+#include "H5Timing.h"
 
 #include "TClass.h"
 #include "TBufferFile.h"
 
+#include <algorithm>
+
 using namespace cce::tf;
 
 using product_t = std::vector<char>;
@@ -34,11 +37,47 @@ namespace {
 }
 
 
-HDFSource::HDFSource(std::string const& iName):
+HDFSource::HDFSource(std::string const& iName, unsigned int iWindowSize, std::shared_ptr<WindowClaims> iClaims):
 file_(hdf5::File::open(iName.c_str())),
-lumi_(hdf5::Group::open(file_, "/Lumi"))
+lumi_(hdf5::Group::open(file_, "/Lumi")),
+eventIDsDataset_(hdf5::Dataset::open(lumi_, "Event_IDs")),
+eventIDsSpace_(hdf5::Dataspace::get_space(eventIDsDataset_)),
+windowSize_{iWindowSize},
+claims_{std::move(iClaims)}
 {
   H5Literate (lumi_, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, op_func, &productInfos_);
+
+  {
+    auto attr_r = hdf5::Attribute::open(lumi_, "run");
+    H5Aread(attr_r, H5T_NATIVE_UINT, &run_);
+    auto attr_l = hdf5::Attribute::open(lumi_, "lumisec");
+    H5Aread(attr_l, H5T_NATIVE_UINT, &lumisec_);
+  }
+  hsize_t dims[1];
+  H5Sget_simple_extent_dims(eventIDsSpace_, dims, NULL);
+  nEvents_ = dims[0];
+  if (windowSize_ > 1) {
+    std::call_once(claims_->sizeFlag_, [this]() {
+        claims_->nWindows_ = (nEvents_ + windowSize_ - 1) / windowSize_;
+        claims_->nextInWindow_ = std::make_unique<std::atomic<long>[]>(claims_->nWindows_);
+        for(long window = 0; window < claims_->nWindows_; ++window) {
+          claims_->nextInWindow_[window] = window*windowSize_;
+        }
+      });
+  }
+
+  productDatasets_.reserve(productInfos_.size());
+  productSpaces_.reserve(productInfos_.size());
+  offsetDatasets_.reserve(productInfos_.size());
+  offsetSpaces_.reserve(productInfos_.size());
+  for (auto const& pi: productInfos_) {
+    productDatasets_.push_back(hdf5::Dataset::open(lumi_, pi.name().c_str()));
+    productSpaces_.push_back(hdf5::Dataspace::get_space(productDatasets_.back()));
+    offsetDatasets_.push_back(hdf5::Dataset::open(lumi_, (pi.name()+"_sz").c_str()));
+    offsetSpaces_.push_back(hdf5::Dataspace::get_space(offsetDatasets_.back()));
+  }
+  windowOffsets_.resize(productInfos_.size());
+  windowProducts_.resize(productInfos_.size());
   
   dataProducts_.reserve(productInfos_.size());
   dataBuffers_.resize(productInfos_.size(), nullptr);
@@ -68,13 +107,12 @@ HDFSource::~HDFSource() {
 std::vector<std::string>
 HDFSource::readClassNames() {
   std::vector<std::string> classnames;
-  for (auto const& pi : productInfos_) {
-    auto dset = hdf5::Dataset::open(lumi_, (pi.name()).c_str());
+  for (auto const& dset : productDatasets_) {
     auto aid = hdf5::Attribute::open(dset, "classname");
     auto tid = H5Aget_type(aid); 
-    auto sz = H5Aget_storage_size(aid);
     char* attribute_name; 
     H5Aread(aid, tid, &attribute_name);
+    H5Tclose(tid);
     std::string s(attribute_name);
     free(attribute_name);
     classnames.push_back(std::move(s));
@@ -83,88 +121,113 @@ HDFSource::readClassNames() {
 }
 
 
-std::pair<long unsigned int, long unsigned int>
-HDFSource::getEventOffsets(long iEventIndex, std::string const& pname) {
-  constexpr hsize_t nelements = 2;
-  long unsigned int offsets[nelements];
-  hsize_t coords[nelements]; 
-  coords[0] = (iEventIndex == 0) ? iEventIndex: iEventIndex-1;
-  coords[1] = iEventIndex;
-  auto dset = hdf5::Dataset::open(lumi_, (pname+"_sz").c_str());
-  auto fspace = hdf5::Dataspace::get_space(dset);
-  auto mspace = hdf5::Dataspace::create_simple(1, &nelements, NULL); 
-  H5Sselect_elements(fspace, H5S_SELECT_SET, 2, (const hsize_t *)&coords);
-  H5Dread(dset, H5T_STD_U64LE, mspace, fspace, H5P_DEFAULT, offsets); 
-  if (iEventIndex == 0) {
-    return {0, offsets[0]};
-  } else {
-   return {offsets[0], offsets[1]};
+void
+HDFSource::readWindow(long iEventIndex) {
+  windowBegin_ = iEventIndex;
+  windowEnd_ = std::min(iEventIndex + static_cast<long>(windowSize_), nEvents_);
+  hsize_t nEventsInWindow = windowEnd_ - windowBegin_;
+
+  windowEventIDs_.resize(nEventsInWindow);
+  register_dataset_sz_read_timer_start("Event_IDs");
+  hdf5::read_slab(eventIDsDataset_, eventIDsSpace_, windowBegin_, nEventsInWindow, windowEventIDs_.data());
+  register_dataset_sz_read_timer_end(nEventsInWindow*sizeof(unsigned int));
+
+  for (size_t productIndex = 0; productIndex < productInfos_.size(); ++productIndex) {
+    //the _sz dataset holds the offset of the end of each event, the first event begins at 0
+    auto& offsets = windowOffsets_[productIndex];
+    offsets.resize(nEventsInWindow+1);
+    auto const& name = productInfos_[productIndex].name();
+    auto const sizeName = name+"_sz";
+    register_dataset_sz_read_timer_start(sizeName.c_str());
+    if (windowBegin_ == 0) {
+      offsets[0] = 0;
+      hdf5::read_slab(offsetDatasets_[productIndex], offsetSpaces_[productIndex], 0, nEventsInWindow, offsets.data()+1);
+    } else {
+      hdf5::read_slab(offsetDatasets_[productIndex], offsetSpaces_[productIndex], windowBegin_-1, nEventsInWindow+1, offsets.data());
+    }
+    register_dataset_sz_read_timer_end(offsets.size()*sizeof(unsigned long long));
+
+    auto& bytes = windowProducts_[productIndex];
+    bytes.resize(offsets.back() - offsets.front());
+    register_dataset_read_timer_start(name.c_str());
+    hdf5::read_slab(productDatasets_[productIndex], productSpaces_[productIndex], offsets.front(), bytes.size(), bytes.data());
+    register_dataset_read_timer_end(bytes.size());
   }
 }
 
 
+long
+HDFSource::nextEventInWindows() {
+  while (true) {
+    if (presentWindow_ >= 0) {
+      auto index = claims_->nextInWindow_[presentWindow_]++;
+      if (index < windowEnd_) {
+        return index;
+      }
+      presentWindow_ = -1;
+    }
+    auto window = claims_->nextWindow_++;
+    if (window >= claims_->nWindows_) {
+      //all windows are claimed, help with one which still has events
+      window = 0;
+      while (window < claims_->nWindows_ and claims_->nextInWindow_[window].load() >= std::min((window+1)*windowSize_, nEvents_)) {
+        ++window;
+      }
+      if (window == claims_->nWindows_) {
+        return -1;
+      }
+    }
+    presentWindow_ = window;
+    readWindow(window*windowSize_);
+  }
+}
+
 bool
 HDFSource::readEvent(long iEventIndex) {
-  constexpr hsize_t ndims = 1;
-  unsigned int run_num[ndims];
-  unsigned int lumi_num[ndims];
-  auto attr_r = hdf5::Attribute::open(lumi_, "run");
-  H5Aread(attr_r, H5T_STD_I32LE,run_num);
-  auto attr_l = hdf5::Attribute::open(lumi_, "lumisec");
-  H5Aread(attr_l, H5T_STD_I32LE,lumi_num);
-  auto dset = hdf5::Dataset::open(lumi_, "Event_IDs");
-  unsigned int eventID[ndims];
-  hsize_t coords[ndims]; 
-  coords[0] = iEventIndex;
-  auto fspace = hdf5::Dataspace::get_space(dset);
-  auto mspace = hdf5::Dataspace::create_simple(1, &ndims, NULL); 
-  H5Sselect_elements(fspace, H5S_SELECT_SET, 1, (const hsize_t *)&coords);
-  H5Dread(dset, H5T_STD_I32LE, mspace, fspace, H5P_DEFAULT, eventID); 
-  eventID_ = {run_num[0], lumi_num[0], eventID[0]};
-  hsize_t start[1];
-  hsize_t count[1];
-  long unsigned int begin;
-  long unsigned int end;
-  std::vector<product_t> products;
-  products.reserve(productInfos_.size());
-  for (auto pi : productInfos_) {
-      std::tie(begin, end) = getEventOffsets(iEventIndex, pi.name());
-      auto prods_dset = hdf5::Dataset::open(lumi_, (pi.name()).c_str());
-      auto prods_fspace = hdf5::Dataspace::get_space(prods_dset);
-      hsize_t dp_sz[1];
-      dp_sz[0] = end-begin;
-      auto prods_mspace = hdf5::Dataspace::create_simple(1, &dp_sz[0], NULL); 
-      //std::cout << "Reading: " << pi.name() << ", Begin at: " << begin << ", and end at : " << end << '\n';
-      std::unique_ptr<char[]> product(new char[dp_sz[0]]);
-      start[0]  = begin;
-      count[0]  = dp_sz[0];
-      prods_fspace.select_hyperslab(start, count);
-      H5Dread(prods_dset, H5T_NATIVE_CHAR, prods_mspace, prods_fspace, H5P_DEFAULT, product.get());
-      products.push_back({product.get(), product.get() + dp_sz[0]});
+  if (iEventIndex >= nEvents_) {
+    return false;
+  }
+  if (windowSize_ > 1) {
+    //the lanes get interleaved event indices so each replica instead reads the events
+    // of the windows it claims, in order
+    iEventIndex = nextEventInWindows();
+    if (iEventIndex < 0) {
+      return false;
+    }
+  } else if (iEventIndex < windowBegin_ or iEventIndex >= windowEnd_) {
+    readWindow(iEventIndex);
   }
+  auto indexInWindow = iEventIndex - windowBegin_;
+  eventID_ = {run_, lumisec_, windowEventIDs_[indexInWindow]};
 
-  deserializeDataProducts(products.begin(), products.end());
+  deserializeDataProducts(indexInWindow);
   return true;
 }
 
-void HDFSource::deserializeDataProducts(buffer_iterator it, buffer_iterator itEnd) {
-  int productIndex = 0;
+void HDFSource::deserializeDataProducts(long iIndexInWindow) {
   TBufferFile bufferFile{TBuffer::kRead};
-  while(it < itEnd) {
-    auto const & product = *(it);
-    auto storedSize = product.size();
-    bufferFile.SetBuffer(const_cast<char*>(reinterpret_cast<char const*>(&product[0])), storedSize, kFALSE);
+  for (size_t productIndex = 0; productIndex < dataProducts_.size(); ++productIndex) {
+    auto const& offsets = windowOffsets_[productIndex];
+    auto begin = offsets[iIndexInWindow] - offsets.front();
+    auto storedSize = offsets[iIndexInWindow+1] - offsets[iIndexInWindow];
+    bufferFile.SetBuffer(windowProducts_[productIndex].data()+begin, storedSize, kFALSE);
     dataProducts_[productIndex].classType()->ReadBuffer(bufferFile, dataBuffers_[productIndex]);
     dataProducts_[productIndex].setSize(bufferFile.Length());
-    //std::cout <<"Product Name: " << dataProducts_[productIndex].name()  << "Product Index "<< productIndex << ", " << dataProducts_[productIndex].classType() << ", storedSize " << storedSize  <<" Buffer size "<<bufferFile.Length() << ", and Buffer data: " << dataBuffers_[productIndex]<< std::endl;
     bufferFile.Reset();
-    ++productIndex;
-    ++it;
   }
-  assert(it==itEnd);
 }
 
 namespace {
+  class ReplicatedHDFSource : public ReplicatedSharedSource<HDFSource> {
+  public:
+    using ReplicatedSharedSource<HDFSource>::ReplicatedSharedSource;
+
+    void printSummary() const final {
+      ReplicatedSharedSource<HDFSource>::printSummary();
+      print_read_timers();
+    }
+  };
+
     class Maker : public SourceMakerBase {
   public:
     Maker(): SourceMakerBase("HDFSource") {}
@@ -174,7 +237,16 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
-        return std::make_unique<ReplicatedSharedSource<HDFSource>>(iNLanes, iNEvents, *fileName);
+        auto windowSize = params.get<unsigned int>("readWindow", 1);
+        if(windowSize == 0) {
+          std::cout <<"readWindow must be at least 1\n";
+          return {};
+        }
+        if(params.get<bool>("h5Timing", false)) {
+          init_timers();
+        }
+        auto claims = std::make_shared<HDFSource::WindowClaims>();
+        return std::make_unique<ReplicatedHDFSource>(iNLanes, iNEvents, *fileName, windowSize, claims);
     }
     };
 
@@ -6,6 +6,8 @@
 #include <optional>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <mutex>
 
 #include "DataProductRetriever.h"
 #include "DelayedProductRetriever.h"
@@ -20,9 +22,21 @@ class HDFDelayedRetriever : public DelayedProductRetriever {
 
 class HDFSource : public SourceBase {
 public:
-  HDFSource(std::string const& iName);
+  //Shared by the replicas when the window size is above 1. Each replica claims whole windows
+  // of consecutive events and takes the events of its window one at a time. Once all windows
+  // are claimed, a replica without events joins a window which still has some so every event
+  // index below the number of events still gets an event.
+  struct WindowClaims {
+    std::once_flag sizeFlag_;
+    long nWindows_ = 0;
+    std::atomic<long> nextWindow_{0};
+    //next event to be taken from each window
+    std::unique_ptr<std::atomic<long>[]> nextInWindow_;
+  };
+
+  HDFSource(std::string const& iName, unsigned int iWindowSize, std::shared_ptr<WindowClaims> iClaims);
   HDFSource(HDFSource&&) = default;
-  HDFSource(HDFSource const&) = default;
+  HDFSource(HDFSource const&) = delete;
   ~HDFSource();
 
   struct ProductInfo{
@@ -38,15 +52,36 @@ public:
   size_t numberOfDataProducts() const final {return productInfos_.size();}
   std::vector<DataProductRetriever>& dataProducts() final {return dataProducts_;}
   EventIdentifier eventIdentifier() final { return eventID_;}
-  using buffer_iterator = std::vector<std::vector<char>>::const_iterator;
 
 private: 
   std::vector<std::string> readClassNames();
-  std::pair<long unsigned int, long unsigned int> getEventOffsets(long eventindex, std::string const& pname);
+  void readWindow(long iEventIndex);
+  long nextEventInWindows();
   bool readEvent(long iEventIndex) final; //returns true if an event was read
-  void deserializeDataProducts(buffer_iterator, buffer_iterator);
+  void deserializeDataProducts(long iIndexInWindow);
   hdf5::File file_;
   hdf5::Group lumi_;
+  //dataset and dataspace handles are kept open for the life of the source
+  hdf5::Dataset eventIDsDataset_;
+  hdf5::Dataspace eventIDsSpace_;
+  std::vector<hdf5::Dataset> productDatasets_;
+  std::vector<hdf5::Dataspace> productSpaces_;
+  std::vector<hdf5::Dataset> offsetDatasets_;
+  std::vector<hdf5::Dataspace> offsetSpaces_;
+  unsigned int run_;
+  unsigned int lumisec_;
+  long nEvents_;
+  unsigned int windowSize_;
+  //events [windowBegin_, windowEnd_) are held in memory
+  long windowBegin_ = 0;
+  long windowEnd_ = 0;
+  //only used with windows, the window the events are presently taken from
+  long presentWindow_ = -1;
+  std::shared_ptr<WindowClaims> claims_;
+  std::vector<unsigned int> windowEventIDs_;
+  //per product: the windowSize_+1 offsets bounding each event and the bytes for all events in the window
+  std::vector<std::vector<unsigned long long>> windowOffsets_;
+  std::vector<std::vector<char>> windowProducts_;
   EventIdentifier eventID_;
   std::vector<DataProductRetriever> dataProducts_; 
   std::vector<void*> dataBuffers_;  
@@ -0,0 +1,79 @@
+#include "HDFWriterThread.h"
+
+using namespace cce::tf;
+
+HDFWriterThread::HDFWriterThread(unsigned int iCredits):
+  credits_{iCredits},
+  thread_([this]() { run(); })
+{}
+
+HDFWriterThread::~HDFWriterThread() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  workReady_.notify_one();
+  thread_.join();
+}
+
+void HDFWriterThread::push(std::function<void()> iWork, TaskHolder iCallback) {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if(items_.size() < credits_) {
+      items_.push_back({std::move(iWork), TaskHolder()});
+    } else {
+      std::call_once(arenaFlag_, [this]() { arena_ = std::make_unique<tbb::task_arena>(tbb::task_arena::attach()); });
+      ++nStalls_;
+      items_.push_back({std::move(iWork), std::move(iCallback)});
+    }
+  }
+  workReady_.notify_one();
+  //if not moved into the item this releases the lane
+}
+
+void HDFWriterThread::drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  workDone_.wait(lock, [this]() { return items_.empty() and not working_;});
+  if(exception_) {
+    auto e = exception_;
+    exception_ = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+void HDFWriterThread::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    workReady_.wait(lock, [this]() { return stop_ or not items_.empty();});
+    if(items_.empty()) {
+      //only get here once stop_ is set and all work is done
+      return;
+    }
+    {
+      Item item = std::move(items_.front());
+      items_.pop_front();
+      working_ = true;
+      lock.unlock();
+
+      auto start = std::chrono::high_resolution_clock::now();
+      try {
+        item.work_();
+      } catch(...) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if(not exception_) {
+          exception_ = std::current_exception();
+        }
+      }
+      busyTime_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+      if(item.callback_.group()) {
+        //The held lane is released when the functor is destroyed by the arena's worker thread.
+        // Releasing it on this thread would spawn its next task outside of the job's arena.
+        arena_->enqueue([callback = std::move(item.callback_)]() {});
+      }
+    }
+
+    lock.lock();
+    working_ = false;
+    workDone_.notify_all();
+  }
+}
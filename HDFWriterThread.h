@@ -0,0 +1,67 @@
+#if !defined(HDFWriterThread_h)
+#define HDFWriterThread_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <memory>
+
+#include "tbb/task_arena.h"
+#include "TaskHolder.h"
+
+namespace cce::tf {
+  /*
+   Runs HDF5 work on a dedicated thread so a slow write does not occupy a TBB worker.
+   The work is done in the order it was pushed. A lane handing off work may continue
+   right away as long as fewer than the credit limit of items are waiting. Once the
+   limit is hit the lane's TaskHolder is held until its work has been done and is then
+   handed back to the task_arena of the pushing thread so the lane continues on its workers.
+   */
+  class HDFWriterThread {
+  public:
+    explicit HDFWriterThread(unsigned int iCredits);
+    ~HDFWriterThread();
+
+    HDFWriterThread(HDFWriterThread const&) = delete;
+    HDFWriterThread(HDFWriterThread&&) = delete;
+    HDFWriterThread& operator=(HDFWriterThread const&) = delete;
+    HDFWriterThread& operator=(HDFWriterThread&&) = delete;
+
+    //Must be called from within the task_arena running the TaskHolder's tasks
+    void push(std::function<void()> iWork, TaskHolder iCallback);
+
+    //Waits until all pushed work has been done. Rethrows an exception thrown by the work.
+    void drain();
+
+    std::chrono::microseconds busyTime() const { return std::chrono::microseconds(busyTime_.load());}
+    unsigned long long nStalls() const { return nStalls_.load();}
+  private:
+    struct Item {
+      std::function<void()> work_;
+      //only holds a task if the credit limit was hit
+      TaskHolder callback_;
+    };
+    void run();
+
+    const unsigned int credits_;
+    std::mutex mutex_;
+    std::condition_variable workReady_;
+    std::condition_variable workDone_;
+    std::deque<Item> items_;
+    bool working_ = false;
+    bool stop_ = false;
+    std::exception_ptr exception_;
+    std::atomic<std::chrono::microseconds::rep> busyTime_{0};
+    std::atomic<unsigned long long> nStalls_{0};
+    std::once_flag arenaFlag_;
+    std::unique_ptr<tbb::task_arena> arena_;
+    //declared last so the other members are ready when the thread starts
+    std::thread thread_;
+  };
+}
+#endif
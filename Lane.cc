@@ -48,6 +48,7 @@ void Lane::processEventAsync(tbb::task_group& group, TaskHolder iCallback, const
   //std::cout <<"make process event task"<<std::endl;
   TaskHolder holder(group, 
                     make_functor_task([&outputer, this, callback=std::move(iCallback)]() {
+                        outputer.setEventIndex(this->index_, presentEventIndex_);
                         outputer.outputAsync(this->index_, source_->eventIdentifier(index_, presentEventIndex_),
                                              std::move(callback));
                       }));
@@ -0,0 +1,365 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <map>
+#include <iostream>
+#include <limits>
+#include "EventIdentifier.h"
+#include "DataProductRetriever.h"
+#include "TaskHolder.h"
+#include "FunctorTask.h"
+#include "WaiterBase.h"
+#include "WaiterFactory.h"
+#include "TimerService.h"
+
+
+namespace cce::tf {
+  /*
+   Mimics a framework's modules which consume and produce data products. Each module runs once
+   all the modules it depends on have run and all the data products it consumes from the Source
+   have been retrieved. A data product produced by a module is only passed on to the Outputer once
+   that module has run. Data products not produced by any module are passed on once all modules
+   for the event have run. The modules are run as tasks in the Lane's task_group.
+   */
+  class ModuleDAGWaiter : public WaiterBase {
+  public:
+    struct Module {
+      std::string name_;
+      double cost_; //microseconds
+      std::vector<std::string> consumes_;
+      std::vector<std::string> produces_;
+    };
+
+    ModuleDAGWaiter(std::vector<Module> iModules, unsigned int iNLanes, bool iBlocking):
+      modules_(std::move(iModules)),
+      laneStates_(iNLanes),
+      laneMutexes_(iNLanes),
+      timer_{iBlocking ? nullptr : std::make_unique<TimerService>()} {
+      for(unsigned int i=0; i< modules_.size(); ++i) {
+        moduleIndex_[modules_[i].name_] = i;
+        for(auto const& p: modules_[i].produces_) {
+          producerOfName_[p] = i;
+        }
+      }
+      dependents_.resize(modules_.size());
+      nModuleDependencies_.resize(modules_.size(),0);
+      for(unsigned int i=0; i< modules_.size(); ++i) {
+        for(auto const& c: modules_[i].consumes_) {
+          auto itModule = moduleIndex_.find(c);
+          std::optional<unsigned int> dependsOn;
+          if(itModule != moduleIndex_.end()) {
+            dependsOn = itModule->second;
+          } else {
+            auto itProducer = producerOfName_.find(c);
+            if(itProducer != producerOfName_.end()) {
+              dependsOn = itProducer->second;
+            }
+          }
+          if(dependsOn) {
+            dependents_[*dependsOn].push_back(i);
+            ++nModuleDependencies_[i];
+          }
+        }
+      }
+    }
+
+    void waitAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, long iEventIndex,
+                   std::vector<DataProductRetriever> const& iRetrievers, unsigned int index,
+                   TaskHolder iCallback) const final {
+      //all lanes have the same data products in the same order
+      std::call_once(mapFlag_, [this, &iRetrievers]() { mapProducts(iRetrievers); });
+
+      std::shared_ptr<EventState> state;
+      bool newEvent = false;
+      {
+        std::lock_guard<std::mutex> guard(laneMutexes_[iLaneIndex]);
+        auto& laneState = laneStates_[iLaneIndex];
+        if(not laneState or laneState->eventIndex_ != iEventIndex) {
+          laneState = std::make_shared<EventState>(iEventIndex, *iCallback.group(), nDependencies_, iRetrievers.size());
+          newEvent = true;
+        }
+        state = laneState;
+      }
+      state->callbacks_[index].emplace(std::move(iCallback));
+      productStepDone(*state, index);
+
+      if(newEvent) {
+        if(modules_.empty()) {
+          allModulesDone(*state);
+        }
+        for(unsigned int m = 0; m < modules_.size(); ++m) {
+          if(0 == nDependencies_[m]) {
+            startModule(state, m);
+          }
+        }
+      }
+      for(auto m: consumersOfProduct_[index]) {
+        if(0 == --state->waitingOn_[m]) {
+          startModule(state, m);
+        }
+      }
+    }
+
+  private:
+    static constexpr unsigned int kNoModule = std::numeric_limits<unsigned int>::max();
+
+    struct EventState {
+      EventState(long iEventIndex, tbb::task_group& iGroup, std::vector<unsigned int> const& iNDependencies, std::size_t iNProducts):
+        eventIndex_{iEventIndex},
+        group_{&iGroup},
+        waitingOn_{new std::atomic<unsigned int>[iNDependencies.size()]},
+        modulesLeft_{static_cast<unsigned int>(iNDependencies.size())},
+        productSteps_{new std::atomic<unsigned int>[iNProducts]},
+        callbacks_(iNProducts) {
+        for(std::size_t i=0; i< iNDependencies.size(); ++i) {
+          waitingOn_[i] = iNDependencies[i];
+        }
+        for(std::size_t i=0; i< iNProducts; ++i) {
+          productSteps_[i] = 0;
+        }
+      }
+      long eventIndex_;
+      tbb::task_group* group_;
+      std::unique_ptr<std::atomic<unsigned int>[]> waitingOn_;
+      std::atomic<unsigned int> modulesLeft_;
+      //a data product is released once both its callback has arrived and its producer has run
+      std::unique_ptr<std::atomic<unsigned int>[]> productSteps_;
+      std::vector<std::optional<TaskHolder>> callbacks_;
+    };
+
+    void mapProducts(std::vector<DataProductRetriever> const& iRetrievers) const {
+      consumersOfProduct_.resize(iRetrievers.size());
+      producerOfProduct_.resize(iRetrievers.size(), kNoModule);
+      nDependencies_ = nModuleDependencies_;
+      producedBy_.resize(modules_.size());
+      std::map<std::string, unsigned int> productIndex;
+      for(unsigned int i=0; i< iRetrievers.size(); ++i) {
+        productIndex[iRetrievers[i].name()] = i;
+      }
+      for(unsigned int m=0; m< modules_.size(); ++m) {
+        for(auto const& p: modules_[m].produces_) {
+          auto itFound = productIndex.find(p);
+          if(itFound == productIndex.end()) {
+            continue;
+          }
+          producerOfProduct_[itFound->second] = m;
+          producedBy_[m].push_back(itFound->second);
+        }
+      }
+      for(unsigned int m=0; m< modules_.size(); ++m) {
+        for(auto const& c: modules_[m].consumes_) {
+          if(moduleIndex_.find(c) != moduleIndex_.end() or producerOfName_.find(c) != producerOfName_.end()) {
+            //already accounted for by nModuleDependencies_
+            continue;
+          }
+          auto itFound = productIndex.find(c);
+          if(itFound == productIndex.end()) {
+            std::cout <<"ModuleDAGWaiter: module '"<<modules_[m].name_<<"' consumes unknown '"<<c<<"'"<<std::endl;
+            continue;
+          }
+          consumersOfProduct_[itFound->second].push_back(m);
+          ++nDependencies_[m];
+        }
+      }
+      for(unsigned int p=0; p< iRetrievers.size(); ++p) {
+        if(producerOfProduct_[p] == kNoModule) {
+          unproducedProducts_.push_back(p);
+        }
+      }
+    }
+
+    void startModule(std::shared_ptr<EventState> const& iState, unsigned int iModule) const {
+      using namespace std::chrono_literals;
+      auto cost = std::chrono::duration_cast<std::chrono::microseconds>(modules_[iModule].cost_*1us);
+      auto group = iState->group_;
+      if(timer_) {
+        timer_->releaseAfter(cost, TaskHolder(*group, make_functor_task([this, iState, iModule]() {
+                moduleDone(iState, iModule);
+              })));
+      } else {
+        group->run([this, iState, iModule, cost]() {
+            std::this_thread::sleep_for(cost);
+            moduleDone(iState, iModule);
+          });
+      }
+    }
+
+    void moduleDone(std::shared_ptr<EventState> const& iState, unsigned int iModule) const {
+      for(auto d: dependents_[iModule]) {
+        if(0 == --iState->waitingOn_[d]) {
+          startModule(iState, d);
+        }
+      }
+      for(auto p: producedBy_[iModule]) {
+        productStepDone(*iState, p);
+      }
+      if(0 == --iState->modulesLeft_) {
+        allModulesDone(*iState);
+      }
+    }
+
+    void allModulesDone(EventState& iState) const {
+      for(auto p: unproducedProducts_) {
+        productStepDone(iState, p);
+      }
+    }
+
+    void productStepDone(EventState& iState, unsigned int iProduct) const {
+      if(2 == ++iState.productSteps_[iProduct]) {
+        iState.callbacks_[iProduct].reset();
+      }
+    }
+
+    std::vector<Module> modules_;
+    std::map<std::string, unsigned int> moduleIndex_;
+    std::map<std::string, unsigned int> producerOfName_;
+    std::vector<std::vector<unsigned int>> dependents_;
+    std::vector<unsigned int> nModuleDependencies_;
+
+    //filled the first time the waiter is called
+    mutable std::once_flag mapFlag_;
+    mutable std::vector<unsigned int> nDependencies_;
+    mutable std::vector<std::vector<unsigned int>> consumersOfProduct_;
+    mutable std::vector<unsigned int> producerOfProduct_;
+    mutable std::vector<std::vector<unsigned int>> producedBy_;
+    mutable std::vector<unsigned int> unproducedProducts_;
+
+    mutable std::vector<std::shared_ptr<EventState>> laneStates_;
+    mutable std::vector<std::mutex> laneMutexes_;
+    std::unique_ptr<TimerService> timer_;
+  };
+}
+
+namespace {
+
+  using namespace cce::tf;
+
+  //Each line describes one module
+  //   <module name> <cost in microseconds> [consumes <name> ...] [produces <data product name> ...]
+  // where a consumed name is either a module or a data product. Text after a '#' is ignored.
+  std::optional<std::vector<ModuleDAGWaiter::Module>> readModules(std::ifstream& iFile, float iScale) {
+    std::vector<ModuleDAGWaiter::Module> modules;
+    std::string line;
+    while(std::getline(iFile, line)) {
+      line = line.substr(0, line.find('#'));
+      std::istringstream tokens(line);
+      ModuleDAGWaiter::Module module;
+      if(not (tokens >> module.name_)) {
+        continue;
+      }
+      if(not (tokens >> module.cost_)) {
+        std::cout <<"no cost given for module '"<<module.name_<<"'"<<std::endl;
+        return {};
+      }
+      module.cost_ *= iScale;
+      std::vector<std::string>* list = nullptr;
+      std::string token;
+      while(tokens >> token) {
+        if(token == "consumes") {
+          list = &module.consumes_;
+        } else if(token == "produces") {
+          list = &module.produces_;
+        } else if(list) {
+          list->push_back(token);
+        } else {
+          std::cout <<"expected 'consumes' or 'produces' but found '"<<token<<"' for module '"<<module.name_<<"'"<<std::endl;
+          return {};
+        }
+      }
+      modules.push_back(std::move(module));
+    }
+    return modules;
+  }
+
+  bool checkModules(std::vector<ModuleDAGWaiter::Module> const& iModules) {
+    std::map<std::string, unsigned int> moduleIndex;
+    std::map<std::string, unsigned int> producer;
+    for(unsigned int i=0; i< iModules.size(); ++i) {
+      if(not moduleIndex.emplace(iModules[i].name_, i).second) {
+        std::cout <<"module '"<<iModules[i].name_<<"' is declared more than once"<<std::endl;
+        return false;
+      }
+      for(auto const& p: iModules[i].produces_) {
+        if(not producer.emplace(p, i).second) {
+          std::cout <<"data product '"<<p<<"' is produced by both '"<<iModules[producer[p]].name_<<"' and '"<<iModules[i].name_<<"'"<<std::endl;
+          return false;
+        }
+      }
+    }
+    //use Kahn's algorithm to find cycles
+    std::vector<std::vector<unsigned int>> dependents(iModules.size());
+    std::vector<unsigned int> nDependencies(iModules.size(), 0);
+    for(unsigned int i=0; i< iModules.size(); ++i) {
+      for(auto const& c: iModules[i].consumes_) {
+        auto itModule = moduleIndex.find(c);
+        auto itProducer = producer.find(c);
+        if(itModule != moduleIndex.end()) {
+          dependents[itModule->second].push_back(i);
+          ++nDependencies[i];
+        } else if(itProducer != producer.end()) {
+          dependents[itProducer->second].push_back(i);
+          ++nDependencies[i];
+        }
+      }
+    }
+    std::vector<unsigned int> ready;
+    for(unsigned int i=0; i< iModules.size(); ++i) {
+      if(0 == nDependencies[i]) {
+        ready.push_back(i);
+      }
+    }
+    unsigned int nVisited = 0;
+    while(not ready.empty()) {
+      auto m = ready.back();
+      ready.pop_back();
+      ++nVisited;
+      for(auto d: dependents[m]) {
+        if(0 == --nDependencies[d]) {
+          ready.push_back(d);
+        }
+      }
+    }
+    if(nVisited != iModules.size()) {
+      std::cout <<"the module dependencies contain a cycle"<<std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  class Maker : public WaiterMakerBase {
+  public:
+    Maker(): WaiterMakerBase("ModuleDAGWaiter") {}
+
+    std::unique_ptr<WaiterBase> create(unsigned int iNLanes, std::size_t iNDataProducts, ConfigurationParameters const& params) const final {
+      auto scale = params.get<float>("scale", 1.);
+      auto blocking = params.get<bool>("blocking", false);
+
+      auto filename = params.get<std::string>("filename");
+      if(not filename) {
+        std::cout <<"no file name give for ModuleDAGWaiter"<<std::endl;
+        return {};
+      }
+
+      std::ifstream file(*filename);
+      if(not file.is_open()) {
+        std::cout <<"unable to open file "<<*filename<<" with module dependencies";
+        return {};
+      }
+      auto modules = readModules(file, scale);
+      if(not modules or not checkModules(*modules)) {
+        return {};
+      }
+
+      return std::make_unique<ModuleDAGWaiter>(std::move(*modules), iNLanes, blocking);
+    }
+
+  };
+
+  Maker s_maker;
+}
@@ -18,6 +18,9 @@ class OutputerBase {
   virtual bool usesProductReadyAsync() const = 0;
 
 
+  //called just before outputAsync. iEventIndex is the position of the event in the order given by the source
+  virtual void setEventIndex(unsigned int iLaneIndex, long iEventIndex) const {}
+
   virtual void outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const = 0;
 
   virtual void printSummary() const = 0;
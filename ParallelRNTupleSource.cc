@@ -0,0 +1,255 @@
+#include "ParallelRNTupleSource.h"
+#include "SourceFactory.h"
+
+#include "ROOT/RNTupleDescriptor.hxx"
+#include "ROOT/RNTupleReadOptions.hxx"
+#include "TClass.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace cce::tf;
+
+namespace {
+  const std::string eventIDBranchName{"EventID"};
+
+  std::unique_ptr<ROOT::RNTupleReader> openReader(std::string const& iName) {
+    ROOT::RNTupleReadOptions options;
+    options.SetClusterCache(ROOT::RNTupleReadOptions::EClusterCache::kOn);
+    return ROOT::RNTupleReader::Open("Events", iName.c_str(), options);
+  }
+}
+
+ParallelRNTupleSource::ParallelRNTupleSource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName, unsigned int iClustersPerClaim, bool iBulkRead):
+  SharedSourceBase(iNEvents),
+  bulkRead_{iBulkRead},
+  clustersPerClaim_{iClustersPerClaim}
+ {
+  std::vector<std::string> fieldIDs;
+  std::vector<std::string> fieldTypes;
+  {
+    auto reader = openReader(iName);
+    nEvents_ = std::min<unsigned long long>(iNEvents, reader->GetNEntries());
+
+    auto const& subfields = reader->GetModel().GetConstFieldZero().GetConstSubfields();
+    fieldIDs.reserve(subfields.size());
+    fieldTypes.reserve(subfields.size());
+    for(auto* field: subfields) {
+      if(eventIDBranchName == field->GetFieldName()) {
+        continue;
+      }
+      fieldIDs.emplace_back(field->GetFieldName());
+      fieldTypes.emplace_back(field->GetTypeName());
+    }
+
+    std::vector<std::pair<ROOT::NTupleSize_t, ROOT::DescriptorId_t>> clusters;
+    ROOT::NTupleSize_t maxClusterEntries = 0;
+    auto const& descriptor = reader->GetDescriptor();
+    for(auto const& cluster: descriptor.GetClusterIterable()) {
+      clusters.emplace_back(cluster.GetFirstEntryIndex(), cluster.GetId());
+      maxClusterEntries = std::max<ROOT::NTupleSize_t>(maxClusterEntries, cluster.GetNEntries());
+    }
+    std::sort(clusters.begin(), clusters.end());
+    for(auto const& [firstEntry, id]: clusters) {
+      clusterBoundaries_.push_back(firstEntry);
+      clusterIDs_.push_back(id);
+    }
+    clusterBoundaries_.push_back(reader->GetNEntries());
+    clusterNextEntry_ = std::make_unique<std::atomic<ROOT::NTupleSize_t>[]>(clusters.size());
+    for(size_t i=0; i < clusters.size(); ++i) {
+      clusterNextEntry_[i] = clusterBoundaries_[i];
+    }
+
+    if(bulkRead_) {
+      bulkMask_ = std::make_unique<bool[]>(maxClusterEntries);
+      std::fill(bulkMask_.get(), bulkMask_.get()+maxClusterEntries, true);
+      bulkFieldTypes_ = fieldTypes;
+      bulkFieldTypes_.push_back(reader->GetModel().GetConstField(eventIDBranchName).GetTypeName());
+    }
+  }
+
+  laneInfos_.reserve(iNLanes);
+  for(unsigned int laneId=0; laneId < iNLanes; ++laneId) {
+    laneInfos_.emplace_back(iName, fieldIDs, fieldTypes, bulkRead_);
+  }
+}
+
+ParallelRNTupleSource::LaneInfo::LaneInfo(std::string const& iName, std::vector<std::string> const& iFieldIDs, std::vector<std::string> const& iFieldTypes, bool iBulkRead):
+  reader_{openReader(iName)},
+  readTime_{std::chrono::microseconds::zero()}
+{
+  if(not iBulkRead) {
+    entry_ = reader_->GetModel().CreateEntry();
+    identifier_ = entry_->GetPtr<EventIdentifier>(eventIDBranchName).get();
+  }
+  ptrToDataProducts_.reserve(iFieldIDs.size());
+  dataProducts_.reserve(iFieldIDs.size());
+  for(size_t i=0; i< iFieldIDs.size(); ++i) {
+    TClass* class_ptr=TClass::GetClass(iFieldTypes[i].c_str());
+    ptrToDataProducts_.push_back(entry_ ? entry_->GetPtr<void>(iFieldIDs[i]).get() : nullptr);
+    dataProducts_.emplace_back(i,
+                               &ptrToDataProducts_[i],
+                               iFieldIDs[i],
+                               class_ptr,
+                               &retriever_);
+  }
+  if(iBulkRead) {
+    auto addBulk = [this](std::string const& iFieldID) {
+      //the bulk values must come from the field connected to the reader's page source
+      auto& field = const_cast<ROOT::RFieldBase&>(reader_->GetModel().GetConstField(iFieldID));
+      bulks_.push_back(field.CreateBulk());
+      valueSizes_.push_back(field.GetValueSize());
+    };
+    bulks_.reserve(iFieldIDs.size()+1);
+    for(auto const& id: iFieldIDs) {
+      addBulk(id);
+    }
+    addBulk(eventIDBranchName);
+    bulkArrays_.resize(bulks_.size(), nullptr);
+    bulkReadTimes_.resize(bulks_.size(), std::chrono::microseconds::zero());
+  }
+}
+
+bool ParallelRNTupleSource::claimClusters(LaneInfo& iLane) {
+  auto const nClusters = clusterIDs_.size();
+  auto const first = nextCluster_.fetch_add(clustersPerClaim_);
+  if(first >= nClusters) {
+    return false;
+  }
+  iLane.nextCluster_ = first;
+  iLane.endCluster_ = std::min<size_t>(first+clustersPerClaim_, nClusters);
+  ++iLane.nClaims_;
+  return true;
+}
+
+bool ParallelRNTupleSource::joinCluster(LaneInfo& iLane) {
+  for(size_t cluster=0; cluster < clusterIDs_.size(); ++cluster) {
+    if(clusterNextEntry_[cluster].load() < clusterBoundaries_[cluster+1]) {
+      startCluster(iLane, cluster);
+      ++iLane.nJoins_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParallelRNTupleSource::startCluster(LaneInfo& iLane, size_t iCluster) {
+  iLane.inCluster_ = true;
+  iLane.presentCluster_ = iCluster;
+  iLane.firstEntry_ = clusterBoundaries_[iCluster];
+  if(bulkRead_) {
+    auto const nEntries = clusterBoundaries_[iCluster+1] - iLane.firstEntry_;
+    for(size_t i=0; i < iLane.bulks_.size(); ++i) {
+      auto start = std::chrono::high_resolution_clock::now();
+      iLane.bulkArrays_[i] = static_cast<char*>(iLane.bulks_[i].ReadBulk(ROOT::RNTupleLocalIndex(clusterIDs_[iCluster], 0), bulkMask_.get(), nEntries));
+      iLane.bulkReadTimes_[i] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    }
+    iLane.nBulkEntries_ += nEntries;
+  }
+}
+
+std::optional<ROOT::NTupleSize_t> ParallelRNTupleSource::nextEntry(LaneInfo& iLane) {
+  while(true) {
+    if(iLane.inCluster_) {
+      auto const cluster = iLane.presentCluster_;
+      auto const entry = clusterNextEntry_[cluster]++;
+      if(entry < clusterBoundaries_[cluster+1]) {
+        return entry;
+      }
+      iLane.inCluster_ = false;
+    }
+    if(iLane.nextCluster_ != iLane.endCluster_ or claimClusters(iLane)) {
+      startCluster(iLane, iLane.nextCluster_++);
+    } else if(not joinCluster(iLane)) {
+      return {};
+    }
+  }
+}
+
+void ParallelRNTupleSource::readEventAsync(unsigned int iLane, long iEventIndex, OptionalTaskHolder iTask) {
+  //which entry is read does not depend on iEventIndex. One entry is taken per index below nEvents_
+  // so one is always available.
+  if(static_cast<unsigned long long>(iEventIndex) >= nEvents_) {
+    return;
+  }
+  auto& laneInfo = laneInfos_[iLane];
+  auto start = std::chrono::high_resolution_clock::now();
+  auto entry = nextEntry(laneInfo);
+  if(not entry) {
+    return;
+  }
+  if(bulkRead_) {
+    auto const indexInCluster = *entry - laneInfo.firstEntry_;
+    for(size_t i=0; i < laneInfo.ptrToDataProducts_.size(); ++i) {
+      laneInfo.ptrToDataProducts_[i] = laneInfo.bulkArrays_[i] + indexInCluster*laneInfo.valueSizes_[i];
+    }
+    laneInfo.identifier_ = reinterpret_cast<EventIdentifier const*>(laneInfo.bulkArrays_.back() + indexInCluster*laneInfo.valueSizes_.back());
+  } else {
+    laneInfo.reader_->LoadEntry(*entry, *laneInfo.entry_);
+  }
+  laneInfo.readTime_ += std::chrono::duration_cast<decltype(laneInfo.readTime_)>(std::chrono::high_resolution_clock::now() - start);
+  iTask.runNow();
+}
+
+std::chrono::microseconds ParallelRNTupleSource::accumulatedTime() const {
+  auto fullTime = std::chrono::microseconds::zero();
+  for(auto const& laneInfo: laneInfos_) {
+    fullTime += laneInfo.readTime_ + laneInfo.retriever_.accumulatedTime();
+  }
+  return fullTime;
+}
+
+void ParallelRNTupleSource::printSummary() const {
+  unsigned int nClaims = 0;
+  unsigned int nJoins = 0;
+  for(auto const& laneInfo: laneInfos_) {
+    nClaims += laneInfo.nClaims_;
+    nJoins += laneInfo.nJoins_;
+  }
+  std::cout <<"\nSource time: "<<accumulatedTime().count()<<"us\n"
+    "  clusters in file: "<<clusterIDs_.size()<<", claimed by the lanes in "<<nClaims<<" claims, joined by other lanes "<<nJoins<<" times\n";
+  if(bulkRead_) {
+    //fields of the same type are summed together
+    std::map<std::string, std::pair<unsigned long long, std::chrono::microseconds>> perType;
+    for(auto const& laneInfo: laneInfos_) {
+      for(size_t i=0; i < bulkFieldTypes_.size(); ++i) {
+        auto& [nEntries, time] = perType.emplace(bulkFieldTypes_[i], std::make_pair(0ULL, std::chrono::microseconds::zero())).first->second;
+        nEntries += laneInfo.nBulkEntries_;
+        time += laneInfo.bulkReadTimes_[i];
+      }
+    }
+    std::cout <<"  bulk read by field type:\n";
+    for(auto const& [type, entriesAndTime]: perType) {
+      auto const& [nEntries, time] = entriesAndTime;
+      std::cout <<"   "<<type<<": "<<nEntries<<" entries in "<<time.count()<<"us";
+      if(time.count() != 0) {
+        std::cout <<", "<<static_cast<double>(nEntries)/time.count()*1.0E6<<" entries/s";
+      }
+      std::cout <<"\n";
+    }
+  }
+  std::cout <<std::endl;
+}
+
+
+namespace {
+    class Maker : public SourceMakerBase {
+  public:
+    Maker(): SourceMakerBase("ParallelRNTupleSource") {}
+      std::unique_ptr<SharedSourceBase> create(unsigned int iNLanes, unsigned long long iNEvents, ConfigurationParameters const& params) const final {
+        auto fileName = params.get<std::string>("fileName");
+        if(not fileName) {
+          std::cout <<"no file name given\n";
+          return {};
+        }
+        auto clustersPerClaim = params.get<unsigned int>("clustersPerClaim", 2);
+        if(clustersPerClaim == 0) {
+          std::cout <<"clustersPerClaim must be greater than 0\n";
+          return {};
+        }
+        return std::make_unique<ParallelRNTupleSource>(iNLanes, iNEvents, *fileName, clustersPerClaim, params.get<bool>("bulkRead", false));
+    }
+    };
+
+  Maker s_maker;
+}
@@ -0,0 +1,105 @@
+#if !defined(ParallelRNTupleSource_h)
+#define ParallelRNTupleSource_h
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <optional>
+
+#include "DataProductRetriever.h"
+#include "DelayedProductRetriever.h"
+
+#include "SharedSourceBase.h"
+#include "ROOT/RNTuple.hxx"
+#include "ROOT/RNTupleReader.hxx"
+#include "ROOT/RField.hxx"
+#include "SerialRNTupleRetrievers.h"
+
+namespace cce::tf {
+  /*
+   Each lane has its own RNTupleReader so reading, decompressing and deserializing
+   proceed concurrently. Lanes claim whole clusters, iClustersPerClaim at a time,
+   and read the entries of their claim in order. That lets the cluster pool of the
+   lane's reader prefetch the next cluster of the claim while the present one is used.
+   Each entry is taken from its cluster's atomic counter. Once all clusters are claimed,
+   a lane without entries joins a cluster of another lane which still has some, so every
+   event index below the number of entries still gets an entry.
+   With iBulkRead each field is read for a whole cluster at once with the RNTuple bulk
+   API into arrays owned by the lane and the products of an event point into those arrays.
+   */
+  class ParallelRNTupleSource : public SharedSourceBase {
+  public:
+    ParallelRNTupleSource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName, unsigned int iClustersPerClaim, bool iBulkRead);
+    size_t numberOfDataProducts() const final {return laneInfos_[0].dataProducts_.size();}
+
+    std::vector<DataProductRetriever>& dataProducts(unsigned int iLane, long iEventIndex) final {
+      return laneInfos_[iLane].dataProducts_;
+    }
+    EventIdentifier eventIdentifier(unsigned int iLane, long iEventIndex) final {
+      return *laneInfos_[iLane].identifier_;
+    }
+
+    void printSummary() const final;
+    std::chrono::microseconds accumulatedTime() const;
+  private:
+    struct LaneInfo {
+      LaneInfo(std::string const& iName, std::vector<std::string> const& iFieldIDs, std::vector<std::string> const& iFieldTypes, bool iBulkRead);
+
+      LaneInfo(LaneInfo&&) = default;
+      LaneInfo(LaneInfo const&) = delete;
+
+      std::unique_ptr<ROOT::RNTupleReader> reader_;
+      std::unique_ptr<ROOT::REntry> entry_;
+      //points into entry_ or, when bulk reading, into the EventID bulk array
+      EventIdentifier const* identifier_ = nullptr;
+      std::vector<void*> ptrToDataProducts_;
+      SerialRNTuplePromptRetriever retriever_;
+      std::vector<DataProductRetriever> dataProducts_;
+
+      //only used when bulk reading. Same order as the data products with EventID last
+      std::vector<ROOT::RFieldBase::RBulkValues> bulks_;
+      std::vector<std::size_t> valueSizes_;
+      std::vector<char*> bulkArrays_;
+      std::vector<std::chrono::microseconds> bulkReadTimes_;
+      unsigned long long nBulkEntries_ = 0;
+
+      //clusters claimed by the lane which have not yet been started
+      size_t nextCluster_ = 0;
+      size_t endCluster_ = 0;
+      //the cluster the lane presently takes its entries from
+      bool inCluster_ = false;
+      size_t presentCluster_ = 0;
+      ROOT::NTupleSize_t firstEntry_ = 0;
+      unsigned int nClaims_ = 0;
+      unsigned int nJoins_ = 0;
+      std::chrono::microseconds readTime_;
+    };
+
+    void readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder) final;
+    bool claimClusters(LaneInfo&);
+    bool joinCluster(LaneInfo&);
+    void startCluster(LaneInfo&, size_t iCluster);
+    std::optional<ROOT::NTupleSize_t> nextEntry(LaneInfo&);
+
+    //first entry of each cluster in entry order followed by the number of entries
+    std::vector<ROOT::NTupleSize_t> clusterBoundaries_;
+    std::vector<ROOT::DescriptorId_t> clusterIDs_;
+    //next entry to be taken from each cluster
+    std::unique_ptr<std::atomic<ROOT::NTupleSize_t>[]> clusterNextEntry_;
+    //all true, one per entry of the largest cluster
+    std::unique_ptr<bool[]> bulkMask_;
+    bool bulkRead_;
+    //same order as the bulks_ of each lane
+    std::vector<std::string> bulkFieldTypes_;
+    unsigned int clustersPerClaim_;
+    std::atomic<size_t> nextCluster_{0};
+    unsigned long long nEvents_;
+
+    std::vector<LaneInfo> laneInfos_;
+  };
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "EventIdentifier.h"
+#include "DataProductRetriever.h"
+#include "TaskHolder.h"
+#include "WaiterBase.h"
+#include "WaiterFactory.h"
+#include "TimerService.h"
+
+
+namespace cce::tf {
+  /*
+   Replays a per event, per data product table of times. The table columns are matched to the
+   data products using DataProductRetriever::name(). Data products without a column do not wait.
+   */
+  class ProductTimesWaiter : public WaiterBase {
+  public:
+
+    ProductTimesWaiter(std::vector<std::string> iNames, std::vector<float> iTimes, bool iBlocking):
+      names_(std::move(iNames)),
+      times_(std::move(iTimes)),
+      nEvents_{times_.size()/names_.size()},
+      timer_{iBlocking ? nullptr : std::make_unique<TimerService>()} {}
+
+    void waitAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, long iEventIndex,
+                   std::vector<DataProductRetriever> const& iRetrievers, unsigned int index,
+                   TaskHolder iCallback) const final {
+      //all lanes have the same data products in the same order
+      std::call_once(mapFlag_, [this, &iRetrievers]() { mapColumns(iRetrievers); });
+      auto column = columnForProduct_[index];
+      if(column == kNoColumn) {
+        return;
+      }
+      using namespace std::chrono_literals;
+      auto sleep = std::chrono::duration_cast<std::chrono::microseconds>(times_[(iEventIndex % nEvents_)*names_.size()+column]*1us);
+      if(timer_) {
+        timer_->releaseAfter(sleep, std::move(iCallback));
+        return;
+      }
+      iCallback.group()->run([iCallback, sleep]() {
+          std::this_thread::sleep_for(sleep);
+        });
+    }
+
+  private:
+    static constexpr unsigned int kNoColumn = std::numeric_limits<unsigned int>::max();
+
+    void mapColumns(std::vector<DataProductRetriever> const& iRetrievers) const {
+      columnForProduct_.reserve(iRetrievers.size());
+      std::vector<bool> used(names_.size(), false);
+      for(auto const& r: iRetrievers) {
+        auto itFound = std::find(names_.begin(), names_.end(), r.name());
+        if(itFound == names_.end()) {
+          columnForProduct_.push_back(kNoColumn);
+        } else {
+          auto column = itFound - names_.begin();
+          used[column] = true;
+          columnForProduct_.push_back(column);
+        }
+      }
+      for(unsigned int i=0; i< names_.size(); ++i) {
+        if(not used[i]) {
+          std::cout <<"ProductTimesWaiter: no data product named '"<<names_[i]<<"'"<<std::endl;
+        }
+      }
+    }
+
+    std::vector<std::string> names_;
+    std::vector<float> times_;
+    std::size_t nEvents_;
+    std::unique_ptr<TimerService> timer_;
+    mutable std::once_flag mapFlag_;
+    mutable std::vector<unsigned int> columnForProduct_;
+  };
+}
+
+namespace {
+
+  using namespace cce::tf;
+
+  constexpr char kBinaryMagic[4] = {'P','T','I','M'};
+
+  //Binary layout: 'PTIM', uint32 # products, null terminated product names,
+  // uint32 # events, then float times for each product of the first event, then of the second, ...
+  bool readBinary(std::ifstream& iFile, std::vector<std::string>& oNames, std::vector<float>& oTimes) {
+    uint32_t nProducts;
+    if(not iFile.read(reinterpret_cast<char*>(&nProducts), sizeof(nProducts))) {
+      return false;
+    }
+    oNames.resize(nProducts);
+    for(auto& n: oNames) {
+      if(not std::getline(iFile, n, '\0')) {
+        return false;
+      }
+    }
+    uint32_t nEvents;
+    if(not iFile.read(reinterpret_cast<char*>(&nEvents), sizeof(nEvents))) {
+      return false;
+    }
+    oTimes.resize(std::size_t(nEvents)*nProducts);
+    return static_cast<bool>(iFile.read(reinterpret_cast<char*>(oTimes.data()), oTimes.size()*sizeof(float)));
+  }
+
+  std::string trim(std::string const& iValue) {
+    auto begin = iValue.find_first_not_of(" \t\r");
+    if(begin == std::string::npos) {
+      return std::string();
+    }
+    auto end = iValue.find_last_not_of(" \t\r");
+    return iValue.substr(begin, end-begin+1);
+  }
+
+  //CSV layout: first line holds the product names, each following line the times for one event.
+  // A first column named 'event' is ignored.
+  bool readCSV(std::ifstream& iFile, std::vector<std::string>& oNames, std::vector<float>& oTimes) {
+    std::string line;
+    if(not std::getline(iFile, line)) {
+      return false;
+    }
+    std::istringstream header(line);
+    std::string value;
+    while(std::getline(header, value, ',')) {
+      oNames.push_back(trim(value));
+    }
+    bool skipFirst = (not oNames.empty()) and oNames.front() == "event";
+    if(skipFirst) {
+      oNames.erase(oNames.begin());
+    }
+    while(std::getline(iFile, line)) {
+      if(trim(line).empty()) {
+        continue;
+      }
+      std::istringstream row(line);
+      std::size_t nValues = 0;
+      bool first = true;
+      while(std::getline(row, value, ',')) {
+        if(first and skipFirst) {
+          first = false;
+          continue;
+        }
+        first = false;
+        oTimes.push_back(std::stof(value));
+        ++nValues;
+      }
+      if(nValues != oNames.size()) {
+        std::cout <<"line '"<<line<<"' has "<<nValues<<" times but expected "<<oNames.size()<<std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  class Maker : public WaiterMakerBase {
+  public:
+    Maker(): WaiterMakerBase("ProductTimesWaiter") {}
+
+    std::unique_ptr<WaiterBase> create(unsigned int iNLanes, std::size_t iNDataProducts, ConfigurationParameters const& params) const final {
+      auto scale = params.get<float>("scale", 1.);
+      auto blocking = params.get<bool>("blocking", false);
+
+      auto filename = params.get<std::string>("filename");
+      if(not filename) {
+        std::cout <<"no file name give for ProductTimesWaiter"<<std::endl;
+        return {};
+      }
+
+      std::ifstream file(*filename, std::ios::binary);
+      if(not file.is_open()) {
+        std::cout <<"unable to open file "<<*filename<<" with product times";
+        return {};
+      }
+      std::vector<std::string> names;
+      std::vector<float> times;
+      char magic[sizeof(kBinaryMagic)];
+      bool isBinary = file.read(magic, sizeof(magic)) and 0 == std::memcmp(magic, kBinaryMagic, sizeof(magic));
+      if(not isBinary) {
+        file.clear();
+        file.seekg(0);
+      }
+      if(not (isBinary ? readBinary(file, names, times) : readCSV(file, names, times))) {
+        std::cout <<"unable to read product times from file "<<*filename<<std::endl;
+        return {};
+      }
+      if(names.empty() or times.empty()) {
+        std::cout <<"file "<<*filename<<" contained no product times"<<std::endl;
+        return {};
+      }
+      for(auto& t: times) {
+        t *= scale;
+      }
+
+      return std::make_unique<ProductTimesWaiter>(std::move(names), std::move(times), blocking);
+    }
+
+  };
+
+  Maker s_maker;
+}
@@ -10,10 +10,11 @@
 
 using namespace cce::tf;
 
-RNTupleAsyncOutputer::RNTupleAsyncOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const& iConfig):
+RNTupleAsyncOutputer::RNTupleAsyncOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const& iConfig, unsigned int iMaxPendingFlushes):
     fileName_(fileName),
     laneInfos_(iNLanes),
     config_(iConfig),
+    maxPendingFlushes_(iMaxPendingFlushes),
     collateTime_{std::chrono::microseconds::zero()},
     parallelTime_{0}
   { }
@@ -66,8 +67,22 @@ void RNTupleAsyncOutputer::setupForLane(unsigned int iLaneIndex, std::vector<Dat
   else if ( not ntuple_ ) {
     throw std::logic_error("setupForLane should be sequential");
   }
-  laneInfos_[iLaneIndex].retrievers = &iDPs;
-  laneInfos_[iLaneIndex].fillContext = ntuple_->CreateFillContext();
+  auto& laneInfo = laneInfos_[iLaneIndex];
+  laneInfo.retrievers = &iDPs;
+  laneInfo.fillContext = ntuple_->CreateFillContext();
+  //the lane changes fill context after each cluster and an entry from the writer can be used with any of them
+  laneInfo.entry = ntuple_->CreateEntry();
+  laneInfo.tokens.reserve(iDPs.size());
+  laneInfo.boundAddresses.reserve(iDPs.size());
+  for(size_t i=0; i < iDPs.size(); ++i) {
+    laneInfo.tokens.push_back(laneInfo.entry->GetToken(fieldIDs_[i]));
+    void* address = *iDPs[i].address();
+    laneInfo.entry->BindRawPtr(laneInfo.tokens.back(), address);
+    laneInfo.boundAddresses.push_back(address);
+  }
+  if(not hasEventAuxiliaryBranch_) {
+    laneInfo.entry->BindRawPtr(laneInfo.entry->GetToken("EventID"), &laneInfo.eventID);
+  }
 }
 
 void RNTupleAsyncOutputer::productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const& iDataProduct, TaskHolder iCallback) const {
@@ -77,16 +92,17 @@ void RNTupleAsyncOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier
   auto runningClock = startClock();
   auto start = std::chrono::high_resolution_clock::now();
 
-  auto context = fillProducts(iEventID, laneInfos_[iLaneIndex]);
+  auto flush = fillProducts(iEventID, laneInfos_[iLaneIndex]);
 
-  if(context) {
-    auto pTime = &flushClusterTime_;
-    queue_.push(*iCallback.group(), [context, pTime, callback=std::move(iCallback)]() mutable {
-       auto start = std::chrono::high_resolution_clock::now();
-       context->FlushCluster();
-       auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
-       *pTime += time.count();
-                                    });
+  if(flush.context_) {
+    auto group = iCallback.group();
+    if(flush.holdLane_) {
+      ++nHeldLanes_;
+      flushClusterAsync(*group, std::move(flush), std::move(iCallback));
+    } else {
+      //the lane already continues with a fresh context so it does not wait for the compression
+      flushClusterAsync(*group, std::move(flush), TaskHolder());
+    }
   }
   
   auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
@@ -122,6 +138,7 @@ void RNTupleAsyncOutputer::stopClock(decltype(std::chrono::high_resolution_clock
 void RNTupleAsyncOutputer::printSummary() const {
   auto start = std::chrono::high_resolution_clock::now();
   laneInfos_.clear();
+  freeFillContexts_.clear();
   ntuple_.reset();
   auto deleteTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
 
@@ -130,41 +147,88 @@ void RNTupleAsyncOutputer::printSummary() const {
   std::cout <<"RNTupleAsyncOutputer\n"
     "  total wallclock time at end event: "<<wallclockTime_.load()<<"us\n"
     "  total non-serializer parallel time at end event: "<<parallelTime_.load()<<"us\n"
+    "  number of times a field was rebound: "<<nRebinds_.load()<<"\n"
+    "  number of column flushes: "<<nColumnFlushes_.load()<<"\n"
+    "  unzipped bytes compressed: "<<compressedBytes_.load()<<"\n"
+    "  time in FlushColumns: "<<flushColumnsTime_.load()<<"us\n"
+    "  time waiting for FlushCluster queue: "<<queueWaitTime_<<"us\n"
     "  time in FlushCluster: "<<flushClusterTime_<<"us\n"
+    "  lanes held waiting for a free fill context: "<<nHeldLanes_.load()<<"\n"
     "  end of job RNTupleAsyncWriter shutdown time: "<<deleteTime.count()<<"us\n";
 }
 
-ROOT::Experimental::RNTupleFillContext* RNTupleAsyncOutputer::fillProducts(
+RNTupleAsyncOutputer::PendingFlush RNTupleAsyncOutputer::fillProducts(
     EventIdentifier const& iEventID,
-    RNTupleAsyncOutputer::LaneContainer const& entry ) const
+    RNTupleAsyncOutputer::LaneContainer & entry ) const
 {
   auto start = std::chrono::high_resolution_clock::now();
   auto thisOffset = eventGlobalOffset_++;
   if ( config_.verbose_ > 0 ) std::cout << thisOffset << " event id " << iEventID.run << ", "<< iEventID.lumi<<", "<<iEventID.event<<"\n";
 
-  auto rentry = entry.fillContext->CreateEntry();
-  auto temp = iEventID;
   for(size_t i=0; i < entry.retrievers->size(); ++i) {
-    void** ptr = (*entry.retrievers)[i].address();
-    rentry->BindRawPtr(fieldIDs_[i], *ptr);
-  }
-  if(not hasEventAuxiliaryBranch_) {
-    rentry->BindRawPtr("EventID", &temp);
+    void* address = *(*entry.retrievers)[i].address();
+    if(address != entry.boundAddresses[i]) {
+      entry.entry->BindRawPtr(entry.tokens[i], address);
+      entry.boundAddresses[i] = address;
+      ++nRebinds_;
+    }
   }
+  entry.eventID = iEventID;
   ROOT::RNTupleFillStatus status;
-  entry.fillContext->FillNoFlush(*rentry, status);
+  entry.fillContext->FillNoFlush(*entry.entry, status);
+  PendingFlush flush;
   if(status.ShouldFlushCluster()) {
-    //doesn't require calls to the TFile
-    entry.fillContext->FlushColumns();
-    collateTime_ += std::chrono::duration_cast<decltype(collateTime_)>(std::chrono::high_resolution_clock::now() - start);
-
-    return entry.fillContext.get();
-     //this need synchronization across all callers to the TFile
-     //fillContext.FlushCluster();
+    flush.bytes_ = status.GetUnzippedClusterSize();
+    if(auto fresh = freeFillContext()) {
+      flush.context_ = std::move(entry.fillContext);
+      entry.fillContext = std::move(fresh);
+    } else {
+      flush.context_ = entry.fillContext;
+      flush.holdLane_ = true;
+    }
   }
   
   collateTime_ += std::chrono::duration_cast<decltype(collateTime_)>(std::chrono::high_resolution_clock::now() - start);
-  return nullptr;
+  return flush;
+}
+
+std::shared_ptr<ROOT::Experimental::RNTupleFillContext> RNTupleAsyncOutputer::freeFillContext() const {
+  std::lock_guard guard(freeFillContextsMutex_);
+  if(not freeFillContexts_.empty()) {
+    auto context = std::move(freeFillContexts_.back());
+    freeFillContexts_.pop_back();
+    return context;
+  }
+  if(nSpareFillContexts_ < maxPendingFlushes_) {
+    ++nSpareFillContexts_;
+    return ntuple_->CreateFillContext();
+  }
+  return {};
+}
+
+void RNTupleAsyncOutputer::flushClusterAsync(tbb::task_group& iGroup, PendingFlush iFlush, TaskHolder iCallback) const {
+  iGroup.run([this, &iGroup, flush=std::move(iFlush), callback=std::move(iCallback)]() mutable {
+      //doesn't require calls to the TFile. With ROOT's implicit MT the pages of the columns are compressed as separate tasks
+      auto start = std::chrono::high_resolution_clock::now();
+      flush.context_->FlushColumns();
+      auto queued = std::chrono::high_resolution_clock::now();
+      flushColumnsTime_ += std::chrono::duration_cast<std::chrono::microseconds>(queued - start).count();
+      ++nColumnFlushes_;
+      compressedBytes_ += flush.bytes_;
+
+      //this need synchronization across all callers to the TFile
+      queue_.push(iGroup, [this, flush=std::move(flush), callback=std::move(callback), queued]() mutable {
+          auto start = std::chrono::high_resolution_clock::now();
+          queueWaitTime_ += std::chrono::duration_cast<std::chrono::microseconds>(start - queued).count();
+          flush.context_->FlushCluster();
+          flushClusterTime_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+          if(not flush.holdLane_) {
+            std::lock_guard guard(freeFillContextsMutex_);
+            freeFillContexts_.push_back(std::move(flush.context_));
+          }
+          //a held lane continues with its own context once callback is destroyed
+        });
+    });
 }
 
 
@@ -178,7 +242,8 @@ class Maker : public OutputerMakerBase {
       if(not result) {
         return {};
       }
-      return std::make_unique<RNTupleAsyncOutputer>(result->first, iNLanes, result->second);
+      auto maxPendingFlushes = params.get<unsigned int>("maxPendingFlushes", iNLanes);
+      return std::make_unique<RNTupleAsyncOutputer>(result->first, iNLanes, result->second, maxPendingFlushes);
     }
 };
 
@@ -8,6 +8,7 @@
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <utility>
 
 #include "OutputerBase.h"
 #include "EventIdentifier.h"
@@ -19,13 +20,16 @@
 #include <ROOT/RNTuple.hxx>
 #include <ROOT/RNTupleParallelWriter.hxx>
 #include <ROOT/RNTupleFillContext.hxx>
+#include <ROOT/REntry.hxx>
 
 namespace cce::tf {
 
 
 class RNTupleAsyncOutputer : public OutputerBase {
  public:
-  RNTupleAsyncOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const&);
+  //at most iMaxPendingFlushes full fill contexts wait to be flushed, after that the lane
+  // which fills a cluster is held until its own context has been flushed
+  RNTupleAsyncOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const&, unsigned int iMaxPendingFlushes);
 
   void setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs) final;
   bool usesProductReadyAsync() const final {return true;}
@@ -35,16 +39,37 @@ class RNTupleAsyncOutputer : public OutputerBase {
 
 private:
   struct LaneContainer {
-    // std::unique_ptr<ROOT::REntry> entry;
     std::vector<DataProductRetriever> const* retrievers;
     std::shared_ptr<ROOT::Experimental::RNTupleFillContext> fillContext;
+    //reused for every event of the lane. Declared after fillContext so it is deleted first
+    std::unique_ptr<ROOT::REntry> entry;
+    //found once in setupForLane, in the same order as retrievers
+    std::vector<ROOT::REntry::RFieldToken> tokens;
+    //addresses presently bound to entry, only rebound when a retriever's address changes
+    std::vector<void*> boundAddresses;
+    //bound to the EventID field when there is no EventAuxiliary
+    EventIdentifier eventID;
   };
 
+
   decltype(std::chrono::high_resolution_clock::now()) startClock() const;
   void stopClock(decltype(std::chrono::high_resolution_clock::now()) const&) const;
 
-  //returns non-nullptr if context must be flushed
-  ROOT::Experimental::RNTupleFillContext* fillProducts(EventIdentifier const& iEventID, LaneContainer const& entry) const;
+  struct PendingFlush {
+    std::shared_ptr<ROOT::Experimental::RNTupleFillContext> context_;
+    //unzipped bytes of the cluster
+    std::size_t bytes_ = 0;
+    //no free context was available so the lane keeps context_ and must wait for its flush
+    bool holdLane_ = false;
+  };
+  //returns a non-null context_ if that context must be flushed
+  PendingFlush fillProducts(EventIdentifier const& iEventID, LaneContainer& entry) const;
+
+  //returns nullptr once iMaxPendingFlushes contexts beyond those of the lanes exist and none is free
+  std::shared_ptr<ROOT::Experimental::RNTupleFillContext> freeFillContext() const;
+  //seals and compresses the pages of a full context then queues its FlushCluster. iCallback is
+  // only non-empty when the lane is held until the flush is done.
+  void flushClusterAsync(tbb::task_group&, PendingFlush, TaskHolder iCallback) const;
 
   // configuration options
   const std::string fileName_;
@@ -65,9 +90,20 @@ private:
   mutable std::chrono::microseconds collateTime_;
   bool hasEventAuxiliaryBranch_ = true;
 
+  mutable std::atomic<unsigned long long> nRebinds_ = 0;
   mutable std::atomic<std::chrono::microseconds::rep> parallelTime_ = 0;
   mutable std::atomic<std::chrono::microseconds::rep> wallclockTime_ = 0;
   mutable std::chrono::microseconds::rep flushClusterTime_ = 0;
+  mutable std::atomic<unsigned long long> nColumnFlushes_ = 0;
+  mutable std::atomic<unsigned long long> compressedBytes_ = 0;
+  mutable std::atomic<std::chrono::microseconds::rep> flushColumnsTime_ = 0;
+  mutable std::chrono::microseconds::rep queueWaitTime_ = 0;
+  //contexts whose cluster has been committed, ready to be given to a lane
+  mutable std::atomic<unsigned long long> nHeldLanes_ = 0;
+  const unsigned int maxPendingFlushes_;
+  mutable std::mutex freeFillContextsMutex_;
+  mutable std::vector<std::shared_ptr<ROOT::Experimental::RNTupleFillContext>> freeFillContexts_;
+  mutable unsigned int nSpareFillContexts_ = 0;
   mutable std::mutex wallclockMutex_;
   mutable decltype(std::chrono::high_resolution_clock::now()) wallclockStartTime_;
   mutable unsigned int nConcurrentCalls_=0;
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include "RNTupleParallelOutputer.h"
 #include "OutputerFactory.h"
 #include "FunctorTask.h"
@@ -7,12 +8,17 @@
 #include <ROOT/RNTupleModel.hxx>
 #include <ROOT/RField.hxx>
 #include <ROOT/RFieldVisitor.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+
+#include "TFile.h"
 
 using namespace cce::tf;
 
-RNTupleParallelOutputer::RNTupleParallelOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const& iConfig):
+RNTupleParallelOutputer::RNTupleParallelOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const& iConfig, unsigned long long iStageEvents):
     fileName_(fileName),
     laneInfos_(iNLanes),
+    stageEvents_(iStageEvents),
+    laneEventIndex_(iNLanes, 0),
     config_(iConfig),
     collateTime_{std::chrono::microseconds::zero()},
     parallelTime_{0}
@@ -66,18 +72,42 @@ void RNTupleParallelOutputer::setupForLane(unsigned int iLaneIndex, std::vector<
   else if ( not ntuple_ ) {
     throw std::logic_error("setupForLane should be sequential");
   }
-  laneInfos_[iLaneIndex].retrievers = &iDPs;
-  laneInfos_[iLaneIndex].fillContext = ntuple_->CreateFillContext();
+  auto& laneInfo = laneInfos_[iLaneIndex];
+  laneInfo.retrievers = &iDPs;
+  if(stageEvents_ == 0) {
+    laneInfo.fillContext = ntuple_->CreateFillContext();
+  }
+  //an entry from the writer can be used with any of its fill contexts
+  laneInfo.entry = ntuple_->CreateEntry();
+  laneInfo.tokens.reserve(iDPs.size());
+  laneInfo.boundAddresses.reserve(iDPs.size());
+  for(size_t i=0; i < iDPs.size(); ++i) {
+    laneInfo.tokens.push_back(laneInfo.entry->GetToken(fieldIDs_[i]));
+    void* address = *iDPs[i].address();
+    laneInfo.entry->BindRawPtr(laneInfo.tokens.back(), address);
+    laneInfo.boundAddresses.push_back(address);
+  }
+  if(not hasEventAuxiliaryBranch_) {
+    laneInfo.entry->BindRawPtr(laneInfo.entry->GetToken("EventID"), &laneInfo.eventID);
+  }
 }
 
 void RNTupleParallelOutputer::productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const& iDataProduct, TaskHolder iCallback) const {
 }
 
+void RNTupleParallelOutputer::setEventIndex(unsigned int iLaneIndex, long iEventIndex) const {
+  laneEventIndex_[iLaneIndex] = iEventIndex;
+}
+
 void RNTupleParallelOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const {
   auto runningClock = startClock();
   auto start = std::chrono::high_resolution_clock::now();
 
-  fillProducts(iEventID, laneInfos_[iLaneIndex]);
+  if(stageEvents_ != 0) {
+    outputStagedAsync(iLaneIndex, iEventID, std::move(iCallback));
+  } else {
+    fillProducts(iEventID, laneInfos_[iLaneIndex]);
+  }
 
   auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
   parallelTime_ += time.count();
@@ -111,8 +141,17 @@ void RNTupleParallelOutputer::stopClock(decltype(std::chrono::high_resolution_cl
 
 void RNTupleParallelOutputer::printSummary() const {
   auto start = std::chrono::high_resolution_clock::now();
+  //the last range is partial at the end of the job
+  while(not stagedRanges_.empty()) {
+    finishStagedRange(stagedRanges_.begin()->first);
+  }
+  freeStagingContexts_.clear();
+  stagingContexts_.clear();
   laneInfos_.clear();
   ntuple_.reset();
+  if(stageEvents_ != 0) {
+    writeClusterIndex();
+  }
   auto deleteTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
 
   start = std::chrono::high_resolution_clock::now();
@@ -120,31 +159,195 @@ void RNTupleParallelOutputer::printSummary() const {
   std::cout <<"RNTupleParallelOutputer\n"
     "  total wallclock time at end event: "<<wallclockTime_.load()<<"us\n"
     "  total non-serializer parallel time at end event: "<<parallelTime_.load()<<"us\n"
+    "  number of times a field was rebound: "<<nRebinds_.load()<<"\n"
     "  end of job RNTupleParallelWriter shutdown time: "<<deleteTime.count()<<"us\n";
+  if(stageEvents_ != 0) {
+    std::cout <<"  staged clusters written: "<<clusterIndex_.size()<<"\n";
+  }
 }
 
 void RNTupleParallelOutputer::fillProducts(
     EventIdentifier const& iEventID,
-    RNTupleParallelOutputer::LaneContainer const& entry ) const
+    RNTupleParallelOutputer::LaneContainer & entry ) const
 {
   auto start = std::chrono::high_resolution_clock::now();
   auto thisOffset = eventGlobalOffset_++;
   if ( config_.verbose_ > 0 ) std::cout << thisOffset << " event id " << iEventID.run << ", "<< iEventID.lumi<<", "<<iEventID.event<<"\n";
 
-  auto rentry = entry.fillContext->CreateEntry();
-  auto temp = iEventID;
+  bindProducts(iEventID, entry);
+  entry.fillContext->Fill(*entry.entry);
+
+  collateTime_ += std::chrono::duration_cast<decltype(collateTime_)>(std::chrono::high_resolution_clock::now() - start);
+}
+
+void RNTupleParallelOutputer::bindProducts(
+    EventIdentifier const& iEventID,
+    RNTupleParallelOutputer::LaneContainer & entry ) const
+{
   for(size_t i=0; i < entry.retrievers->size(); ++i) {
-    void** ptr = (*entry.retrievers)[i].address();
-    rentry->BindRawPtr(fieldIDs_[i], *ptr);
+    void* address = *(*entry.retrievers)[i].address();
+    if(address != entry.boundAddresses[i]) {
+      entry.entry->BindRawPtr(entry.tokens[i], address);
+      entry.boundAddresses[i] = address;
+      ++nRebinds_;
+    }
   }
-  if(not hasEventAuxiliaryBranch_) {
-    rentry->BindRawPtr("EventID", &temp);
+  entry.eventID = iEventID;
+}
+
+void RNTupleParallelOutputer::outputStagedAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const {
+  unsigned long long const eventIndex = laneEventIndex_[iLaneIndex];
+  auto const rangeIndex = eventIndex/stageEvents_;
+  auto range = stagedRange(rangeIndex);
+  auto const firstInRange = rangeIndex*stageEvents_;
+
+  bool rangeDone = false;
+  //the order buffer only decides the order. The fills run in the range's queue in that order
+  // once the buffer's lock has been released
+  range->order_.insert(eventIndex - firstInRange, StagedEvent{iLaneIndex, iEventID, std::move(iCallback)}, 0, TaskHolder(),
+                      [this, &range, &rangeDone, firstInRange](StagedEvent&& iEvent) {
+                        auto group = iEvent.callback_.group();
+                        range->context_->queue_.push(*group, [this, range, firstInRange, event = std::move(iEvent)]() {
+                            fillStaged(*range, event, firstInRange + range->nFilled_);
+                            if(++range->nFilled_ == stageEvents_) {
+                              finishRange(range);
+                            }
+                          });
+                        rangeDone = (++range->nReleased_ == stageEvents_);
+                      });
+  //only the call which passed on the last event of the range gets here with rangeDone set.
+  // The queued fills keep the range alive until they are done.
+  if(rangeDone) {
+    std::lock_guard<std::mutex> guard(stagingMutex_);
+    stagedRanges_.erase(rangeIndex);
   }
-  entry.fillContext->Fill(*rentry);
+}
 
+std::shared_ptr<RNTupleParallelOutputer::StagedRange> RNTupleParallelOutputer::stagedRange(unsigned long long iRange) const {
+  std::lock_guard<std::mutex> guard(stagingMutex_);
+  auto& range = stagedRanges_[iRange];
+  if(not range) {
+    range = std::make_shared<StagedRange>(iRange);
+    if(freeStagingContexts_.empty()) {
+      stagingContexts_.push_back(std::make_unique<StagingContext>());
+      stagingContexts_.back()->fillContext_ = ntuple_->CreateFillContext();
+      range->context_ = stagingContexts_.back().get();
+    } else {
+      range->context_ = freeStagingContexts_.back();
+      freeStagingContexts_.pop_back();
+    }
+  }
+  return range;
+}
+
+void RNTupleParallelOutputer::releaseStagingContext(StagedRange& iRange) const {
+  std::lock_guard<std::mutex> guard(stagingMutex_);
+  freeStagingContexts_.push_back(iRange.context_);
+  iRange.context_ = nullptr;
+}
+
+void RNTupleParallelOutputer::fillStaged(StagedRange& iRange, StagedEvent const& iEvent, unsigned long long iEventIndex) const {
+  auto start = std::chrono::high_resolution_clock::now();
+  auto thisOffset = eventGlobalOffset_++;
+  if ( config_.verbose_ > 0 ) std::cout << thisOffset << " event id " << iEvent.id_.run << ", "<< iEvent.id_.lumi<<", "<<iEvent.id_.event<<"\n";
+
+  //the lane which delivered the event is held until now so its products are still valid
+  auto& laneInfo = laneInfos_[iEvent.lane_];
+  bindProducts(iEvent.id_, laneInfo);
+  ROOT::RNTupleFillStatus status;
+  iRange.context_->fillContext_->FillNoFlush(*laneInfo.entry, status);
+
+  auto& cluster = iRange.cluster_;
+  if(cluster.nEntries_ == 0) {
+    cluster.firstEventIndex_ = iEventIndex;
+    cluster.firstID_ = iEvent.id_;
+  }
+  cluster.lastID_ = iEvent.id_;
+  ++cluster.nEntries_;
+
+  if(status.ShouldFlushCluster()) {
+    std::lock_guard<std::mutex> guard(flushMutex_);
+    //a range which is not the first unfinished one keeps growing its cluster until it is
+    if(iRange.index_ == nextRangeToFlush_) {
+      flushStaged(iRange);
+    }
+  }
   collateTime_ += std::chrono::duration_cast<decltype(collateTime_)>(std::chrono::high_resolution_clock::now() - start);
 }
 
+void RNTupleParallelOutputer::flushStaged(StagedRange& iRange) const {
+  //flushMutex_ must be held
+  if(iRange.cluster_.nEntries_ == 0) {
+    return;
+  }
+  iRange.context_->fillContext_->FlushCluster();
+  iRange.cluster_.firstEntry_ = nFlushedEntries_;
+  nFlushedEntries_ += iRange.cluster_.nEntries_;
+  clusterIndex_.push_back(iRange.cluster_);
+  iRange.cluster_ = {};
+}
+
+void RNTupleParallelOutputer::finishRange(std::shared_ptr<StagedRange> iRange) const {
+  std::lock_guard<std::mutex> guard(flushMutex_);
+  doneRanges_.emplace(iRange->index_, std::move(iRange));
+  //the queues of the done ranges are idle so their fill contexts can be flushed from here
+  auto it = doneRanges_.begin();
+  while(it != doneRanges_.end() and it->first == nextRangeToFlush_) {
+    flushStaged(*it->second);
+    releaseStagingContext(*it->second);
+    ++nextRangeToFlush_;
+    it = doneRanges_.erase(it);
+  }
+}
+
+void RNTupleParallelOutputer::finishStagedRange(unsigned long long iRange) const {
+  std::shared_ptr<StagedRange> range;
+  {
+    std::lock_guard<std::mutex> guard(stagingMutex_);
+    auto it = stagedRanges_.find(iRange);
+    range = std::move(it->second);
+    stagedRanges_.erase(it);
+  }
+  //only called at the end of the job once all the queued fills are done. Events held then
+  // have no earlier events still to come.
+  range->order_.flush([this, &range, iRange](StagedEvent&& iEvent) {
+      fillStaged(*range, iEvent, iRange*stageEvents_ + range->nFilled_);
+      ++range->nFilled_;
+    });
+  finishRange(std::move(range));
+}
+
+void RNTupleParallelOutputer::writeClusterIndex() const {
+  std::sort(clusterIndex_.begin(), clusterIndex_.end(), [](auto const& iLHS, auto const& iRHS) {
+      return iLHS.firstEntry_ < iRHS.firstEntry_;
+    });
+
+  auto model = ROOT::RNTupleModel::Create();
+  auto firstEntry = model->MakeField<unsigned long long>("firstEntry");
+  auto nEntries = model->MakeField<unsigned long long>("nEntries");
+  auto firstEventIndex = model->MakeField<unsigned long long>("firstEventIndex");
+  auto firstID = model->MakeField<EventIdentifier>("firstID");
+  auto lastID = model->MakeField<EventIdentifier>("lastID");
+
+  std::unique_ptr<TFile> file{TFile::Open(fileName_.c_str(), "UPDATE")};
+  if(not file or file->IsZombie()) {
+    std::cout <<"ERROR: unable to open "<<fileName_<<" to add the ClusterIndex"<<std::endl;
+    return;
+  }
+  {
+    auto writer = ROOT::RNTupleWriter::Append(std::move(model), "ClusterIndex", *file);
+    for(auto const& cluster: clusterIndex_) {
+      *firstEntry = cluster.firstEntry_;
+      *nEntries = cluster.nEntries_;
+      *firstEventIndex = cluster.firstEventIndex_;
+      *firstID = cluster.firstID_;
+      *lastID = cluster.lastID_;
+      writer->Fill();
+    }
+  }
+  file->Close();
+}
+
 
 namespace {
 class Maker : public OutputerMakerBase {
@@ -156,7 +359,8 @@ class Maker : public OutputerMakerBase {
       if(not result) {
         return {};
       }
-      return std::make_unique<RNTupleParallelOutputer>(result->first, iNLanes, result->second);
+      auto stageEvents = params.get<std::size_t>("stageEvents", 0);
+      return std::make_unique<RNTupleParallelOutputer>(result->first, iNLanes, result->second, stageEvents);
     }
 };
 
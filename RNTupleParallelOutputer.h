@@ -8,6 +8,7 @@
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <map>
 
 #include "OutputerBase.h"
 #include "EventIdentifier.h"
@@ -16,34 +17,91 @@
 #include "summarize_serializers.h"
 #include "SerialTaskQueue.h"
 #include "RNTupleOutputerConfig.h"
+#include "EventOrderBuffer.h"
 #include <ROOT/RNTuple.hxx>
 #include <ROOT/RNTupleParallelWriter.hxx>
 #include <ROOT/RNTupleFillContext.hxx>
+#include <ROOT/REntry.hxx>
 
 namespace cce::tf {
 
 
 class RNTupleParallelOutputer : public OutputerBase {
  public:
-  RNTupleParallelOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const&);
+  //a non zero iStageEvents fills the events in consecutive ranges of that many events, in the
+  // order given by the source, into one fill context per range so each cluster holds a contiguous range
+  RNTupleParallelOutputer(std::string const& fileName, unsigned int iNLanes, RNTupleOutputerConfig const&, unsigned long long iStageEvents);
 
   void setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs) final;
   bool usesProductReadyAsync() const final {return true;}
   void productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const& iDataProduct, TaskHolder iCallback) const final;
+  void setEventIndex(unsigned int iLaneIndex, long iEventIndex) const final;
   void outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const final;
   void printSummary() const final;
 
 private:
   struct LaneContainer {
-    // std::unique_ptr<ROOT::Experimental::REntry> entry;
     std::vector<DataProductRetriever> const* retrievers;
     std::shared_ptr<ROOT::Experimental::RNTupleFillContext> fillContext;
+    //reused for every event of the lane. Declared after fillContext so it is deleted first
+    std::unique_ptr<ROOT::REntry> entry;
+    //found once in setupForLane, in the same order as retrievers
+    std::vector<ROOT::REntry::RFieldToken> tokens;
+    //addresses presently bound to entry, only rebound when a retriever's address changes
+    std::vector<void*> boundAddresses;
+    //bound to the EventID field when there is no EventAuxiliary
+    EventIdentifier eventID;
   };
 
+
   decltype(std::chrono::high_resolution_clock::now()) startClock() const;
   void stopClock(decltype(std::chrono::high_resolution_clock::now()) const&) const;
  
-  void fillProducts(EventIdentifier const& iEventID, LaneContainer const& entry) const;
+  void fillProducts(EventIdentifier const& iEventID, LaneContainer& entry) const;
+  void bindProducts(EventIdentifier const& iEventID, LaneContainer& entry) const;
+
+  struct StagedEvent {
+    unsigned int lane_;
+    EventIdentifier id_;
+    //holds the lane which delivered the event until it has been filled so its products stay valid
+    TaskHolder callback_;
+  };
+  //entries of one cluster written while staging, used by readers to skip clusters
+  struct ClusterRange {
+    unsigned long long firstEntry_;
+    unsigned long long nEntries_;
+    unsigned long long firstEventIndex_;
+    EventIdentifier firstID_;
+    EventIdentifier lastID_;
+  };
+  //reused by the ranges one after the other
+  struct StagingContext {
+    std::shared_ptr<ROOT::Experimental::RNTupleFillContext> fillContext_;
+    //the fills of a range are serialized while different ranges fill concurrently
+    SerialTaskQueue queue_;
+  };
+  struct StagedRange {
+    //only decides the order, the events are filled in tasks pushed to the context's queue
+    explicit StagedRange(unsigned long long iIndex): order_(0,0), index_{iIndex} {}
+    EventOrderBuffer<StagedEvent> order_;
+    const unsigned long long index_;
+    StagingContext* context_ = nullptr;
+    //only changed while order_ is passing on an event
+    unsigned long long nReleased_ = 0;
+    //only changed in the context's queue
+    unsigned long long nFilled_ = 0;
+    //events filled since the last cluster was flushed
+    ClusterRange cluster_ = {};
+  };
+
+  void outputStagedAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const;
+  std::shared_ptr<StagedRange> stagedRange(unsigned long long iRange) const;
+  void fillStaged(StagedRange&, StagedEvent const&, unsigned long long iEventIndex) const;
+  void flushStaged(StagedRange&) const;
+  void releaseStagingContext(StagedRange&) const;
+  void finishRange(std::shared_ptr<StagedRange>) const;
+  void finishStagedRange(unsigned long long iRange) const;
+  void writeClusterIndex() const;
 
   // configuration options
   const std::string fileName_;
@@ -57,11 +115,27 @@ private:
   
   mutable std::vector<LaneContainer> laneInfos_;
 
+  //only used when staging
+  const unsigned long long stageEvents_;
+  mutable std::vector<long> laneEventIndex_;
+  mutable std::mutex stagingMutex_;
+  mutable std::map<unsigned long long, std::shared_ptr<StagedRange>> stagedRanges_;
+  mutable std::vector<std::unique_ptr<StagingContext>> stagingContexts_;
+  mutable std::vector<StagingContext*> freeStagingContexts_;
+  //flushes while staging are serialized so the entry numbers of each cluster are known.
+  // Clusters are written in range order so ranges filled early wait here for the earlier ones.
+  mutable std::mutex flushMutex_;
+  mutable unsigned long long nFlushedEntries_ = 0;
+  mutable unsigned long long nextRangeToFlush_ = 0;
+  mutable std::map<unsigned long long, std::shared_ptr<StagedRange>> doneRanges_;
+  mutable std::vector<ClusterRange> clusterIndex_;
+
   // only modified in collateProducts()
   mutable std::atomic<size_t> eventGlobalOffset_{0};
   mutable std::chrono::microseconds collateTime_;
   bool hasEventAuxiliaryBranch_ = true;
 
+  mutable std::atomic<unsigned long long> nRebinds_ = 0;
   mutable std::atomic<std::chrono::microseconds::rep> parallelTime_ = 0;
   mutable std::atomic<std::chrono::microseconds::rep> wallclockTime_ = 0;
   mutable std::mutex wallclockMutex_;
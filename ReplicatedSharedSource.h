@@ -2,6 +2,9 @@
 #define ReplicatedSharedSource_h
 
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 #include <iostream>
 #include "SharedSourceBase.h"
 
@@ -40,6 +43,9 @@ namespace cce::tf {
       return totalTime;
     }
 
+  protected:
+    std::vector<S> const& sources() const { return sources_; }
+
   private:
     void readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder iTask) final {
       if(sources_[iLane].gotoEvent(iEventIndex)) {
@@ -48,6 +54,97 @@ namespace cce::tf {
     }
     std::vector<S> sources_;
   };
+
+  /*
+   Lies between ReplicatedSharedSource and a single shared source. iNReplicas instances of the
+   shared source S are made, each serving a contiguous group of lanes with its own serialization.
+   Each instance reads its own contiguous range of entries so the replicas read disjoint parts of
+   the file. Once a range is used up, lanes of that group take entries from the other ranges.
+   S must be constructible from (nLanes, nEvents, iArgs...), provide numberOfEntries()
+   and read the entry given as the event index.
+   */
+  template<typename S>
+    class GroupReplicatedSharedSource : public SharedSourceBase {
+  public:
+    template<typename... Args>
+      GroupReplicatedSharedSource(unsigned iNLanes, unsigned long long iNEvents, unsigned int iNReplicas, Args&&... iArgs):
+    SharedSourceBase(iNEvents),
+    laneGroups_(iNLanes),
+    laneEntries_(iNLanes, 0) {
+      iNReplicas = std::clamp(iNReplicas, 1U, iNLanes);
+      sources_.reserve(iNReplicas);
+      ranges_ = std::make_unique<Range[]>(iNReplicas);
+      for(unsigned int group=0; group < iNReplicas; ++group) {
+        auto firstLane = group*iNLanes/iNReplicas;
+        auto endLane = (group+1)*iNLanes/iNReplicas;
+        for(auto lane = firstLane; lane < endLane; ++lane) {
+          laneGroups_[lane] = {group, lane-firstLane};
+        }
+        sources_.push_back(std::make_unique<S>(endLane-firstLane, iNEvents, iArgs...));
+      }
+      nEntries_ = std::min<unsigned long long>(iNEvents, sources_[0]->numberOfEntries());
+      for(unsigned int group=0; group < iNReplicas; ++group) {
+        ranges_[group].next_ = group*nEntries_/iNReplicas;
+        ranges_[group].end_ = (group+1)*nEntries_/iNReplicas;
+      }
+    }
+
+    size_t numberOfDataProducts() const final {return sources_[0]->numberOfDataProducts();}
+
+    std::vector<DataProductRetriever>& dataProducts(unsigned int iLane, long iEventIndex) final {
+      auto [group, lane] = laneGroups_[iLane];
+      return sources_[group]->dataProducts(lane, laneEntries_[iLane]);
+    }
+    EventIdentifier eventIdentifier(unsigned int iLane, long iEventIndex) final {
+      auto [group, lane] = laneGroups_[iLane];
+      return sources_[group]->eventIdentifier(lane, laneEntries_[iLane]);
+    }
+
+    void printSummary() const final {
+      std::cout <<"\nSource replicas: "<<sources_.size()<<", entries read from another replica's range: "<<nTakenEntries_.load()<<"\n";
+      for(auto const& source: sources_) {
+        source->printSummary();
+      }
+    }
+
+  private:
+    struct Range {
+      std::atomic<unsigned long long> next_{0};
+      unsigned long long end_ = 0;
+    };
+    struct LaneGroup {
+      unsigned int group_;
+      unsigned int laneInGroup_;
+    };
+
+    void readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder iTask) final {
+      //one entry is claimed per index below nEntries_ so the claim always succeeds
+      if(static_cast<unsigned long long>(iEventIndex) >= nEntries_) {
+        return;
+      }
+      auto [group, lane] = laneGroups_[iLane];
+      auto const nGroups = sources_.size();
+      for(size_t i=0; i < nGroups; ++i) {
+        auto& range = ranges_[(group+i) % nGroups];
+        auto entry = range.next_++;
+        if(entry < range.end_) {
+          if(i != 0) {
+            ++nTakenEntries_;
+          }
+          laneEntries_[iLane] = entry;
+          sources_[group]->gotoEventAsync(lane, entry, std::move(iTask));
+          return;
+        }
+      }
+    }
+
+    std::vector<std::unique_ptr<S>> sources_;
+    std::unique_ptr<Range[]> ranges_;
+    std::vector<LaneGroup> laneGroups_;
+    std::vector<long> laneEntries_;
+    unsigned long long nEntries_ = 0;
+    std::atomic<unsigned long long> nTakenEntries_{0};
+  };
 }
 
 #endif
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <cstring>
 #include <set>
+#include <limits>
 
 using namespace cce::tf;
 using namespace cce::tf::pds;
@@ -17,19 +18,26 @@ using namespace cce::tf::pds;
 RootBatchEventsOutputer::RootBatchEventsOutputer(std::string const& iFileName, unsigned int iNLanes, Compression iCompression, int iCompressionLevel, 
                                                  Serialization iSerialization, int autoFlush, int maxVirtualSize,
                                                  std::string const& iTFileCompression, int iTFileCompressionLevel,
-                                                 uint32_t iBatchSize): 
+                                                 uint32_t iBatchSize, std::size_t iBatchBytes, bool iEventOrder, std::size_t iOrderMaxEvents, std::size_t iOrderMaxBytes): 
   file_(iFileName.c_str(), "recreate", "", iTFileCompressionLevel),
   serializers_{iNLanes},
   eventBatches_{iNLanes},
   waitingEventsInBatch_(iNLanes),
   presentEventEntry_(0),
   batchSize_(iBatchSize),
+  batchBytes_(iBatchBytes),
   compression_{iCompression},
   compressionLevel_{iCompressionLevel},
   serialization_{iSerialization},
   serialTime_{std::chrono::microseconds::zero()},
-  parallelTime_{0}
+  parallelTime_{0},
+  laneEventIndex_(iNLanes, 0)
   {
+    if(iEventOrder) {
+      eventOrder_ = std::make_unique<EventOrderBuffer<EventInfo>>(iOrderMaxEvents, iOrderMaxBytes);
+      //at most one batch per lane can wait so there is no need to stall
+      batchOrder_ = std::make_unique<EventOrderBuffer<Batch>>(std::numeric_limits<std::size_t>::max(), std::numeric_limits<std::size_t>::max());
+    }
     for(auto& v: waitingEventsInBatch_) {
       v.store(0);
     }
@@ -99,10 +107,28 @@ void RootBatchEventsOutputer::productReadyAsync(unsigned int iLaneIndex, DataPro
   laneSerializers[iDataProduct.index()].doWorkAsync(*group, iDataProduct.address(), std::move(iCallback));
 }
 
+void RootBatchEventsOutputer::setEventIndex(unsigned int iLaneIndex, long iEventIndex) const {
+  laneEventIndex_[iLaneIndex] = iEventIndex;
+}
+
 void RootBatchEventsOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const {
   auto start = std::chrono::high_resolution_clock::now();
   auto [offsets, buffer] = writeDataProductsToOutputBuffer(serializers_[iLaneIndex]);
 
+  if(eventOrder_) {
+    const_cast<RootBatchEventsOutputer*>(this)->outputInOrderAsync(laneEventIndex_[iLaneIndex], EventInfo(iEventID, std::move(offsets), std::move(buffer)), std::move(iCallback));
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    parallelTime_ += time.count();
+    return;
+  }
+
+  if(batchBytes_ != 0) {
+    const_cast<RootBatchEventsOutputer*>(this)->outputSizedBatchAsync(EventInfo(iEventID, std::move(offsets), std::move(buffer)), std::move(iCallback));
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    parallelTime_ += time.count();
+    return;
+  }
+
   auto eventIndex = presentEventEntry_++;
 
   auto batchIndex = (eventIndex/batchSize_) % eventBatches_.size();
@@ -146,6 +172,11 @@ void RootBatchEventsOutputer::printSummary() const  {
     
     {
       TaskHolder th(group, make_functor_task([](){}));
+      if(eventOrder_) {
+        const_cast<RootBatchEventsOutputer*>(this)->finishInOrder(th);
+      } else if(batchBytes_ != 0) {
+        const_cast<RootBatchEventsOutputer*>(this)->finishSizedBatch(th);
+      }
       for( int index=0; index < waitingEventsInBatch_.size();++index) {
         if(0 != waitingEventsInBatch_[index].load()) {
           const_cast<RootBatchEventsOutputer*>(this)->finishBatchAsync(index, th);
@@ -169,6 +200,10 @@ void RootBatchEventsOutputer::printSummary() const  {
 
   std::cout << "  end of job file write time: "<<writeTime.count()<<"us\n";
   std::cout << "  end of job file close time: "<<closeTime.count()<<"us\n";
+  if(eventOrder_) {
+    std::cout << "  event order: max held events "<<eventOrder_->maxHeldEvents()<<", max held bytes "<<eventOrder_->maxHeldBytes()<<"\n"
+      "   lanes stalled "<<eventOrder_->nStalls()<<" times for "<<eventOrder_->stallTime().count()<<"us\n";
+  }
                                                                                          
   summarize_serializers(serializers_);
 }
@@ -179,43 +214,135 @@ void RootBatchEventsOutputer::finishBatchAsync(unsigned int iBatchIndex, TaskHol
   auto eventsInBatch = waitingEventsInBatch_[iBatchIndex].load();
   waitingEventsInBatch_[iBatchIndex] = 0;
 
+  writeBatchAsync(combineBatch(*batch, eventsInBatch), std::move(iCallback));
+}
+
+RootBatchEventsOutputer::Batch RootBatchEventsOutputer::combineBatch(std::vector<EventInfo>& iEvents, uint32_t iNEvents) const {
+  //batch can be smaller than usual. Can happen at end of job
+  auto const nEvents = std::min<std::size_t>(iNEvents, iEvents.size());
+
+  //size the buffers exactly so they are never reallocated while appending
+  std::size_t nOffsets = 0;
+  std::size_t nBytes = 0;
+  for(std::size_t index = 0; index < nEvents; ++index) {
+    nOffsets += std::get<1>(iEvents[index]).size();
+    nBytes += std::get<2>(iEvents[index]).size();
+  }
+
   std::vector<EventIdentifier> batchEventIDs;
-  batchEventIDs.reserve(batch->size());
+  batchEventIDs.reserve(nEvents);
 
   std::vector<uint32_t> batchOffsets;
-  batchOffsets.reserve(batch->size() * (serializers_.size()+1));
+  batchOffsets.reserve(nOffsets);
 
   std::vector<char> batchBlob;
+  batchBlob.reserve(nBytes);
 
-  int index = 0;
-  for(auto& event: *batch) {
-    if(index++ == eventsInBatch) {
-      //batch was smaller than usual. Can happen at end of job
-      break;
-    }
+  for(std::size_t index = 0; index < nEvents; ++index) {
+    auto& event = iEvents[index];
     batchEventIDs.push_back(std::get<0>(event));
 
     auto& offsets = std::get<1>(event);
-    std::copy(offsets.begin(), offsets.end(), std::back_inserter(batchOffsets));
+    batchOffsets.insert(batchOffsets.end(), offsets.begin(), offsets.end());
 
     auto& blob = std::get<2>(event);
-    std::copy(blob.begin(), blob.end(), std::back_inserter(batchBlob));
+    batchBlob.insert(batchBlob.end(), blob.begin(), blob.end());
 
     //release memory
     blob = std::vector<char>();
   }
 
   auto compressedBlob = compressBuffer(batchBlob);
-  batchBlob = std::vector<char>();
 
-  
+  return {std::move(batchEventIDs), std::move(batchOffsets), std::move(compressedBlob)};
+}
+
+void RootBatchEventsOutputer::writeBatchAsync(Batch iBatch, TaskHolder iCallback) {
+  auto& [batchEventIDs, batchOffsets, compressedBlob] = iBatch;
   queue_.push(*iCallback.group(), [this, eventIDs=std::move(batchEventIDs), offsets = std::move(batchOffsets), buffer = std::move(compressedBlob),  callback=std::move(iCallback)]() mutable {
       auto start = std::chrono::high_resolution_clock::now();
       const_cast<RootBatchEventsOutputer*>(this)->output(std::move(eventIDs), std::move(buffer), std::move(offsets));
         serialTime_ += std::chrono::duration_cast<decltype(serialTime_)>(std::chrono::high_resolution_clock::now() - start);
       callback.doneWaiting();
     });
-  
+}
+
+bool RootBatchEventsOutputer::batchIsFull(std::size_t iNEvents, std::size_t iBytes) const {
+  if(batchBytes_ != 0) {
+    return iBytes >= batchBytes_;
+  }
+  return iNEvents == batchSize_;
+}
+
+void RootBatchEventsOutputer::outputSizedBatchAsync(EventInfo iEvent, TaskHolder iCallback) {
+  std::vector<EventInfo> fullBatch;
+  {
+    std::lock_guard<std::mutex> guard(sizedBatchMutex_);
+    sizedBatchBytes_ += std::get<2>(iEvent).size();
+    sizedBatch_.push_back(std::move(iEvent));
+    if(batchIsFull(sizedBatch_.size(), sizedBatchBytes_)) {
+      std::swap(fullBatch, sizedBatch_);
+      sizedBatchBytes_ = 0;
+    }
+  }
+  //combining is done outside the lock so other lanes can keep adding events
+  if(not fullBatch.empty()) {
+    writeBatchAsync(combineBatch(fullBatch, fullBatch.size()), std::move(iCallback));
+  }
+}
+
+void RootBatchEventsOutputer::finishSizedBatch(TaskHolder iCallback) {
+  if(not sizedBatch_.empty()) {
+    writeBatchAsync(combineBatch(sizedBatch_, sizedBatch_.size()), std::move(iCallback));
+    sizedBatch_.clear();
+    sizedBatchBytes_ = 0;
+  }
+}
+
+void RootBatchEventsOutputer::outputInOrderAsync(long iEventIndex, EventInfo iEvent, TaskHolder iCallback) {
+  auto const bytes = std::get<2>(iEvent).size();
+  std::vector<std::pair<unsigned long long, std::vector<EventInfo>>> fullBatches;
+  eventOrder_->insert(iEventIndex, std::move(iEvent), bytes, iCallback, [this, &fullBatches](EventInfo&& iReady) {
+      addOrderedEvent(std::move(iReady), fullBatches);
+    });
+  //batches are combined concurrently but must also be written in order
+  for(auto& [batchNumber, events]: fullBatches) {
+    auto batch = combineBatch(events, events.size());
+    auto const batchBytes = std::get<2>(batch).size();
+    batchOrder_->insert(batchNumber, std::move(batch), batchBytes, iCallback, [this, &iCallback](Batch&& iReady) {
+        writeBatchAsync(std::move(iReady), iCallback);
+      });
+  }
+}
+
+void RootBatchEventsOutputer::addOrderedEvent(EventInfo&& iEvent, std::vector<std::pair<unsigned long long, std::vector<EventInfo>>>& oFullBatches) {
+  orderedBytes_ += std::get<2>(iEvent).size();
+  orderedEvents_.push_back(std::move(iEvent));
+  if(batchIsFull(orderedEvents_.size(), orderedBytes_)) {
+    oFullBatches.emplace_back(nOrderedBatches_++, std::move(orderedEvents_));
+    orderedEvents_ = std::vector<EventInfo>();
+    orderedBytes_ = 0;
+  }
+}
+
+void RootBatchEventsOutputer::finishInOrder(TaskHolder iCallback) {
+  std::vector<std::pair<unsigned long long, std::vector<EventInfo>>> fullBatches;
+  eventOrder_->flush([this, &fullBatches](EventInfo&& iReady) {
+      addOrderedEvent(std::move(iReady), fullBatches);
+    });
+  if(not orderedEvents_.empty()) {
+    fullBatches.emplace_back(nOrderedBatches_++, std::move(orderedEvents_));
+    orderedEvents_ = std::vector<EventInfo>();
+  }
+  auto write = [this, &iCallback](Batch&& iReady) {
+    writeBatchAsync(std::move(iReady), iCallback);
+  };
+  for(auto& [batchNumber, events]: fullBatches) {
+    auto batch = combineBatch(events, events.size());
+    auto const batchBytes = std::get<2>(batch).size();
+    batchOrder_->insert(batchNumber, std::move(batch), batchBytes, iCallback, write);
+  }
+  batchOrder_->flush(write);
 }
 
 void RootBatchEventsOutputer::output(std::vector<EventIdentifier> iEventIDs, std::vector<char>  iBuffer, std::vector<uint32_t> iOffsets) {
@@ -321,8 +448,13 @@ namespace {
       auto fileLevelCompressionLevel = params.get<int>("tfileCompressionLevel",0);
 
       auto batchSize = params.get<int>("batchSize",1);
+      auto batchBytes = params.get<std::size_t>("batchBytes",0);
+
+      auto eventOrder = params.get<bool>("eventOrder", false);
+      auto orderMaxEvents = params.get<std::size_t>("orderMaxEvents", 64);
+      auto orderMaxBytes = params.get<std::size_t>("orderMaxBytes", 104857600);
       
-      return std::make_unique<RootBatchEventsOutputer>(*fileName,iNLanes, *compression, compressionLevel, *serialization, autoFlush, treeMaxVirtualSize, fileLevelCompression, fileLevelCompressionLevel, batchSize);
+      return std::make_unique<RootBatchEventsOutputer>(*fileName,iNLanes, *compression, compressionLevel, *serialization, autoFlush, treeMaxVirtualSize, fileLevelCompression, fileLevelCompressionLevel, batchSize, batchBytes, eventOrder, orderMaxEvents, orderMaxBytes);
     }
     
   };
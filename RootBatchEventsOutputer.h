@@ -2,10 +2,12 @@
 #define RootBatchEventsOutputer_h
 
 #include <vector>
+#include <mutex>
 #include <string>
 #include <cstdint>
 #include <tuple>
 #include <atomic>
+#include <memory>
 #include "TFile.h"
 #include "TTree.h"
 #include "TBranch.h"
@@ -17,6 +19,7 @@
 #include "pds_writer.h"
 
 #include "SerialTaskQueue.h"
+#include "EventOrderBuffer.h"
 
 namespace cce::tf {
 class RootBatchEventsOutputer :public OutputerBase {
@@ -24,7 +27,7 @@ class RootBatchEventsOutputer :public OutputerBase {
   RootBatchEventsOutputer(std::string const& iFileName, unsigned int iNLanes, pds::Compression iCompression, int iCompressionLevel, 
                           pds::Serialization iSerialization, int autoFlush, int maxVirtualSize,
                           std::string const& iTFileCompression, int iTFileCompressionLevel,
-                          uint32_t iBatchSize);
+                          uint32_t iBatchSize, std::size_t iBatchBytes, bool iEventOrder, std::size_t iOrderMaxEvents, std::size_t iOrderMaxBytes);
  ~RootBatchEventsOutputer();
 
   void setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs) final;
@@ -32,12 +35,29 @@ class RootBatchEventsOutputer :public OutputerBase {
   void productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const& iDataProduct, TaskHolder iCallback) const final;
   bool usesProductReadyAsync() const final {return true;}
 
+  void setEventIndex(unsigned int iLaneIndex, long iEventIndex) const final;
+
   void outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const final;
   
   void printSummary() const final;
 
  private:
+  using EventInfo = std::tuple<EventIdentifier, std::vector<uint32_t>, std::vector<char>>;
+  //event identifiers, offsets and blob of all events in a batch
+  using Batch = std::tuple<std::vector<EventIdentifier>, std::vector<uint32_t>, std::vector<char>>;
+
   void finishBatchAsync(unsigned int iBatchIndex, TaskHolder iCallback);
+  Batch combineBatch(std::vector<EventInfo>& iEvents, uint32_t iNEvents) const;
+  void writeBatchAsync(Batch iBatch, TaskHolder iCallback);
+
+  //when using batchBytes_ a batch is closed once its events reach that many bytes
+  bool batchIsFull(std::size_t iNEvents, std::size_t iBytes) const;
+  void outputSizedBatchAsync(EventInfo iEvent, TaskHolder iCallback);
+  void finishSizedBatch(TaskHolder iCallback);
+
+  void outputInOrderAsync(long iEventIndex, EventInfo iEvent, TaskHolder iCallback);
+  void addOrderedEvent(EventInfo&& iEvent, std::vector<std::pair<unsigned long long, std::vector<EventInfo>>>& oFullBatches);
+  void finishInOrder(TaskHolder iCallback);
 
   void output(std::vector<EventIdentifier> iEventIDs, std::vector<char>  iBuffer, std::vector<uint32_t> iOffset);
   void writeMetaData(SerializeStrategy const& iSerializers);
@@ -59,18 +79,31 @@ private:
   mutable std::vector<EventIdentifier> eventIDs_;
 
   //This is used as a circular buffer of length nLanes but only entries being used exist
-  using EventInfo = std::tuple<EventIdentifier, std::vector<uint32_t>, std::vector<char>>;
   mutable std::vector<std::atomic<std::vector<EventInfo>*>> eventBatches_;
   mutable std::vector<std::atomic<uint32_t>> waitingEventsInBatch_;
 
   mutable std::atomic<uint64_t> presentEventEntry_;
 
   uint32_t batchSize_;
+  std::size_t batchBytes_;
+  //only used with batchBytes_
+  std::mutex sizedBatchMutex_;
+  std::vector<EventInfo> sizedBatch_;
+  std::size_t sizedBatchBytes_ = 0;
   pds::Compression compression_;
   int compressionLevel_;
   pds::Serialization serialization_;
   mutable std::chrono::microseconds serialTime_;
   mutable std::atomic<std::chrono::microseconds::rep> parallelTime_;
+
+  //only used when writing the events in the order given by the source
+  mutable std::vector<long> laneEventIndex_;
+  std::unique_ptr<EventOrderBuffer<EventInfo>> eventOrder_;
+  std::unique_ptr<EventOrderBuffer<Batch>> batchOrder_;
+  //events passed on by eventOrder_ which do not yet fill a batch
+  std::vector<EventInfo> orderedEvents_;
+  std::size_t orderedBytes_ = 0;
+  unsigned long long nOrderedBatches_ = 0;
 };
 }
 #endif
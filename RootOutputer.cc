@@ -8,6 +8,7 @@
 #include "TBranch.h"
 #include "TROOT.h"
 #include "TFileCacheWrite.h"
+#include "TMemFile.h"
 
 #include "tbb/task_arena.h"
 
@@ -19,7 +20,11 @@ RootOutputer::RootOutputer(std::string const& iFileName, unsigned int iNLanes, C
   retrievers_{std::size_t(iNLanes)},
   accumulatedTime_(std::chrono::microseconds::zero()),
   basketSize_{iConfig.basketSize_},
-  splitLevel_{iConfig.splitLevel_}
+  splitLevel_{iConfig.splitLevel_},
+  laneTrees_{iConfig.laneTrees_},
+  laneFlushBytes_{iConfig.laneFlushBytes_},
+  lanes_{std::size_t(iConfig.laneTrees_ ? iNLanes : 0)},
+  parallelTime_{0}
 {
   if(iConfig.cacheSize_ > 0 ) { 
      new TFileCacheWrite(&file_, iConfig.cacheSize_);
@@ -56,19 +61,42 @@ RootOutputer::~RootOutputer() {
 void RootOutputer::setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs) {
   const std::string eventAuxiliaryBranchName{"EventAuxiliary"}; 
   retrievers_[iLaneIndex] = &iDPs;
+  bool hasEventAuxiliaryBranch = false;
+  for(auto& dp : iDPs) {
+    if(dp.name() == eventAuxiliaryBranchName) {
+      hasEventAuxiliaryBranch = true;
+    }
+  }
   if(iLaneIndex == 0) {
-    bool hasEventAuxiliaryBranch = false;
     branches_.reserve(iDPs.size());
     for(auto& dp : iDPs) {
       branches_.push_back( eventTree_->Branch(dp.name().c_str(), dp.classType()->GetName(), dp.address(), basketSize_, splitLevel_) );
-      if(dp.name() == eventAuxiliaryBranchName) {
-        hasEventAuxiliaryBranch = true;
-      }
     }
     if(not hasEventAuxiliaryBranch) {
       eventIDBranch_ = eventTree_->Branch("EventID", &id_, "run/i:lumi/i:event/l");
     }
   }
+  if(laneTrees_) {
+    setupLaneTree(iLaneIndex, iDPs, hasEventAuxiliaryBranch);
+  }
+}
+
+void RootOutputer::setupLaneTree(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs, bool iHasEventAuxiliaryBranch) {
+  auto& lane = lanes_[iLaneIndex];
+  //baskets written to the TMemFile are compressed using the same settings as the output file
+  std::string const name = "RootOutputerLane"+std::to_string(iLaneIndex)+".root";
+  lane.file_ = std::make_unique<TMemFile>(name.c_str(), "recreate", "", file_.GetCompressionSettings());
+  lane.eventTree_ = new TTree("Events", "", splitLevel_, lane.file_.get());
+  lane.eventTree_->SetAutoSave(std::numeric_limits<Long64_t>::max());
+  //only write a cluster when the lane is merged
+  lane.eventTree_->SetAutoFlush(0);
+  lane.branches_.reserve(iDPs.size());
+  for(auto& dp : iDPs) {
+    lane.branches_.push_back( lane.eventTree_->Branch(dp.name().c_str(), dp.classType()->GetName(), dp.address(), basketSize_, splitLevel_) );
+  }
+  if(not iHasEventAuxiliaryBranch) {
+    lane.eventTree_->Branch("EventID", &lane.id_, "run/i:lumi/i:event/l");
+  }
 }
 
 void RootOutputer::productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const& iDataProduct, TaskHolder iCallback) const {
@@ -76,6 +104,12 @@ void RootOutputer::productReadyAsync(unsigned int iLaneIndex, DataProductRetriev
 
 void RootOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) const {
   auto group = iCallback.group();
+  if(laneTrees_) {
+    group->run([this, iLaneIndex, callback=std::move(iCallback), iEventID]() {
+        const_cast<RootOutputer*>(this)->fillLane(iLaneIndex, iEventID, std::move(callback));
+      });
+    return;
+  }
   queue_.push(*group, [this, iLaneIndex, callback=std::move(iCallback), iEventID]() mutable {
       const_cast<RootOutputer*>(this)->write(iLaneIndex, iEventID);
       callback.doneWaiting();
@@ -102,8 +136,56 @@ void RootOutputer::write(unsigned int iLaneIndex, EventIdentifier const& iEventI
   accumulatedTime_ += std::chrono::duration_cast<decltype(accumulatedTime_)>(std::chrono::high_resolution_clock::now() - start);
 }
   
+void RootOutputer::fillLane(unsigned int iLaneIndex, EventIdentifier const& iEventID, TaskHolder iCallback) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  auto& lane = lanes_[iLaneIndex];
+  auto* retrievers = retrievers_[iLaneIndex];
+
+  auto it = lane.branches_.begin();
+  for(auto const& retriever: *retrievers) {
+    (*it)->SetAddress(retriever.address());
+    ++it;
+  }
+  lane.id_ = iEventID;
+
+  tbb::this_task_arena::isolate([&] { lane.nBytesSinceMerge_ += lane.eventTree_->Fill(); });
+  if(lane.nBytesSinceMerge_ > laneFlushBytes_) {
+    //compress the remaining baskets on this lane so the merge only copies bytes
+    tbb::this_task_arena::isolate([&] { lane.eventTree_->FlushBaskets(); });
+    lane.nBytesSinceMerge_ = 0;
+    auto group = iCallback.group();
+    queue_.push(*group, [this, iLaneIndex, callback=std::move(iCallback)]() mutable {
+        auto start = std::chrono::high_resolution_clock::now();
+        mergeLane(iLaneIndex);
+        accumulatedTime_ += std::chrono::duration_cast<decltype(accumulatedTime_)>(std::chrono::high_resolution_clock::now() - start);
+        callback.doneWaiting();
+      });
+  }
+  parallelTime_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void RootOutputer::mergeLane(unsigned int iLaneIndex) {
+  auto& lane = lanes_[iLaneIndex];
+  if(lane.eventTree_->GetEntries() == 0) {
+    return;
+  }
+  //'fast' copies the compressed baskets without decompressing them
+  tbb::this_task_arena::isolate([&] { eventTree_->CopyEntries(lane.eventTree_, -1, "fast"); });
+  //drops the baskets and entries of the lane's TTree but keeps its branches
+  lane.eventTree_->ResetAfterMerge(nullptr);
+  lane.file_->ResetAfterMerge(nullptr);
+}
+  
 void RootOutputer::printSummary() const {
   auto start = std::chrono::high_resolution_clock::now();
+  if(laneTrees_) {
+    for(unsigned int index = 0; index < lanes_.size(); ++index) {
+      auto& lane = const_cast<RootOutputer*>(this)->lanes_[index];
+      lane.eventTree_->FlushBaskets();
+      const_cast<RootOutputer*>(this)->mergeLane(index);
+    }
+  }
   file_.Write();
   auto writeTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
 
@@ -111,7 +193,12 @@ void RootOutputer::printSummary() const {
   file_.Close();
   auto closeTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
 
-  std::cout <<"RootOutputer total time: "<<accumulatedTime_.count()<<"us\n";
+  if(laneTrees_) {
+    std::cout <<"RootOutputer\n  total serial time at end event: "<<accumulatedTime_.count()<<"us\n"
+      "  total parallel time at end event: "<<parallelTime_.load()<<"us\n";
+  } else {
+    std::cout <<"RootOutputer total time: "<<accumulatedTime_.count()<<"us\n";
+  }
   std::cout << "  end of job file write time: "<<writeTime.count()<<"us\n";
   std::cout << "  end of job file close time: "<<closeTime.count()<<"us\n";
 }
@@ -125,7 +212,10 @@ namespace {
       if(not result) {
         return {};
       }
-      return std::make_unique<RootOutputer>(result->first,iNLanes, outputerConfig<RootOutputer::Config>(result->second));
+      auto config = outputerConfig<RootOutputer::Config>(result->second);
+      config.laneTrees_ = params.get<bool>("laneTrees", false);
+      config.laneFlushBytes_ = params.get<int>("laneFlushBytes", config.laneFlushBytes_);
+      return std::make_unique<RootOutputer>(result->first,iNLanes, config);
     }
     };
 
@@ -4,6 +4,9 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <atomic>
+#include <chrono>
 
 #include "OutputerBase.h"
 #include "EventIdentifier.h"
@@ -15,6 +18,7 @@
 
 class TBranch;
 class TTree;
+class TMemFile;
 
 namespace cce::tf {
 class RootOutputer :public OutputerBase {
@@ -27,6 +31,9 @@ class RootOutputer :public OutputerBase {
     int treeMaxVirtualSize_=-1;
     int autoFlush_=-1;
     int cacheSize_=0;
+    //each lane fills its own TTree held in memory which is merged into the file
+    bool laneTrees_ = false;
+    int laneFlushBytes_ = 30000000;
   };
 
   RootOutputer(std::string const& iFileName, unsigned int iNLanes, Config const&);
@@ -43,7 +50,18 @@ class RootOutputer :public OutputerBase {
 
 
 private:
+  struct PerLane {
+    std::unique_ptr<TMemFile> file_;
+    TTree* eventTree_ = nullptr;
+    std::vector<TBranch*> branches_;
+    EventIdentifier id_;
+    Long64_t nBytesSinceMerge_ = 0;
+  };
+
   void write(unsigned int iLaneIndex, EventIdentifier const&);
+  void fillLane(unsigned int iLaneIndex, EventIdentifier const&, TaskHolder iCallback);
+  void mergeLane(unsigned int iLaneIndex);
+  void setupLaneTree(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iDPs, bool iHasEventAuxiliaryBranch);
   mutable TFile file_;
   TTree* eventTree_;
   std::vector<TBranch*> branches_;
@@ -54,6 +72,10 @@ private:
   std::chrono::microseconds accumulatedTime_;
   int basketSize_;
   int splitLevel_;
+  bool laneTrees_;
+  int laneFlushBytes_;
+  std::vector<PerLane> lanes_;
+  mutable std::atomic<std::chrono::microseconds::rep> parallelTime_;
 };
 }
 #endif
@@ -10,7 +10,7 @@
 
 using namespace cce::tf;
 
-RootSource::RootSource(std::string const& iName) :
+RootSource::RootSource(std::string const& iName, RootTreeCacheConfig const& iCacheConfig) :
   file_{TFile::Open(iName.c_str())},
   eventAuxReader_{*file_}
 {
@@ -47,6 +47,7 @@ RootSource::RootSource(std::string const& iName) :
       eventAuxBranch_ = b;
     }
   }
+  setupTreeCache(*events_, iCacheConfig);
 }
 
 EventIdentifier RootSource::eventIdentifier() {
@@ -77,6 +78,21 @@ bool RootSource::readEvent(long iEventIndex) {
 }
 
 namespace {
+  class ReplicatedRootSource : public ReplicatedSharedSource<RootSource> {
+  public:
+    using ReplicatedSharedSource<RootSource>::ReplicatedSharedSource;
+
+    void printSummary() const final {
+      RootTreeCacheStats stats;
+      for(auto const& s: sources()) {
+        stats += s.cacheStats();
+      }
+      std::cout <<"\nSource time: "<<accumulatedTime().count()<<"us\n";
+      stats.print(std::cout);
+      std::cout <<std::endl;
+    }
+  };
+
     class Maker : public SourceMakerBase {
   public:
     Maker(): SourceMakerBase("ReplicatedRootSource") {}
@@ -86,7 +102,7 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
-        return std::make_unique<ReplicatedSharedSource<RootSource>>(iNLanes, iNEvents, *fileName);
+        return std::make_unique<ReplicatedRootSource>(iNLanes, iNEvents, *fileName, parseRootTreeCacheConfig(params));
     }
     };
 
@@ -9,6 +9,7 @@
 #include "DataProductRetriever.h"
 #include "DelayedProductRetriever.h"
 #include "EventAuxReader.h"
+#include "RootTreeCache.h"
 
 #include "SourceBase.h"
 #include "TFile.h"
@@ -23,7 +24,7 @@ class RootDelayedRetriever : public DelayedProductRetriever {
 
 class RootSource : public SourceBase {
 public:
-  RootSource(std::string const& iName);
+  RootSource(std::string const& iName, RootTreeCacheConfig const&);
   RootSource(RootSource&&) = default;
   RootSource(RootSource const&) = default;
 
@@ -33,6 +34,8 @@ public:
 
   bool readEvent(long iEventIndex) final;
 
+  RootTreeCacheStats cacheStats() const { return treeCacheStats(*events_, *file_); }
+
 private:
   long numberOfEvents();
 
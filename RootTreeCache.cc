@@ -0,0 +1,78 @@
+#include "RootTreeCache.h"
+#include "ConfigurationParameters.h"
+
+#include "TTree.h"
+#include "TFile.h"
+#include "TTreeCache.h"
+#include "TTreeCacheUnzip.h"
+
+#include <iostream>
+
+namespace cce::tf {
+  RootTreeCacheConfig parseRootTreeCacheConfig(ConfigurationParameters const& params) {
+    RootTreeCacheConfig config;
+    config.cacheSize_ = params.get<int>("cacheSize", config.cacheSize_);
+    config.learnEntries_ = params.get<int>("cacheLearnEntries", config.learnEntries_);
+    config.cacheAllBranches_ = params.get<bool>("cacheAllBranches", config.cacheAllBranches_);
+    config.parallelUnzip_ = params.get<bool>("parallelUnzip", config.parallelUnzip_);
+    return config;
+  }
+
+  void setupTreeCache(TTree& iTree, RootTreeCacheConfig const& iConfig) {
+    //both are global settings which ROOT uses when the cache is created
+    if(iConfig.parallelUnzip_) {
+      iTree.SetParallelUnzip(true);
+    }
+    if(iConfig.learnEntries_ > 0) {
+      TTree::SetCacheLearnEntries(iConfig.learnEntries_);
+    }
+    if(iConfig.cacheSize_ >= 0) {
+      iTree.SetCacheSize(iConfig.cacheSize_);
+    }
+    if(iConfig.cacheAllBranches_ and iConfig.cacheSize_ != 0) {
+      iTree.AddBranchToCache("*", true);
+      iTree.StopCacheLearningPhase();
+    }
+  }
+
+  RootTreeCacheStats treeCacheStats(TTree& iTree, TFile& iFile) {
+    RootTreeCacheStats stats;
+    stats.readCalls_ = iFile.GetReadCalls();
+    stats.bytesRead_ = iFile.GetBytesRead();
+    if(auto cache = iTree.GetReadCache(&iFile)) {
+      stats.hitFractions_ = cache->GetEfficiency();
+      stats.nCaches_ = 1;
+      if(auto unzip = dynamic_cast<TTreeCacheUnzip*>(cache)) {
+        stats.unzip_ = true;
+        stats.nUnzipped_ = unzip->GetNUnzip();
+        stats.nUnzipHits_ = unzip->GetNFound();
+        stats.nUnzipMisses_ = unzip->GetNMissed();
+      }
+    }
+    return stats;
+  }
+
+  RootTreeCacheStats& RootTreeCacheStats::operator+=(RootTreeCacheStats const& iOther) {
+    readCalls_ += iOther.readCalls_;
+    bytesRead_ += iOther.bytesRead_;
+    hitFractions_ += iOther.hitFractions_;
+    nCaches_ += iOther.nCaches_;
+    nUnzipped_ += iOther.nUnzipped_;
+    nUnzipHits_ += iOther.nUnzipHits_;
+    nUnzipMisses_ += iOther.nUnzipMisses_;
+    unzip_ = unzip_ or iOther.unzip_;
+    return *this;
+  }
+
+  void RootTreeCacheStats::print(std::ostream& iOS) const {
+    iOS <<"   file read calls: "<<readCalls_<<", bytes read: "<<bytesRead_<<"\n";
+    if(nCaches_ == 0) {
+      iOS <<"   no TTreeCache\n";
+      return;
+    }
+    iOS <<"   TTreeCache hit fraction: "<<hitFractions_/nCaches_<<"\n";
+    if(unzip_) {
+      iOS <<"   baskets unzipped ahead: "<<nUnzipped_<<", hits: "<<nUnzipHits_<<", misses: "<<nUnzipMisses_<<"\n";
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#if !defined(RootTreeCache_h)
+#define RootTreeCache_h
+
+#include <iosfwd>
+
+class TTree;
+class TFile;
+
+namespace cce::tf {
+  //the TTreeCache options shared by the sources reading a ROOT TTree
+  struct RootTreeCacheConfig {
+    //bytes, a negative value keeps ROOT's default cache and 0 turns the cache off
+    int cacheSize_=-1;
+    //entries used to learn which branches are read, 0 keeps ROOT's default
+    int learnEntries_=0;
+    //register all branches up front instead of using the learning phase
+    bool cacheAllBranches_=false;
+    //use a TTreeCacheUnzip so baskets are decompressed by ROOT tasks ahead of their use
+    bool parallelUnzip_=false;
+  };
+
+  struct RootTreeCacheStats {
+    //from the TFile, so these are also filled when there is no cache
+    unsigned long long readCalls_=0;
+    unsigned long long bytesRead_=0;
+    //sum over the caches of the fraction of requested baskets found in the cache
+    double hitFractions_=0;
+    unsigned int nCaches_=0;
+    //only filled when using a TTreeCacheUnzip
+    unsigned long long nUnzipped_=0;
+    unsigned long long nUnzipHits_=0;
+    unsigned long long nUnzipMisses_=0;
+    bool unzip_=false;
+
+    RootTreeCacheStats& operator+=(RootTreeCacheStats const&);
+    void print(std::ostream&) const;
+  };
+
+  class ConfigurationParameters;
+
+  RootTreeCacheConfig parseRootTreeCacheConfig(ConfigurationParameters const& params);
+
+  //must be called before the first entry is read from iTree
+  void setupTreeCache(TTree& iTree, RootTreeCacheConfig const&);
+
+  RootTreeCacheStats treeCacheStats(TTree& iTree, TFile& iFile);
+}
+
+
+#endif
@@ -6,18 +6,25 @@
 #include "TaskHolder.h"
 #include "WaiterBase.h"
 #include "WaiterFactory.h"
+#include "TimerService.h"
 
 
 namespace cce::tf {
   class ScaleWaiter : public WaiterBase {
  public:
 
- ScaleWaiter(double iScaleFactor):
-  scale_{iScaleFactor} {}
+ ScaleWaiter(double iScaleFactor, bool iBlocking):
+  scale_{iScaleFactor}, timer_{iBlocking ? nullptr : std::make_unique<TimerService>()} {}
 
     void waitAsync(unsigned int iLaneIndex, EventIdentifier const& iEventID, long iEventIndex,
                    std::vector<DataProductRetriever> const& iRetrievers, unsigned int index, 
                    TaskHolder iCallback) const final {
+      if(timer_) {
+        using namespace std::chrono_literals;
+        auto sleep = std::chrono::duration_cast<std::chrono::microseconds>(scale_*iRetrievers[index].size()*1us);
+        timer_->releaseAfter(sleep, std::move(iCallback));
+        return;
+      }
       iCallback.group()->run([iCallback, &iRetrievers, scale=scale_, index]() {
 	  using namespace std::chrono_literals;
 	  auto sleep = scale*iRetrievers[index].size()*1us;
@@ -29,6 +36,7 @@ namespace cce::tf {
 
  private:
   double scale_;
+  std::unique_ptr<TimerService> timer_;
 };
 }
 
@@ -42,8 +50,9 @@ namespace {
     std::unique_ptr<WaiterBase> create(unsigned int iNLanes, std::size_t iNDataProducts, ConfigurationParameters const& params) const final {
 
       auto scale = params.get<float>("scale", 0);
+      auto blocking = params.get<bool>("blocking", false);
 
-      return std::make_unique<ScaleWaiter>(scale);
+      return std::make_unique<ScaleWaiter>(scale, blocking);
     }
     
   };
@@ -2,6 +2,7 @@
 #include "SourceFactory.h"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace cce::tf;
 
@@ -106,6 +107,45 @@ void SerialRNTupleSource::printSummary() const {
 
 
 namespace {
+  //compares the ClusterIndex RNTuple, written by the RNTupleParallelOutputer when staging,
+  // with the clusters of the Events RNTuple
+  bool checkClusterIndex(std::string const& iName) {
+    auto events = ROOT::RNTupleReader::Open("Events", iName.c_str());
+    std::vector<std::pair<ROOT::NTupleSize_t, ROOT::NTupleSize_t>> clusters;
+    for(auto const& cluster: events->GetDescriptor().GetClusterIterable()) {
+      clusters.emplace_back(cluster.GetFirstEntryIndex(), cluster.GetNEntries());
+    }
+    std::sort(clusters.begin(), clusters.end());
+
+    auto index = ROOT::RNTupleReader::Open("ClusterIndex", iName.c_str());
+    if(index->GetNEntries() != clusters.size()) {
+      std::cout <<"ERROR: ClusterIndex has "<<index->GetNEntries()<<" entries but Events has "<<clusters.size()<<" clusters"<<std::endl;
+      return false;
+    }
+    auto firstEntry = index->GetView<unsigned long long>("firstEntry");
+    auto nEntries = index->GetView<unsigned long long>("nEntries");
+    auto firstID = index->GetView<EventIdentifier>("firstID");
+    auto lastID = index->GetView<EventIdentifier>("lastID");
+    auto eventID = events->GetView<EventIdentifier>("EventID");
+    auto sameID = [](EventIdentifier const& iLHS, EventIdentifier const& iRHS) {
+      return iLHS.run == iRHS.run and iLHS.lumi == iRHS.lumi and iLHS.event == iRHS.event;
+    };
+    for(ROOT::NTupleSize_t i=0; i < clusters.size(); ++i) {
+      auto [clusterFirst, clusterN] = clusters[i];
+      if(firstEntry(i) != clusterFirst or nEntries(i) != clusterN) {
+        std::cout <<"ERROR: ClusterIndex entry "<<i<<" gives entries "<<firstEntry(i)<<" to "<<firstEntry(i)+nEntries(i)
+                  <<" but the cluster holds entries "<<clusterFirst<<" to "<<clusterFirst+clusterN<<std::endl;
+        return false;
+      }
+      if(not sameID(firstID(i), eventID(clusterFirst)) or not sameID(lastID(i), eventID(clusterFirst+clusterN-1))) {
+        std::cout <<"ERROR: ClusterIndex entry "<<i<<" has the wrong first or last EventIdentifier"<<std::endl;
+        return false;
+      }
+    }
+    std::cout <<"ClusterIndex matches the "<<clusters.size()<<" clusters of Events"<<std::endl;
+    return true;
+  }
+
     class Maker : public SourceMakerBase {
   public:
     Maker(): SourceMakerBase("SerialRNTupleSource") {}
@@ -115,6 +155,9 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
+        if(params.get<bool>("checkClusterIndex", false) and not checkClusterIndex(*fileName)) {
+          return {};
+        }
         return std::make_unique<SerialRNTupleSource>(iNLanes, iNEvents, *fileName, params.get<bool>("delayReading",false));
     }
     };
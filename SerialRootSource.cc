@@ -1,5 +1,6 @@
 #include "SerialRootSource.h"
 #include "SourceFactory.h"
+#include "ReplicatedSharedSource.h"
 
 #include "TTree.h"
 #include "TBranch.h"
@@ -8,7 +9,7 @@
 
 using namespace cce::tf;
 
-SerialRootSource::SerialRootSource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName):
+SerialRootSource::SerialRootSource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName, RootTreeCacheConfig const& iCacheConfig):
   SharedSourceBase(iNEvents),
   file_{TFile::Open(iName.c_str())},
   eventAuxReader_{*file_},
@@ -40,6 +41,7 @@ SerialRootSource::SerialRootSource(unsigned iNLanes, unsigned long long iNEvents
       eventAuxBranch_ = b;
     }
   }
+  setupTreeCache(*events_, iCacheConfig);
 
   for(int laneId=0; laneId < iNLanes; ++laneId) {
     dataProductsPerLane_.emplace_back();
@@ -94,7 +96,9 @@ std::chrono::microseconds SerialRootSource::accumulatedTime() const {
 
 void SerialRootSource::printSummary() const {
   std::chrono::microseconds sourceTime = accumulatedTime();
-  std::cout <<"\nSource time: "<<sourceTime.count()<<"us\n"<<std::endl;
+  std::cout <<"\nSource time: "<<sourceTime.count()<<"us\n";
+  treeCacheStats(*events_, *file_).print(std::cout);
+  std::cout <<std::endl;
 }
 
 void SerialRootDelayedRetriever::setupBuffer() {
@@ -132,9 +136,30 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
-        return std::make_unique<SerialRootSource>(iNLanes, iNEvents, *fileName);
+        return std::make_unique<SerialRootSource>(iNLanes, iNEvents, *fileName, parseRootTreeCacheConfig(params));
     }
     };
 
   Maker s_maker;
+
+    class GroupReplicatedMaker : public SourceMakerBase {
+  public:
+    GroupReplicatedMaker(): SourceMakerBase("GroupReplicatedRootSource") {}
+      std::unique_ptr<SharedSourceBase> create(unsigned int iNLanes, unsigned long long iNEvents, ConfigurationParameters const& params) const final {
+        auto fileName = params.get<std::string>("fileName");
+        if(not fileName) {
+          std::cout <<"no file name given\n";
+          return {};
+        }
+        auto lanesPerReplica = params.get<unsigned int>("lanesPerReplica", 8);
+        if(lanesPerReplica == 0) {
+          std::cout <<"lanesPerReplica must be greater than 0\n";
+          return {};
+        }
+        auto replicas = params.get<unsigned int>("replicas", (iNLanes+lanesPerReplica-1)/lanesPerReplica);
+        return std::make_unique<GroupReplicatedSharedSource<SerialRootSource>>(iNLanes, iNEvents, replicas, *fileName, parseRootTreeCacheConfig(params));
+    }
+    };
+
+  GroupReplicatedMaker s_groupReplicatedMaker;
 }
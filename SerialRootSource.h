@@ -9,6 +9,7 @@
 #include "DataProductRetriever.h"
 #include "DelayedProductRetriever.h"
 #include "EventAuxReader.h"
+#include "RootTreeCache.h"
 
 #include "SharedSourceBase.h"
 #include "SerialTaskQueue.h"
@@ -39,7 +40,7 @@ namespace cce::tf {
 
   class SerialRootSource : public SharedSourceBase {
   public:
-    SerialRootSource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName);
+    SerialRootSource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName, RootTreeCacheConfig const&);
     size_t numberOfDataProducts() const final {return dataProductsPerLane_[0].size();}
 
     std::vector<DataProductRetriever>& dataProducts(unsigned int iLane, long iEventIndex) final {
@@ -49,6 +50,8 @@ namespace cce::tf {
       return identifiers_[iLane];
     }
     
+    long numberOfEntries() const { return nEvents_; }
+
     void printSummary() const final;
     std::chrono::microseconds accumulatedTime() const;
   private:
@@ -8,7 +8,7 @@
 
 using namespace cce::tf;
 
-SerialRootTreeGetEntrySource::SerialRootTreeGetEntrySource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName):
+SerialRootTreeGetEntrySource::SerialRootTreeGetEntrySource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName, RootTreeCacheConfig const& iCacheConfig):
   SharedSourceBase(iNEvents),
   file_{TFile::Open(iName.c_str())},
   eventAuxReader_{*file_},
@@ -40,6 +40,7 @@ SerialRootTreeGetEntrySource::SerialRootTreeGetEntrySource(unsigned iNLanes, uns
       eventAuxBranch_ = b;
     }
   }
+  setupTreeCache(*events_, iCacheConfig);
 
   for(int laneId=0; laneId < iNLanes; ++laneId) {
     dataProductsPerLane_.emplace_back();
@@ -92,7 +93,9 @@ std::chrono::microseconds SerialRootTreeGetEntrySource::accumulatedTime() const
 
 void SerialRootTreeGetEntrySource::printSummary() const {
   std::chrono::microseconds sourceTime = accumulatedTime();
-  std::cout <<"\nSource time: "<<sourceTime.count()<<"us\n"<<std::endl;
+  std::cout <<"\nSource time: "<<sourceTime.count()<<"us\n";
+  treeCacheStats(*events_, *file_).print(std::cout);
+  std::cout <<std::endl;
 }
 
 void SerialRootTreeGetEntryDelayedRetriever::setupBuffer(std::vector<TBranch*> const& iBranches) {
@@ -129,7 +132,7 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
-        return std::make_unique<SerialRootTreeGetEntrySource>(iNLanes, iNEvents, *fileName);
+        return std::make_unique<SerialRootTreeGetEntrySource>(iNLanes, iNEvents, *fileName, parseRootTreeCacheConfig(params));
     }
     };
 
@@ -9,6 +9,7 @@
 #include "DataProductRetriever.h"
 #include "DelayedProductRetriever.h"
 #include "EventAuxReader.h"
+#include "RootTreeCache.h"
 
 #include "SharedSourceBase.h"
 #include "SerialTaskQueue.h"
@@ -32,7 +33,7 @@ namespace cce::tf {
 
   class SerialRootTreeGetEntrySource : public SharedSourceBase {
   public:
-    SerialRootTreeGetEntrySource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName);
+    SerialRootTreeGetEntrySource(unsigned iNLanes, unsigned long long iNEvents, std::string const& iName, RootTreeCacheConfig const&);
     size_t numberOfDataProducts() const final {return dataProductsPerLane_[0].size();}
 
     std::vector<DataProductRetriever>& dataProducts(unsigned int iLane, long iEventIndex) final {
@@ -0,0 +1,373 @@
+#include "SharedHDFBatchEventsSource.h"
+#include "HDFBatchEventsOutputer.h"
+#include "HDFDirectChunkWriter.h"
+#include "SourceFactory.h"
+#include "Deserializer.h"
+#include "UnrolledDeserializer.h"
+#include "H5Timing.h"
+
+#include "TClass.h"
+
+#include <algorithm>
+
+using namespace cce::tf;
+
+namespace {
+  constexpr const char* const PRODUCTS_DSNAME="Products";
+  constexpr const char* const EVENTS_DSNAME="EventIDs";
+  constexpr const char* const OFFSETS_DSNAME="Offsets";
+  constexpr const char* const BATCHES_DSNAME="Batches";
+  constexpr const char* const GNAME="Lumi";
+  constexpr const char* const RUN_ANAME="run";
+  constexpr const char* const LUMISEC_ANAME="lumisec";
+  constexpr const char* const COMPRESSION_ANAME="Compression";
+  constexpr const char* const COMPRESSION_CHOICE_ANAME="CompressionChoice";
+  constexpr const char* const SERIALIZATION_ANAME="Serialization";
+  constexpr const char* const PRODUCT_NAMES_ANAME="ProductNames";
+
+  hsize_t length(hid_t iSpace) {
+    hsize_t dims[1];
+    H5Sget_simple_extent_dims(iSpace, dims, NULL);
+    return dims[0];
+  }
+
+  //HDF5 suggests a prime number of hash slots about 100 times the number of chunks in the cache.
+  // Small chunks in a large cache would otherwise give millions of slots.
+  constexpr size_t kMaxChunkCacheSlots = 100000;
+  size_t chunkCacheSlots(size_t iNChunks) {
+    auto isPrime = [](size_t n) {
+      for(size_t d = 2; d*d <= n; ++d) {
+        if(n % d == 0) {
+          return false;
+        }
+      }
+      return true;
+    };
+    size_t slots = std::min(100*iNChunks, kMaxChunkCacheSlots)+1;
+    while(not isPrime(slots)) {
+      ++slots;
+    }
+    return slots;
+  }
+
+  //The chunk cache holds one chunk for each lane which can be waiting on a read plus the chunk
+  // shared with the previous read. It is never made smaller than the HDF5 default of 1MB.
+  hdf5::Dataset openWithChunkCache(hid_t iGroup, const char* iName, unsigned int iNLanes, size_t& oCacheBytes) {
+    hsize_t chunkBytes = 0;
+    {
+      auto dataset = hdf5::Dataset::open(iGroup, iName);
+      chunkBytes = hdf5::chunk_bytes(dataset);
+    }
+    constexpr size_t kDefaultCacheBytes = 1024*1024;
+    size_t const nChunks = iNLanes+1;
+    size_t const cacheBytes = std::max<size_t>(kDefaultCacheBytes, chunkBytes*nChunks);
+    oCacheBytes += cacheBytes;
+    auto access = hdf5::Property::create_access();
+    access.set_chunk_cache(chunkCacheSlots(std::max<size_t>(nChunks, chunkBytes == 0 ? 0 : cacheBytes/chunkBytes)), cacheBytes, 1.0);
+    return hdf5::Dataset::open(iGroup, iName, access);
+  }
+}
+
+SharedHDFBatchEventsSource::SharedHDFBatchEventsSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iName, unsigned int iReadWindow) :
+  SharedSourceBase(iNEvents),
+  file_(hdf5::File::open(iName.c_str())),
+  group_(hdf5::Group::open(file_, GNAME)),
+  eventIDsDataset_(openWithChunkCache(group_, EVENTS_DSNAME, iNLanes, chunkCacheBytes_)),
+  eventIDsSpace_(hdf5::Dataspace::get_space(eventIDsDataset_)),
+  offsetsDataset_(openWithChunkCache(group_, OFFSETS_DSNAME, iNLanes, chunkCacheBytes_)),
+  offsetsSpace_(hdf5::Dataspace::get_space(offsetsDataset_)),
+  productsDataset_(openWithChunkCache(group_, PRODUCTS_DSNAME, iNLanes, chunkCacheBytes_)),
+  productsSpace_(hdf5::Dataspace::get_space(productsDataset_)),
+  readWindow_{iReadWindow},
+  readTime_{std::chrono::microseconds::zero()}
+{
+  //needed to read the Products dataset written using directChunk
+  HDFDirectChunkWriter::registerZstdFilter();
+  if(H5Aexists(group_, PRODUCT_NAMES_ANAME) <= 0) {
+    std::cout <<"no '"<<PRODUCT_NAMES_ANAME<<"' attribute in file "<<iName<<std::endl;
+    throw std::runtime_error("no ProductNames attribute");
+  }
+  auto names = hdf5::Attribute::open(group_, PRODUCT_NAMES_ANAME).read_strings();
+
+  std::vector<pds::ProductInfo> productInfo;
+  productInfo.reserve(names.size());
+  {
+    unsigned int index = 0;
+    for(auto const& name: names) {
+      //each data product has an attribute holding its C++ type
+      productInfo.emplace_back(name, index++, hdf5::Attribute::open(group_, name.c_str()).read_string());
+    }
+  }
+
+  nEventsInFile_ = length(eventIDsSpace_);
+  if(nEventsInFile_ != 0) {
+    //these are only filled once the first event has been written
+    hdf5::Attribute::open(group_, RUN_ANAME).read(run_);
+    hdf5::Attribute::open(group_, LUMISEC_ANAME).read(lumisec_);
+  }
+
+  auto compressionName = hdf5::Attribute::open(group_, COMPRESSION_ANAME).read_string();
+  auto compression = pds::toCompression(compressionName);
+  if(nEventsInFile_ != 0 and not compression) {
+    std::cout <<"Unknown compression algorithm '"<<compressionName<<"'"<<std::endl;
+    throw std::runtime_error("unknown compression algorithm");
+  }
+  compression_ = compression.value_or(pds::Compression::kNone);
+
+  //HDFEventOutputer always compresses each event and has no CompressionChoice
+  auto choice = HDFBatchEventsOutputer::CompressionChoice::kEvents;
+  if(H5Aexists(group_, COMPRESSION_CHOICE_ANAME) > 0) {
+    int value = 0;
+    hdf5::Attribute::open(group_, COMPRESSION_CHOICE_ANAME).read(value);
+    choice = static_cast<HDFBatchEventsOutputer::CompressionChoice>(value);
+  }
+  bool const compressing = compression_ != pds::Compression::kNone;
+  eventsCompressed_ = compressing and (choice == HDFBatchEventsOutputer::CompressionChoice::kEvents or
+                                       choice == HDFBatchEventsOutputer::CompressionChoice::kBoth);
+  batchesCompressed_ = compressing and (choice == HDFBatchEventsOutputer::CompressionChoice::kBatch or
+                                        choice == HDFBatchEventsOutputer::CompressionChoice::kBoth);
+
+  pds::Serialization serialization = pds::Serialization::kRoot;
+  if(H5Aexists(group_, SERIALIZATION_ANAME) > 0) {
+    auto serializationName = hdf5::Attribute::open(group_, SERIALIZATION_ANAME).read_string();
+    auto s = pds::toSerialization(serializationName);
+    if(not s) {
+      std::cout <<"Unknown serialization algorithm '"<<serializationName<<"'"<<std::endl;
+      throw std::runtime_error("unknown serialization algorithm");
+    }
+    serialization = *s;
+  }
+
+  if(H5Lexists(group_, BATCHES_DSNAME, H5P_DEFAULT) > 0) {
+    auto batches = hdf5::Dataset::open(group_, BATCHES_DSNAME);
+    auto batchesSpace = hdf5::Dataspace::get_space(batches);
+    batches_.resize(length(batchesSpace));
+    hdf5::read_slab(batches, batchesSpace, 0, batches_.size(), batches_.data());
+  } else if(batchesCompressed_) {
+    std::cout <<"no '"<<BATCHES_DSNAME<<"' dataset in file "<<iName<<" which is needed to decompress batches"<<std::endl;
+    throw std::runtime_error("no Batches dataset");
+  }
+
+  laneInfos_.reserve(iNLanes);
+  for(unsigned int i = 0; i< iNLanes; ++i) {
+    DeserializeStrategy strategy;
+    switch(serialization) {
+    case pds::Serialization::kRoot: {
+      strategy = DeserializeStrategy::make<DeserializeProxy<Deserializer>>(); break;
+    }
+    case pds::Serialization::kRootUnrolled: {
+      strategy = DeserializeStrategy::make<DeserializeProxy<UnrolledDeserializer>>(); break;
+    }
+    }
+    laneInfos_.emplace_back(productInfo, std::move(strategy));
+  }
+}
+
+SharedHDFBatchEventsSource::LaneInfo::LaneInfo(std::vector<pds::ProductInfo> const& productInfo, DeserializeStrategy deserialize):
+  deserializers_{std::move(deserialize)},
+  decompressTime_{std::chrono::microseconds::zero()},
+  deserializeTime_{std::chrono::microseconds::zero()}
+{
+  dataProducts_.reserve(productInfo.size());
+  dataBuffers_.resize(productInfo.size(), nullptr);
+  deserializers_.reserve(productInfo.size());
+  size_t index =0;
+  for(auto const& pi : productInfo) {
+    TClass* cls = TClass::GetClass(pi.className().c_str());
+    assert(cls);
+    dataBuffers_[index] = cls->New();
+    dataProducts_.emplace_back(index,
+                               &dataBuffers_[index],
+                               pi.name(),
+                               cls,
+                               &delayedRetriever_);
+    deserializers_.emplace_back(cls);
+    ++index;
+  }
+}
+
+SharedHDFBatchEventsSource::LaneInfo::~LaneInfo() {
+  auto it = dataProducts_.begin();
+  for( void * b: dataBuffers_) {
+    it->classType()->Destructor(b);
+    ++it;
+  }
+}
+
+size_t SharedHDFBatchEventsSource::numberOfDataProducts() const {
+  return laneInfos_[0].dataProducts_.size();
+}
+
+std::vector<DataProductRetriever>& SharedHDFBatchEventsSource::dataProducts(unsigned int iLane, long iEventIndex) {
+  return laneInfos_[iLane].dataProducts_;
+}
+
+EventIdentifier SharedHDFBatchEventsSource::eventIdentifier(unsigned int iLane, long iEventIndex) {
+  return laneInfos_[iLane].eventID_;
+}
+
+void SharedHDFBatchEventsSource::readWindow(LaneInfo& iLaneInfo) {
+  auto window = std::make_shared<Window>();
+  const auto entriesPerEvent = iLaneInfo.dataProducts_.size()+2;
+
+  //batches are never split between windows
+  unsigned long long nEvents = 0;
+  auto const firstBatch = nextBatch_;
+  if(batches_.empty()) {
+    nEvents = std::min<unsigned long long>(readWindow_, nEventsInFile_ - nextEvent_);
+  } else {
+    while(2*nextBatch_ < batches_.size() and nEvents < readWindow_) {
+      nEvents += batches_[2*nextBatch_];
+      ++nextBatch_;
+    }
+  }
+
+  window->eventNumbers_.resize(nEvents);
+  register_dataset_sz_read_timer_start(EVENTS_DSNAME);
+  hdf5::read_slab(eventIDsDataset_, eventIDsSpace_, nextEvent_, nEvents, window->eventNumbers_.data());
+  register_dataset_sz_read_timer_end(nEvents*sizeof(unsigned long long));
+  window->offsets_.resize(nEvents*entriesPerEvent);
+  register_dataset_sz_read_timer_start(OFFSETS_DSNAME);
+  hdf5::read_slab(offsetsDataset_, offsetsSpace_, nextEvent_*entriesPerEvent, window->offsets_.size(), window->offsets_.data());
+  register_dataset_sz_read_timer_end(window->offsets_.size()*sizeof(uint32_t));
+
+  window->eventBegins_.reserve(nEvents+1);
+  window->eventBegins_.push_back(0);
+  for(unsigned long long index = 0; index < nEvents; ++index) {
+    window->eventBegins_.push_back(window->eventBegins_.back() + window->offsets_[(index+1)*entriesPerEvent-1]);
+  }
+
+  unsigned long long storedBytes = window->eventBegins_.back();
+  if(batchesCompressed_) {
+    storedBytes = 0;
+    for(auto batch = firstBatch; batch < nextBatch_; ++batch) {
+      storedBytes += batches_[2*batch+1];
+    }
+  }
+  std::vector<char> stored(storedBytes);
+  register_dataset_read_timer_start(PRODUCTS_DSNAME);
+  hdf5::read_slab(productsDataset_, productsSpace_, nextByte_, stored.size(), stored.data());
+  register_dataset_read_timer_end(stored.size());
+  nextByte_ += storedBytes;
+  nextEvent_ += nEvents;
+
+  if(batchesCompressed_) {
+    auto start = std::chrono::high_resolution_clock::now();
+    window->buffer_.resize(window->eventBegins_.back());
+    size_t storedBegin = 0;
+    size_t firstEventInBatch = 0;
+    for(auto batch = firstBatch; batch < nextBatch_; ++batch) {
+      auto const endEventInBatch = firstEventInBatch + batches_[2*batch];
+      auto const uncompressedBegin = window->eventBegins_[firstEventInBatch];
+      auto const uncompressedSize = window->eventBegins_[endEventInBatch] - uncompressedBegin;
+      auto uBuffer = pds::uncompressBuffer(compression_, stored.data()+storedBegin, batches_[2*batch+1], uncompressedSize);
+      std::copy(uBuffer.begin(), uBuffer.end(), window->buffer_.begin()+uncompressedBegin);
+      storedBegin += batches_[2*batch+1];
+      firstEventInBatch = endEventInBatch;
+    }
+    iLaneInfo.decompressTime_ +=
+      std::chrono::duration_cast<decltype(iLaneInfo.decompressTime_)>(std::chrono::high_resolution_clock::now() - start);
+  } else {
+    window->buffer_ = std::move(stored);
+  }
+  window_ = std::move(window);
+  nextEventInWindow_ = 0;
+}
+
+void SharedHDFBatchEventsSource::readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder iTask) {
+  queue_.push(*iTask.group(), [iLane, optTask = std::move(iTask), this]() mutable {
+      auto start = std::chrono::high_resolution_clock::now();
+      if(nextEvent_ < nEventsInFile_ or (window_ and nextEventInWindow_ < window_->eventNumbers_.size())) {
+        if(not window_ or nextEventInWindow_ == window_->eventNumbers_.size()) {
+          readWindow(laneInfos_[iLane]);
+        }
+        auto indexInWindow = nextEventInWindow_++;
+        laneInfos_[iLane].eventID_ = {run_, lumisec_, window_->eventNumbers_[indexInWindow]};
+
+        auto group = optTask.group();
+        group->run([this, window = window_, indexInWindow, task = optTask.releaseToTaskHolder(), iLane]() {
+            auto& laneInfo = this->laneInfos_[iLane];
+            const auto entriesPerEvent = laneInfo.dataProducts_.size()+2;
+            auto itOffsets = window->offsets_.begin() + indexInWindow*entriesPerEvent;
+
+            const char* eventBuffer = window->buffer_.data() + window->eventBegins_[indexInWindow];
+            size_t eventSize = window->eventBegins_[indexInWindow+1] - window->eventBegins_[indexInWindow];
+            std::vector<char> uBuffer;
+            if(eventsCompressed_) {
+              auto start = std::chrono::high_resolution_clock::now();
+              //the last offset before the stored size is the uncompressed size
+              uBuffer = pds::uncompressBuffer(compression_, eventBuffer, eventSize, *(itOffsets+entriesPerEvent-2));
+              eventBuffer = uBuffer.data();
+              eventSize = uBuffer.size();
+              laneInfo.decompressTime_ +=
+                std::chrono::duration_cast<decltype(laneInfo.decompressTime_)>(std::chrono::high_resolution_clock::now() - start);
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            pds::deserializeDataProducts(eventBuffer, eventBuffer+eventSize,
+                                         itOffsets, itOffsets+entriesPerEvent-1,
+                                         laneInfo.dataProducts_, laneInfo.deserializers_);
+            laneInfo.deserializeTime_ +=
+              std::chrono::duration_cast<decltype(laneInfo.deserializeTime_)>(std::chrono::high_resolution_clock::now() - start);
+          });
+      }
+      readTime_ +=std::chrono::duration_cast<decltype(readTime_)>(std::chrono::high_resolution_clock::now() - start);
+    });
+}
+
+void SharedHDFBatchEventsSource::printSummary() const {
+  std::cout <<"\nSource:\n"
+    "   read time: "<<readTime().count()<<"us\n"
+    "   decompress time: "<<decompressTime().count()<<"us\n"
+    "   deserialize time: "<<deserializeTime().count()<<"us\n"
+    "   chunk cache size: "<<chunkCacheBytes_<<" bytes\n"<<std::endl;
+  print_read_timers();
+};
+
+std::chrono::microseconds SharedHDFBatchEventsSource::readTime() const {
+  return readTime_;
+}
+
+std::chrono::microseconds SharedHDFBatchEventsSource::decompressTime() const {
+  auto time = std::chrono::microseconds::zero();
+  for(auto const& l : laneInfos_) {
+    time += l.decompressTime_;
+  }
+  return time;
+}
+
+std::chrono::microseconds SharedHDFBatchEventsSource::deserializeTime() const {
+  auto time = std::chrono::microseconds::zero();
+  for(auto const& l : laneInfos_) {
+    time += l.deserializeTime_;
+  }
+  return time;
+}
+
+
+namespace {
+  //The same Source reads the layouts of both HDFEventOutputer and HDFBatchEventsOutputer
+    class Maker : public SourceMakerBase {
+  public:
+    Maker(std::string const& iName): SourceMakerBase(iName) {}
+      std::unique_ptr<SharedSourceBase> create(unsigned int iNLanes, unsigned long long iNEvents, ConfigurationParameters const& params) const final {
+        auto fileName = params.get<std::string>("fileName");
+        if(not fileName) {
+          std::cout <<"no file name given\n";
+          return {};
+        }
+        auto readWindow = params.get<unsigned int>("readWindow", 16);
+        if(readWindow == 0) {
+          std::cout <<"readWindow must be at least 1\n";
+          return {};
+        }
+        if(params.get<bool>("h5Timing", false)) {
+          init_timers();
+        }
+        return std::make_unique<SharedHDFBatchEventsSource>(iNLanes, iNEvents, *fileName, readWindow);
+    }
+    };
+
+  Maker s_eventMaker("SharedHDFEventSource");
+  Maker s_batchMaker("SharedHDFBatchEventsSource");
+}
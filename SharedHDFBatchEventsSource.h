@@ -0,0 +1,116 @@
+#if !defined(SharedHDFBatchEventsSource_h)
+#define SharedHDFBatchEventsSource_h
+
+#include <string>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "SharedSourceBase.h"
+#include "DataProductRetriever.h"
+#include "DelayedProductRetriever.h"
+#include "SerialTaskQueue.h"
+#include "DeserializeStrategy.h"
+#include "pds_reading.h"
+
+#include "HDFCxx.h"
+
+
+namespace cce::tf {
+  class SharedHDFBatchEventsDelayedRetriever : public DelayedProductRetriever {
+    void getAsync(DataProductRetriever&, int index, TaskHolder) final {}
+  };
+
+  /*
+   Reads files written by HDFEventOutputer or HDFBatchEventsOutputer. The event ids, offsets and
+   stored bytes for a window of events are read with one HDF5 call per dataset from within a
+   SerialTaskQueue. Batches compressed as a whole are decompressed at that time while compressed
+   events are decompressed, and all events deserialized, in the lane's own task.
+   */
+  class SharedHDFBatchEventsSource : public SharedSourceBase {
+  public:
+    SharedHDFBatchEventsSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iFileName, unsigned int iReadWindow);
+    SharedHDFBatchEventsSource(SharedHDFBatchEventsSource&&) = delete;
+    SharedHDFBatchEventsSource(SharedHDFBatchEventsSource const&) = delete;
+    ~SharedHDFBatchEventsSource() = default;
+
+  size_t numberOfDataProducts() const final;
+  std::vector<DataProductRetriever>& dataProducts(unsigned int iLane, long iEventIndex) final;
+  EventIdentifier eventIdentifier(unsigned int iLane, long iEventIndex) final;
+
+  void printSummary() const final;
+  private:
+
+  struct LaneInfo;
+
+  //events read from the file in one go. Shared with the lane tasks so the next
+  // window can be read while events of the previous one are still being deserialized
+  struct Window {
+    std::vector<unsigned long long> eventNumbers_;
+    //per event: the nProducts+1 offsets of the uncompressed event followed by the stored size
+    std::vector<uint32_t> offsets_;
+    //position in buffer_ of the stored bytes of each event, one extra entry for the end
+    std::vector<size_t> eventBegins_;
+    std::vector<char> buffer_;
+  };
+
+  void readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder) final;
+  void readWindow(LaneInfo&);
+
+  std::chrono::microseconds readTime() const;
+  std::chrono::microseconds decompressTime() const;
+  std::chrono::microseconds deserializeTime() const;
+
+  //summed over the datasets. Must be declared before the datasets
+  size_t chunkCacheBytes_ = 0;
+  pds::Compression compression_;
+  bool eventsCompressed_;
+  bool batchesCompressed_;
+  hdf5::File file_;
+  hdf5::Group group_;
+  hdf5::Dataset eventIDsDataset_;
+  hdf5::Dataspace eventIDsSpace_;
+  hdf5::Dataset offsetsDataset_;
+  hdf5::Dataspace offsetsSpace_;
+  hdf5::Dataset productsDataset_;
+  hdf5::Dataspace productsSpace_;
+  unsigned int run_ = 0;
+  unsigned int lumisec_ = 0;
+  unsigned long long nEventsInFile_;
+  unsigned int readWindow_;
+  //number of events followed by the stored bytes for each batch. Empty if events were written one at a time
+  std::vector<uint32_t> batches_;
+  SerialTaskQueue queue_;
+
+  struct LaneInfo {
+    LaneInfo(std::vector<pds::ProductInfo> const&, DeserializeStrategy);
+
+    LaneInfo(LaneInfo&&) = default;
+    LaneInfo(LaneInfo const&) = delete;
+
+    LaneInfo& operator=(LaneInfo&&) = default;
+    LaneInfo& operator=(LaneInfo const&) = delete;
+
+    EventIdentifier eventID_;
+    std::vector<DataProductRetriever> dataProducts_;
+    std::vector<void*> dataBuffers_;
+    DeserializeStrategy deserializers_;
+    SharedHDFBatchEventsDelayedRetriever delayedRetriever_;
+    std::chrono::microseconds decompressTime_;
+    std::chrono::microseconds deserializeTime_;
+    ~LaneInfo();
+  };
+
+  unsigned long long nextEvent_ = 0;
+  unsigned long long nextByte_ = 0;
+  size_t nextBatch_ = 0;
+  std::shared_ptr<Window const> window_;
+  size_t nextEventInWindow_ = 0;
+
+  std::vector<LaneInfo> laneInfos_;
+  std::chrono::microseconds readTime_;
+  };
+}
+
+#endif
@@ -0,0 +1,201 @@
+#include "SharedHDFSource.h"
+#include "SourceFactory.h"
+#include "Deserializer.h"
+#include "H5Timing.h"
+
+#include "TClass.h"
+
+#include <cstring>
+#include <cassert>
+
+using namespace cce::tf;
+
+namespace {
+  herr_t
+  collectProductNames(hid_t loc_id, const char *name, const H5L_info_t *info, void *opdata)
+  {
+    H5O_info_t infobuf;
+    H5Oget_info_by_name (loc_id, name, &infobuf, H5O_INFO_BASIC, H5P_DEFAULT);
+    if (infobuf.type == H5O_TYPE_DATASET and strstr(name,"_sz") == nullptr and strcmp(name, "Event_IDs") != 0) {
+      reinterpret_cast<std::vector<std::string>*>(opdata)->emplace_back(name);
+    }
+    return 0;
+  }
+
+}
+
+SharedHDFSource::SharedHDFSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iName) :
+  SharedSourceBase(iNEvents),
+  file_(hdf5::File::open(iName.c_str())),
+  lumi_(hdf5::Group::open(file_, "/Lumi")),
+  eventIDsDataset_(hdf5::Dataset::open(lumi_, "Event_IDs")),
+  eventIDsSpace_(hdf5::Dataspace::get_space(eventIDsDataset_)),
+  readTime_{std::chrono::microseconds::zero()}
+{
+  std::vector<std::string> names;
+  H5Literate (lumi_, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, collectProductNames, &names);
+
+  {
+    auto attr_r = hdf5::Attribute::open(lumi_, "run");
+    attr_r.read(run_);
+    auto attr_l = hdf5::Attribute::open(lumi_, "lumisec");
+    attr_l.read(lumisec_);
+  }
+  hsize_t dims[1];
+  H5Sget_simple_extent_dims(eventIDsSpace_, dims, NULL);
+  nEvents_ = dims[0];
+
+  std::vector<std::string> classNames;
+  classNames.reserve(names.size());
+  productDatasets_.reserve(names.size());
+  productSpaces_.reserve(names.size());
+  offsetDatasets_.reserve(names.size());
+  offsetSpaces_.reserve(names.size());
+  for (auto const& name: names) {
+    productDatasets_.push_back(hdf5::Dataset::open(lumi_, name.c_str()));
+    productSpaces_.push_back(hdf5::Dataspace::get_space(productDatasets_.back()));
+    offsetDatasets_.push_back(hdf5::Dataset::open(lumi_, (name+"_sz").c_str()));
+    offsetSpaces_.push_back(hdf5::Dataspace::get_space(offsetDatasets_.back()));
+    classNames.push_back(hdf5::Attribute::open(productDatasets_.back(), "classname").read_string());
+  }
+
+  laneInfos_.reserve(iNLanes);
+  for(unsigned int i = 0; i< iNLanes; ++i) {
+    //HDFOutputer always uses ROOT serialization
+    laneInfos_.emplace_back(names, classNames, DeserializeStrategy::make<DeserializeProxy<Deserializer>>());
+  }
+}
+
+SharedHDFSource::LaneInfo::LaneInfo(std::vector<std::string> const& iNames, std::vector<std::string> const& iClassNames, DeserializeStrategy deserialize):
+  productBuffers_(iNames.size()),
+  deserializers_{std::move(deserialize)},
+  deserializeTimes_(iNames.size(), std::chrono::microseconds::zero())
+{
+  dataProducts_.reserve(iNames.size());
+  dataBuffers_.resize(iNames.size(), nullptr);
+  deserializers_.reserve(iNames.size());
+  for(size_t index = 0; index < iNames.size(); ++index) {
+    TClass* cls = TClass::GetClass(iClassNames[index].c_str());
+    assert(cls);
+    dataBuffers_[index] = cls->New();
+    dataProducts_.emplace_back(index,
+                               &dataBuffers_[index],
+                               iNames[index],
+                               cls,
+                               &delayedRetriever_);
+    deserializers_.emplace_back(cls);
+  }
+}
+
+SharedHDFSource::LaneInfo::~LaneInfo() {
+  auto it = dataProducts_.begin();
+  for( void * b: dataBuffers_) {
+    it->classType()->Destructor(b);
+    ++it;
+  }
+}
+
+size_t SharedHDFSource::numberOfDataProducts() const {
+  return laneInfos_[0].dataProducts_.size();
+}
+
+std::vector<DataProductRetriever>& SharedHDFSource::dataProducts(unsigned int iLane, long iEventIndex) {
+  return laneInfos_[iLane].dataProducts_;
+}
+
+EventIdentifier SharedHDFSource::eventIdentifier(unsigned int iLane, long iEventIndex) {
+  return laneInfos_[iLane].eventID_;
+}
+
+void SharedHDFSource::readEvent(long iEventIndex, LaneInfo& iLaneInfo) {
+  unsigned int eventNumber;
+  register_dataset_sz_read_timer_start("Event_IDs");
+  hdf5::read_slab(eventIDsDataset_, eventIDsSpace_, iEventIndex, 1, &eventNumber);
+  register_dataset_sz_read_timer_end(sizeof(eventNumber));
+  iLaneInfo.eventID_ = {run_, lumisec_, eventNumber};
+
+  for(size_t productIndex = 0; productIndex < productDatasets_.size(); ++productIndex) {
+    //the _sz dataset holds the offset of the end of each event, the first event begins at 0
+    unsigned long long offsets[2] = {0, 0};
+    auto const& name = iLaneInfo.dataProducts_[productIndex].name();
+    auto const sizeName = name+"_sz";
+    register_dataset_sz_read_timer_start(sizeName.c_str());
+    if(iEventIndex == 0) {
+      hdf5::read_slab(offsetDatasets_[productIndex], offsetSpaces_[productIndex], 0, 1, offsets+1);
+    } else {
+      hdf5::read_slab(offsetDatasets_[productIndex], offsetSpaces_[productIndex], iEventIndex-1, 2, offsets);
+    }
+    register_dataset_sz_read_timer_end(sizeof(offsets));
+    auto& buffer = iLaneInfo.productBuffers_[productIndex];
+    buffer.resize(offsets[1]-offsets[0]);
+    register_dataset_read_timer_start(name.c_str());
+    hdf5::read_slab(productDatasets_[productIndex], productSpaces_[productIndex], offsets[0], buffer.size(), buffer.data());
+    register_dataset_read_timer_end(buffer.size());
+  }
+}
+
+void SharedHDFSource::readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder iTask) {
+  queue_.push(*iTask.group(), [iLane, iEventIndex, optTask = std::move(iTask), this]() mutable {
+      auto start = std::chrono::high_resolution_clock::now();
+      if(iEventIndex < nEvents_) {
+        readEvent(iEventIndex, laneInfos_[iLane]);
+
+        auto group = optTask.group();
+        auto task = optTask.releaseToTaskHolder();
+        for(size_t productIndex = 0; productIndex < productDatasets_.size(); ++productIndex) {
+          group->run([this, iLane, productIndex, task]() {
+              auto& laneInfo = this->laneInfos_[iLane];
+              auto start = std::chrono::high_resolution_clock::now();
+              auto const& buffer = laneInfo.productBuffers_[productIndex];
+              auto readSize = laneInfo.deserializers_[productIndex].deserialize(buffer.data(), buffer.size(), laneInfo.dataBuffers_[productIndex]);
+              laneInfo.dataProducts_[productIndex].setSize(readSize);
+              laneInfo.deserializeTimes_[productIndex] +=
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+            });
+        }
+      }
+      readTime_ +=std::chrono::duration_cast<decltype(readTime_)>(std::chrono::high_resolution_clock::now() - start);
+    });
+}
+
+void SharedHDFSource::printSummary() const {
+  std::cout <<"\nSource:\n"
+    "   read time: "<<readTime().count()<<"us\n"
+    "   deserialize time: "<<deserializeTime().count()<<"us\n"<<std::endl;
+  print_read_timers();
+};
+
+std::chrono::microseconds SharedHDFSource::readTime() const {
+  return readTime_;
+}
+
+std::chrono::microseconds SharedHDFSource::deserializeTime() const {
+  auto time = std::chrono::microseconds::zero();
+  for(auto const& l : laneInfos_) {
+    for(auto t: l.deserializeTimes_) {
+      time += t;
+    }
+  }
+  return time;
+}
+
+
+namespace {
+    class Maker : public SourceMakerBase {
+  public:
+    Maker(): SourceMakerBase("SharedHDFSource") {}
+      std::unique_ptr<SharedSourceBase> create(unsigned int iNLanes, unsigned long long iNEvents, ConfigurationParameters const& params) const final {
+        auto fileName = params.get<std::string>("fileName");
+        if(not fileName) {
+          std::cout <<"no file name given\n";
+          return {};
+        }
+        if(params.get<bool>("h5Timing", false)) {
+          init_timers();
+        }
+        return std::make_unique<SharedHDFSource>(iNLanes, iNEvents, *fileName);
+    }
+    };
+
+  Maker s_maker;
+}
@@ -0,0 +1,89 @@
+#if !defined(SharedHDFSource_h)
+#define SharedHDFSource_h
+
+#include <string>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "SharedSourceBase.h"
+#include "DataProductRetriever.h"
+#include "DelayedProductRetriever.h"
+#include "SerialTaskQueue.h"
+#include "DeserializeStrategy.h"
+
+#include "HDFCxx.h"
+
+namespace cce::tf {
+  class SharedHDFDelayedRetriever : public DelayedProductRetriever {
+    void getAsync(DataProductRetriever&, int index, TaskHolder) final {}
+  };
+
+  /*
+   Reads the file layout written by HDFOutputer. A single file handle is shared by all lanes.
+   As HDF5 is not thread-safe, all HDF5 calls are serialized through a SerialTaskQueue while
+   the deserialization of each data product of an event is run as its own task.
+   */
+  class SharedHDFSource : public SharedSourceBase {
+  public:
+    SharedHDFSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iFileName);
+    SharedHDFSource(SharedHDFSource&&) = delete;
+    SharedHDFSource(SharedHDFSource const&) = delete;
+    ~SharedHDFSource() = default;
+
+  size_t numberOfDataProducts() const final;
+  std::vector<DataProductRetriever>& dataProducts(unsigned int iLane, long iEventIndex) final;
+  EventIdentifier eventIdentifier(unsigned int iLane, long iEventIndex) final;
+
+  void printSummary() const final;
+  private:
+
+  struct LaneInfo;
+
+  void readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder) final;
+  void readEvent(long iEventIndex, LaneInfo&);
+
+  std::chrono::microseconds readTime() const;
+  std::chrono::microseconds deserializeTime() const;
+
+  hdf5::File file_;
+  hdf5::Group lumi_;
+  hdf5::Dataset eventIDsDataset_;
+  hdf5::Dataspace eventIDsSpace_;
+  std::vector<hdf5::Dataset> productDatasets_;
+  std::vector<hdf5::Dataspace> productSpaces_;
+  std::vector<hdf5::Dataset> offsetDatasets_;
+  std::vector<hdf5::Dataspace> offsetSpaces_;
+  unsigned int run_;
+  unsigned int lumisec_;
+  long nEvents_;
+  SerialTaskQueue queue_;
+
+  struct LaneInfo {
+    LaneInfo(std::vector<std::string> const& iNames, std::vector<std::string> const& iClassNames, DeserializeStrategy);
+
+    LaneInfo(LaneInfo&&) = default;
+    LaneInfo(LaneInfo const&) = delete;
+
+    LaneInfo& operator=(LaneInfo&&) = default;
+    LaneInfo& operator=(LaneInfo const&) = delete;
+
+    EventIdentifier eventID_;
+    //filled from within queue_, the buffers are reused from event to event
+    std::vector<std::vector<char>> productBuffers_;
+    std::vector<DataProductRetriever> dataProducts_;
+    std::vector<void*> dataBuffers_;
+    DeserializeStrategy deserializers_;
+    SharedHDFDelayedRetriever delayedRetriever_;
+    //one entry per data product so concurrent deserialization tasks never share an entry
+    std::vector<std::chrono::microseconds> deserializeTimes_;
+    ~LaneInfo();
+  };
+
+  std::vector<LaneInfo> laneInfos_;
+  std::chrono::microseconds readTime_;
+  };
+}
+
+#endif
@@ -2,16 +2,19 @@
 #include "SourceFactory.h"
 #include "Deserializer.h"
 #include "UnrolledDeserializer.h"
+#include "FunctorTask.h"
 
 #include "TClass.h"
 
 using namespace cce::tf;
 
-SharedRootBatchEventsSource::SharedRootBatchEventsSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iName) :
+SharedRootBatchEventsSource::SharedRootBatchEventsSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iName, unsigned int iReadAhead) :
   SharedSourceBase(iNEvents),
   file_{TFile::Open(iName.c_str())},
   pEventIDs_(&eventIDs_),
   pOffsetsAndBuffer_(&offsetsAndBuffer_),
+  readAhead_{iReadAhead},
+  readAheadDecompressTime_{0},
   readTime_{std::chrono::microseconds::zero()}
 {
 
@@ -163,73 +166,114 @@ EventIdentifier SharedRootBatchEventsSource::eventIdentifier(unsigned int iLane,
   return laneInfos_[iLane].eventID_;
 }
 
+std::shared_ptr<SharedRootBatchEventsSource::Batch> SharedRootBatchEventsSource::readBatch(tbb::task_group& iGroup, LaneInfo& iLaneInfo) {
+  eventsTree_->GetEntry(nextEntry_++);
+
+  auto batch = std::make_shared<Batch>();
+  //ROOT refills the moved from vectors on the next GetEntry
+  batch->eventIDs_ = std::move(eventIDs_);
+  batch->offsets_ = std::move(offsetsAndBuffer_.first);
+
+  //the last entry in the offsets of an event is the uncompressed size for that event
+  const auto entriesInOffset = iLaneInfo.dataProducts_.size()+1;
+  const auto nEvents = batch->eventIDs_.size();
+  batch->eventBegins_.reserve(nEvents+1);
+  batch->eventBegins_.push_back(0);
+  for(size_t index = 0; index < nEvents; ++index) {
+    batch->eventBegins_.push_back(batch->eventBegins_.back() + batch->offsets_[(index+1)*entriesInOffset-1]);
+  }
+
+  if(readAhead_ == 0) {
+    decompress(*batch, offsetsAndBuffer_.second, iLaneInfo.decompressTime_);
+    offsetsAndBuffer_.second = std::vector<char>(); //free memory
+  } else {
+    iGroup.run([this, batch, compressed = std::move(offsetsAndBuffer_.second)]() {
+        auto time = std::chrono::microseconds::zero();
+        decompress(*batch, compressed, time);
+        readAheadDecompressTime_ += time.count();
+      });
+    offsetsAndBuffer_.second = std::vector<char>();
+  }
+  return batch;
+}
+
+void SharedRootBatchEventsSource::decompress(Batch& iBatch, std::vector<char> const& iCompressed, std::chrono::microseconds& oTime) const {
+  auto start = std::chrono::high_resolution_clock::now();
+  iBatch.buffer_ = pds::uncompressBuffer(this->compression_, iCompressed, iBatch.eventBegins_.back());
+  //std::cout <<"compressed buffer size "<<iCompressed.size() <<std::endl;
+  //std::cout <<"uncompressed buffer size "<<iBatch.buffer_.size() <<std::endl;
+  oTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+
+  std::vector<TaskHolder> waiting;
+  {
+    std::lock_guard<std::mutex> guard(iBatch.mutex_);
+    iBatch.decompressed_ = true;
+    std::swap(waiting, iBatch.waiting_);
+  }
+  //destroying the TaskHolders starts the waiting tasks
+}
+
+void SharedRootBatchEventsSource::runWhenDecompressed(Batch& iBatch, TaskHolder iTask) {
+  std::lock_guard<std::mutex> guard(iBatch.mutex_);
+  if(not iBatch.decompressed_) {
+    iBatch.waiting_.emplace_back(std::move(iTask));
+  }
+}
+
+void SharedRootBatchEventsSource::readAheadAsync(tbb::task_group& iGroup, unsigned int iLane) {
+  queue_.push(iGroup, [this, &iGroup, iLane]() {
+      auto start = std::chrono::high_resolution_clock::now();
+      while(readAheadBatches_.size() < readAhead_ and nextEntry_ < eventsTree_->GetEntries()) {
+        readAheadBatches_.push_back(readBatch(iGroup, laneInfos_[iLane]));
+      }
+      readTime_ +=std::chrono::duration_cast<decltype(readTime_)>(std::chrono::high_resolution_clock::now() - start);
+    });
+}
+
 void SharedRootBatchEventsSource::readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder iTask) {
-  //NOTE: if need future scaling performance, could move decompression out of the queue
-  // and then have multiple buffers for data read from ROOT.
   queue_.push(*iTask.group(), [iLane, optTask = std::move(iTask), this]() mutable {
       auto start = std::chrono::high_resolution_clock::now();
-      if(nextEntry_ < eventsTree_->GetEntries() or (cachedEventIndex_ < eventIDs_.size())) {
-        if(cachedEventIndex_ == eventIDs_.size()) {
-          //need to read ahead
-          eventsTree_->GetEntry(nextEntry_++);
-
-          auto start = std::chrono::high_resolution_clock::now();
-          //determine uncompressed size
-          const auto entriesInOffset = laneInfos_[iLane].dataProducts_.size()+1;
-          unsigned int summedSizes=0;
-          for(int index = 0; index < eventIDs_.size(); ++index) {
-            //the last entry in the offsets is the uncompressed size for that event
-            summedSizes += offsetsAndBuffer_.first[(index+1)*entriesInOffset-1];
-          }
-          uncompressedBuffer_ = pds::uncompressBuffer(this->compression_, offsetsAndBuffer_.second, summedSizes);
-          //std::cout <<"compressed buffer size "<<offsetsAndBuffer_.second.size() <<std::endl;
-          //std::cout <<"uncompressed buffer size "<<uncompressedBuffer_.size() <<std::endl;
-          offsetsAndBuffer_.second = std::vector<char>(); //free memory
-          laneInfos_[iLane].decompressTime_ += 
-            std::chrono::duration_cast<decltype(laneInfos_[iLane].decompressTime_)>(std::chrono::high_resolution_clock::now() - start);
-
-          cachedEventIndex_ = 0;
+      auto group = optTask.group();
+      if(not batch_ or nextEventInBatch_ == batch_->eventIDs_.size()) {
+        if(not readAheadBatches_.empty()) {
+          //the next batch is read, and possibly already decompressed, so only need to swap
+          batch_ = std::move(readAheadBatches_.front());
+          readAheadBatches_.pop_front();
+          nextEventInBatch_ = 0;
+        } else if(nextEntry_ < eventsTree_->GetEntries()) {
+          batch_ = readBatch(*group, laneInfos_[iLane]);
+          nextEventInBatch_ = 0;
         }
-        laneInfos_[iLane].eventID_ = eventIDs_[cachedEventIndex_];
-        
-        const auto entriesInOffset = laneInfos_[iLane].dataProducts_.size()+1;
-        const unsigned int indexIntoOffsets = cachedEventIndex_*entriesInOffset;
-        std::vector<uint32_t> offsets(offsetsAndBuffer_.first.begin()+indexIntoOffsets,
-                                      offsetsAndBuffer_.first.begin()+indexIntoOffsets+entriesInOffset);
-
-        unsigned int beginOffsetInBuffer = 0;
-        for(int index = 1; index <= cachedEventIndex_; ++index) {
-          beginOffsetInBuffer += offsetsAndBuffer_.first[index*entriesInOffset-1];
+        if(readAhead_ != 0) {
+          //fill the read ahead after this lane has been handed its event
+          readAheadAsync(*group, iLane);
         }
-        unsigned int endOffsetInBuffer = beginOffsetInBuffer + offsets.back();
-
-        std::vector<char> uBuffer(uncompressedBuffer_.begin()+beginOffsetInBuffer,
-                                  uncompressedBuffer_.begin()+endOffsetInBuffer);
-
-        ++cachedEventIndex_;
+      }
+      if(batch_ and nextEventInBatch_ < batch_->eventIDs_.size()) {
+        auto indexInBatch = nextEventInBatch_++;
+        laneInfos_[iLane].eventID_ = batch_->eventIDs_[indexInBatch];
         /*{
            auto const& id = this->laneInfos_[iLane].eventID_;
-          std::cout <<"event entry "<<nextEntry_-1<<" cache index "<<cachedEventIndex_-1<<std::endl;
+          std::cout <<"event entry "<<nextEntry_-1<<" batch index "<<indexInBatch<<std::endl;
           std::cout <<"ID "<<id.run<<" "<<id.lumi<<" "<<id.event<<std::endl;
-          std::cout <<"ubuffer size "<<uBuffer.size()<<std::endl;
-          std::cout <<"offset size "<<offsets.size()<<std::endl;
-          //for(auto b: buffer) {
-          //  std::cout <<"  "<<b<<std::endl;
-          //}
           }*/
 
-        auto group = optTask.group();
-        group->run([this, offsets=std::move(offsets), uBuffer = std::move(uBuffer), task = optTask.releaseToTaskHolder(), iLane]() {
+        //the task holds a reference to the batch rather than copying its part of the buffer
+        TaskHolder deserialize(*group, make_functor_task([this, batch = batch_, indexInBatch, task = optTask.releaseToTaskHolder(), iLane]() {
             auto& laneInfo = this->laneInfos_[iLane];
+            const auto entriesInOffset = laneInfo.dataProducts_.size()+1;
+            auto itOffsets = batch->offsets_.cbegin() + indexInBatch*entriesInOffset;
+            const char* eventBuffer = batch->buffer_.data() + batch->eventBegins_[indexInBatch];
+            const char* eventBufferEnd = batch->buffer_.data() + batch->eventBegins_[indexInBatch+1];
 
             auto start = std::chrono::high_resolution_clock::now();
-            //uBuffer.pop_back();
-            pds::deserializeDataProducts(uBuffer.data(), uBuffer.data()+uBuffer.size(), 
-                                         offsets.begin(), offsets.end(),
+            pds::deserializeDataProducts(eventBuffer, eventBufferEnd,
+                                         itOffsets, itOffsets+entriesInOffset,
                                          laneInfo.dataProducts_, laneInfo.deserializers_);
             laneInfo.deserializeTime_ += 
               std::chrono::duration_cast<decltype(laneInfo.deserializeTime_)>(std::chrono::high_resolution_clock::now() - start);
-          });
+          }));
+        runWhenDecompressed(*batch_, std::move(deserialize));
       }
       readTime_ +=std::chrono::duration_cast<decltype(readTime_)>(std::chrono::high_resolution_clock::now() - start);
     });
@@ -251,7 +295,7 @@ std::chrono::microseconds SharedRootBatchEventsSource::decompressTime() const {
   for(auto const& l : laneInfos_) {
     time += l.decompressTime_;
   }
-  return time;
+  return time + std::chrono::microseconds(readAheadDecompressTime_.load());
 }
 
 std::chrono::microseconds SharedRootBatchEventsSource::deserializeTime() const {
@@ -273,7 +317,8 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
-        return std::make_unique<SharedRootBatchEventsSource>(iNLanes, iNEvents, *fileName);
+        auto readAhead = params.get<unsigned int>("readAhead", 1);
+        return std::make_unique<SharedRootBatchEventsSource>(iNLanes, iNEvents, *fileName, readAhead);
     }
     };
 
@@ -6,6 +6,10 @@
 #include <chrono>
 #include <iostream>
 #include <utility>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
 
 #include "TFile.h"
 #include "TTree.h"
@@ -26,7 +30,9 @@ namespace cce::tf {
   
   class SharedRootBatchEventsSource : public SharedSourceBase {
   public:
-    SharedRootBatchEventsSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iFileName);
+    //iReadAhead is the number of batches read and decompressed in the background while the
+    // lanes still use the present batch. 0 reads and decompresses in the serial queue
+    SharedRootBatchEventsSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iFileName, unsigned int iReadAhead);
     SharedRootBatchEventsSource(SharedRootBatchEventsSource&&) = delete;
     SharedRootBatchEventsSource(SharedRootBatchEventsSource const&) = delete;
     ~SharedRootBatchEventsSource() = default;
@@ -37,8 +43,30 @@ namespace cce::tf {
 
   void printSummary() const final;
   private:
-  
+
+  struct LaneInfo;
+
+  //the decompressed events of one entry of the Events TTree. Shared with the lane tasks
+  // and released once the last of its events has been deserialized
+  struct Batch {
+    std::vector<EventIdentifier> eventIDs_;
+    //per event: the nProducts offsets followed by the uncompressed size
+    std::vector<uint32_t> offsets_;
+    //position in buffer_ of each event, one extra entry for the end
+    std::vector<size_t> eventBegins_;
+    std::vector<char> buffer_;
+
+    //tasks waiting for buffer_ to be decompressed
+    std::mutex mutex_;
+    bool decompressed_ = false;
+    std::vector<TaskHolder> waiting_;
+  };
+
   void readEventAsync(unsigned int iLane, long iEventIndex,  OptionalTaskHolder) final;
+  std::shared_ptr<Batch> readBatch(tbb::task_group&, LaneInfo&);
+  void readAheadAsync(tbb::task_group&, unsigned int iLane);
+  void decompress(Batch&, std::vector<char> const& iCompressed, std::chrono::microseconds& oTime) const;
+  static void runWhenDecompressed(Batch&, TaskHolder);
 
   std::chrono::microseconds readTime() const;
   std::chrono::microseconds decompressTime() const;
@@ -71,12 +99,15 @@ namespace cce::tf {
   };
 
   unsigned long long int nextEntry_ = 0;
-  unsigned int cachedEventIndex_ = 0;
   std::vector<EventIdentifier> eventIDs_;
   std::vector<EventIdentifier>* pEventIDs_;
   std::pair<std::vector<uint32_t>, std::vector<char>> offsetsAndBuffer_;
   std::pair<std::vector<uint32_t>, std::vector<char>>* pOffsetsAndBuffer_;
-  std::vector<char> uncompressedBuffer_;
+  std::shared_ptr<Batch> batch_;
+  size_t nextEventInBatch_ = 0;
+  unsigned int readAhead_;
+  std::deque<std::shared_ptr<Batch>> readAheadBatches_;
+  mutable std::atomic<std::chrono::microseconds::rep> readAheadDecompressTime_;
 
   std::vector<LaneInfo> laneInfos_;
   std::chrono::microseconds readTime_;
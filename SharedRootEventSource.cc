@@ -7,7 +7,7 @@
 
 using namespace cce::tf;
 
-SharedRootEventSource::SharedRootEventSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iName) :
+SharedRootEventSource::SharedRootEventSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iName, RootTreeCacheConfig const& iCacheConfig) :
                  SharedSourceBase(iNEvents),
                  file_{TFile::Open(iName.c_str())},
   readTime_{std::chrono::microseconds::zero()}
@@ -36,6 +36,7 @@ SharedRootEventSource::SharedRootEventSource(unsigned int iNLanes, unsigned long
     std::cout <<"no 'EventID' TBranch in 'Events' TTree in file "<<iName<<std::endl;
     throw std::runtime_error("no 'EventID' TBranch");
   }
+  setupTreeCache(*eventsTree_, iCacheConfig);
    
   auto meta = file_->Get<TTree>("Meta");
   if(not meta) {
@@ -207,7 +208,9 @@ void SharedRootEventSource::printSummary() const {
   std::cout <<"\nSource:\n"
     "   read time: "<<readTime().count()<<"us\n"
     "   decompress time: "<<decompressTime().count()<<"us\n"
-    "   deserialize time: "<<deserializeTime().count()<<"us\n"<<std::endl;
+    "   deserialize time: "<<deserializeTime().count()<<"us\n";
+  treeCacheStats(*eventsTree_, *file_).print(std::cout);
+  std::cout <<std::endl;
 };
 
 std::chrono::microseconds SharedRootEventSource::readTime() const {
@@ -241,7 +244,7 @@ namespace {
           std::cout <<"no file name given\n";
           return {};
         }
-        return std::make_unique<SharedRootEventSource>(iNLanes, iNEvents, *fileName);
+        return std::make_unique<SharedRootEventSource>(iNLanes, iNEvents, *fileName, parseRootTreeCacheConfig(params));
     }
     };
 
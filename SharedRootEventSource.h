@@ -12,6 +12,7 @@
 #include "TBranch.h"
 
 #include "SharedSourceBase.h"
+#include "RootTreeCache.h"
 #include "DataProductRetriever.h"
 #include "DelayedProductRetriever.h"
 #include "SerialTaskQueue.h"
@@ -26,7 +27,7 @@ namespace cce::tf {
   
   class SharedRootEventSource : public SharedSourceBase {
   public:
-    SharedRootEventSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iFileName);
+    SharedRootEventSource(unsigned int iNLanes, unsigned long long iNEvents, std::string const& iFileName, RootTreeCacheConfig const&);
     SharedRootEventSource(SharedRootEventSource&&) = delete;
     SharedRootEventSource(SharedRootEventSource const&) = delete;
     ~SharedRootEventSource() = default;
@@ -8,8 +8,8 @@
 
 using namespace cce::tf;
 
-TestProductsOutputer::TestProductsOutputer(unsigned int iNLanes, int iNProducts):
-  retrieverPerLane_(iNLanes), nProducts_(iNProducts) {}
+TestProductsOutputer::TestProductsOutputer(unsigned int iNLanes, int iNProducts, bool iCheckOrder, unsigned long long iExpectedEvents):
+  retrieverPerLane_(iNLanes), nProducts_(iNProducts), checkOrder_(iCheckOrder), expectedEvents_(iExpectedEvents) {}
 
 void TestProductsOutputer::setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const& iRetrievers) {
   retrieverPerLane_[iLaneIndex] = &iRetrievers;
@@ -31,6 +31,13 @@ void TestProductsOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier
     std::cout<<"ERROR: wrong number of data products, expected 2 but see "<<retrievers.size() <<std::endl;
     abort();
   }
+  if(checkOrder_) {
+    auto last = lastEvent_.exchange(iEventID.event);
+    if(iEventID.event <= last) {
+      std::cout <<"ERROR: event "<<iEventID.event<<" came after event "<<last<<std::endl;
+      abort();
+    }
+  }
   auto const index = iEventID.event -1;
   for(auto const& prod: retrievers) {
     if(prod.name() == "ints") {
@@ -63,10 +70,15 @@ void TestProductsOutputer::outputAsync(unsigned int iLaneIndex, EventIdentifier
     }
   }
 
+  ++nEvents_;
   iCallback.doneWaiting();
 }
 
 void TestProductsOutputer::printSummary() const {
+  if(expectedEvents_ != 0 and nEvents_.load() != expectedEvents_) {
+    std::cout <<"ERROR: saw "<<nEvents_.load()<<" events but expected "<<expectedEvents_<<std::endl;
+    abort();
+  }
   std::cout <<"\nOutputer time: N/A"<<std::endl;
 }
 
@@ -75,7 +87,7 @@ namespace {
   public:
     TestProductsMaker(): OutputerMakerBase("TestProductsOutputer") {}
     std::unique_ptr<OutputerBase> create(unsigned int iNLanes, ConfigurationParameters const& params) const final {
-      return std::make_unique<TestProductsOutputer>(iNLanes, params.get<int>("nProducts",2));
+      return std::make_unique<TestProductsOutputer>(iNLanes, params.get<int>("nProducts",2), params.get<bool>("checkOrder",false), params.get<std::size_t>("expectedEvents",0));
     }
     };
 
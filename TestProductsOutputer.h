@@ -1,12 +1,16 @@
 #if !defined(TestProductsOutputer_h)
 #define TestProductsOutputer_h
 #include "OutputerBase.h"
+#include <atomic>
 
 namespace cce::tf {
 
 class TestProductsOutputer : public OutputerBase {
  public:
-  TestProductsOutputer(unsigned int iNLanes, int nProducts);
+  //iCheckOrder requires the event numbers to strictly increase from one call of outputAsync to the
+  // next. This is only meaningful when running with 1 lane.
+  //iExpectedEvents, if not 0, is the number of events which must have been seen by the end of the job.
+  TestProductsOutputer(unsigned int iNLanes, int nProducts, bool iCheckOrder, unsigned long long iExpectedEvents);
   void setupForLane(unsigned int iLaneIndex, std::vector<DataProductRetriever> const&) final;
   void productReadyAsync(unsigned int iLaneIndex, DataProductRetriever const&, TaskHolder iCallback) const final;
   bool usesProductReadyAsync() const final;
@@ -18,6 +22,10 @@ class TestProductsOutputer : public OutputerBase {
  private:
   std::vector<std::vector<DataProductRetriever> const*> retrieverPerLane_;
   int nProducts_;
+  bool checkOrder_;
+  mutable std::atomic<unsigned long long> lastEvent_ = 0;
+  unsigned long long expectedEvents_;
+  mutable std::atomic<unsigned long long> nEvents_ = 0;
 };
 }
 #endif
@@ -0,0 +1,175 @@
+#include "TimerService.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace cce::tf;
+
+TimerService::TimerService(std::chrono::microseconds iResolution):
+  start_{clock::now()},
+  resolution_{std::max(iResolution, std::chrono::microseconds(1))},
+  thread_{[this]() { run(); }}
+{}
+
+TimerService::~TimerService() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_one();
+  thread_.join();
+}
+
+std::uint64_t TimerService::toTick(clock::time_point iTime) const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(iTime - start_).count()/resolution_.count();
+}
+
+TimerService::clock::time_point TimerService::toTime(std::uint64_t iTick) const {
+  return start_ + iTick*resolution_;
+}
+
+void TimerService::releaseAfter(std::chrono::microseconds iDelay, TaskHolder iCallback) {
+  if(iDelay.count() <= 0) {
+    return;
+  }
+  std::call_once(arenaFlag_, [this]() { arena_ = std::make_unique<tbb::task_arena>(tbb::task_arena::attach()); });
+
+  auto now = clock::now();
+  //round up so the callback is never released before the deadline
+  auto sinceStart = std::chrono::duration_cast<std::chrono::microseconds>(now - start_) + iDelay;
+  std::uint64_t expiration = (sinceStart.count() + resolution_.count() - 1)/resolution_.count();
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if(0 == nPending_) {
+      //the wheel is empty so there is nothing to cascade when jumping ahead
+      current_ = std::max(current_, toTick(now));
+    }
+    wake = expiration < wakeTick_;
+    insert(Entry{expiration, std::move(iCallback)});
+    ++nPending_;
+  }
+  if(wake) {
+    condition_.notify_one();
+  }
+}
+
+void TimerService::insert(Entry iEntry) {
+  auto expiration = std::max(iEntry.expiration_, current_);
+  iEntry.expiration_ = expiration;
+  auto delta = expiration - current_;
+  if(delta < kLevel0Size) {
+    level0_[expiration & (kLevel0Size-1)].push_back(std::move(iEntry));
+    return;
+  }
+  if(delta >= kMaxTicks) {
+    //park in the furthest slot, it will be re-inserted when that slot is cascaded
+    expiration = current_ + kMaxTicks - 1;
+    delta = kMaxTicks - 1;
+  }
+  for(unsigned int level = 0; level < kNLevels-1; ++level) {
+    auto shift = kLevel0Bits + level*kLevelNBits;
+    if(delta < (std::uint64_t(1) << (shift + kLevelNBits))) {
+      levels_[level][(expiration >> shift) & (kLevelNSize-1)].push_back(std::move(iEntry));
+      return;
+    }
+  }
+}
+
+void TimerService::cascade() {
+  for(unsigned int level = 0; level < kNLevels-1; ++level) {
+    auto index = (current_ >> (kLevel0Bits + level*kLevelNBits)) & (kLevelNSize-1);
+    Slot slot;
+    std::swap(slot, levels_[level][index]);
+    for(auto& e: slot) {
+      insert(std::move(e));
+    }
+    if(index != 0) {
+      break;
+    }
+  }
+}
+
+void TimerService::advanceTo(std::uint64_t iTick, std::vector<Entry>& oExpired) {
+  while(current_ <= iTick) {
+    auto index = current_ & (kLevel0Size-1);
+    if(index == 0) {
+      cascade();
+    }
+    auto& slot = level0_[index];
+    nPending_ -= slot.size();
+    std::move(slot.begin(), slot.end(), std::back_inserter(oExpired));
+    slot.clear();
+    ++current_;
+  }
+}
+
+void TimerService::drain(std::vector<Entry>& oExpired) {
+  auto drainSlot = [&oExpired](Slot& iSlot) {
+    std::move(iSlot.begin(), iSlot.end(), std::back_inserter(oExpired));
+    iSlot.clear();
+  };
+  for(auto& slot: level0_) {
+    drainSlot(slot);
+  }
+  for(auto& level: levels_) {
+    for(auto& slot: level) {
+      drainSlot(slot);
+    }
+  }
+  nPending_ = 0;
+}
+
+std::uint64_t TimerService::nextTickToCheck() const {
+  if( (current_ & (kLevel0Size-1)) == 0) {
+    //must cascade before looking at level 0
+    return current_;
+  }
+  auto endOfRotation = (current_ | (kLevel0Size-1)) + 1;
+  for(auto tick = current_; tick < endOfRotation; ++tick) {
+    if(not level0_[tick & (kLevel0Size-1)].empty()) {
+      return tick;
+    }
+  }
+  return endOfRotation;
+}
+
+void TimerService::release(std::vector<Entry>& iExpired) {
+  for(auto& e: iExpired) {
+    //The callback is released when the functor is destroyed by the arena's worker thread.
+    // This assures TaskHolder::doneWaiting spawns into the proper arena.
+    arena_->enqueue([callback = std::move(e.callback_)]() {});
+  }
+  iExpired.clear();
+}
+
+void TimerService::run() {
+  std::vector<Entry> expired;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    if(stop_ and 0 != nPending_) {
+      //release everything still waiting
+      drain(expired);
+    }
+    if(0 == nPending_ and expired.empty()) {
+      if(stop_) {
+        break;
+      }
+      wakeTick_ = std::numeric_limits<std::uint64_t>::max();
+      condition_.wait(lock, [this]() { return stop_ or 0 != nPending_; });
+      continue;
+    }
+    auto now = toTick(clock::now());
+    if(now >= current_) {
+      advanceTo(now, expired);
+    }
+    if(not expired.empty()) {
+      lock.unlock();
+      release(expired);
+      lock.lock();
+      continue;
+    }
+    wakeTick_ = nextTickToCheck();
+    condition_.wait_until(lock, toTime(wakeTick_));
+  }
+}
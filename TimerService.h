@@ -0,0 +1,79 @@
+#if !defined(TimerService_h)
+#define TimerService_h
+
+#include <vector>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+
+#include "tbb/task_arena.h"
+#include "TaskHolder.h"
+
+namespace cce::tf {
+  /*
+   Holds TaskHolders until their deadline has passed without using a TBB worker thread.
+   A dedicated thread keeps the pending deadlines in a hierarchical timer wheel. Once a deadline
+   expires, the TaskHolder is handed back to the task_arena of the thread which first called
+   releaseAfter so the waiting task is run by the arena's workers.
+   */
+  class TimerService {
+  public:
+    explicit TimerService(std::chrono::microseconds iResolution = std::chrono::microseconds(10));
+    ~TimerService();
+
+    TimerService(TimerService const&) = delete;
+    TimerService& operator=(TimerService const&) = delete;
+
+    //Must be called from within the task_arena running the TaskHolder's tasks
+    void releaseAfter(std::chrono::microseconds iDelay, TaskHolder iCallback);
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct Entry {
+      std::uint64_t expiration_;
+      TaskHolder callback_;
+    };
+    using Slot = std::vector<Entry>;
+
+    static constexpr unsigned int kLevel0Bits = 8;
+    static constexpr unsigned int kLevelNBits = 6;
+    static constexpr unsigned int kNLevels = 4;
+    static constexpr std::uint64_t kLevel0Size = 1 << kLevel0Bits;
+    static constexpr std::uint64_t kLevelNSize = 1 << kLevelNBits;
+    static constexpr std::uint64_t kMaxTicks = std::uint64_t(1) << (kLevel0Bits + (kNLevels-1)*kLevelNBits);
+
+    std::uint64_t toTick(clock::time_point iTime) const;
+    clock::time_point toTime(std::uint64_t iTick) const;
+
+    void insert(Entry iEntry);
+    void cascade();
+    void advanceTo(std::uint64_t iTick, std::vector<Entry>& oExpired);
+    void drain(std::vector<Entry>& oExpired);
+    std::uint64_t nextTickToCheck() const;
+    void release(std::vector<Entry>& iExpired);
+    void run();
+
+    const clock::time_point start_;
+    const std::chrono::microseconds resolution_;
+
+    std::array<Slot, kLevel0Size> level0_;
+    std::array<std::array<Slot, kLevelNSize>, kNLevels-1> levels_;
+    std::uint64_t current_ = 0;
+    std::size_t nPending_ = 0;
+    std::uint64_t wakeTick_ = 0;
+    bool stop_ = false;
+
+    std::once_flag arenaFlag_;
+    std::unique_ptr<tbb::task_arena> arena_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread thread_;
+  };
+}
+#endif
@@ -4,15 +4,10 @@ static int hdf5_method_g = -1;
 static int total_n_events_g = -1;
 static int initialized = 0;
 
-static std::map<std::string, multidataset_array*> multi_datasets;
-
 int init_multidataset() {
     if ( initialized ) {
         return 0;
     }
-#ifdef H5_TIMING_ENABLE
-    init_timers();
-#endif
     char *p = getenv("HEP_IO_TYPE");
     if ( p != NULL ) {
         set_hdf5_method(atoi(p));
@@ -23,25 +18,15 @@ int init_multidataset() {
     return 0;
 }
 
-int finalize_multidataset() {
-    int i, j;
-    std::map<std::string, multidataset_array*>::iterator it;
-    std::vector<char*>::iterator it2;
+/* closes the dataset handles, pending requests which were not flushed are dropped */
+int finalize_multidataset(multidataset_map& multi_datasets) {
+    multidataset_map::iterator it;
     for ( it = multi_datasets.begin(); it != multi_datasets.end(); ++it ) {
-        for ( it2 = it->second->temp_mem->begin(); it2 != it->second->temp_mem->end(); ++it2 ) {
-            free(*it2);
+        if (it->second.did != -1) {
+            H5Dclose(it->second.did);
         }
-        if (it->second->did != -1) {
-            H5Dclose(it->second->did);
-        }
-	delete it->second->start;
-	delete it->second->end;
-	delete it->second->temp_mem;
-        free(it->second);
     }
-#ifdef H5_TIMING_ENABLE
-    finalize_timers();
-#endif
+    multi_datasets.clear();
     return 0;
 }
 
@@ -54,12 +39,23 @@ int get_hdf5_method() {
     return hdf5_method_g;
 }
 
-static hid_t get_dataset_id(const char* name, hid_t gid) {
+/* The dataset handle is opened on first use and kept until finalize_multidataset.
+   Appends continue from the present end of the dataset. */
+static multidataset_array& get_dataset(multidataset_map& multi_datasets, const char* name, hid_t gid) {
     std::string s(name);
-    if ( multi_datasets.find(s) == multi_datasets.end()) {
-        multi_datasets[s]->did = H5Dopen2(gid, name, H5P_DEFAULT);
+    multidataset_map::iterator it = multi_datasets.find(s);
+    if ( it == multi_datasets.end()) {
+        hsize_t dims[1] = {0};
+        multidataset_array multi_dataset;
+        multi_dataset.did = H5Dopen2(gid, name, H5P_DEFAULT);
+        hid_t dsid = H5Dget_space(multi_dataset.did);
+        H5Sget_simple_extent_dims(dsid, dims, NULL);
+        H5Sclose(dsid);
+        multi_dataset.last_end = dims[0];
+        multi_dataset.mtype = -1;
+        it = multi_datasets.emplace(s, std::move(multi_dataset)).first;
     }
-    return multi_datasets[s]->did;
+    return it->second;
 }
 
 static int wrap_hdf5_spaces(int total_requests, hsize_t *start, hsize_t *end, hid_t did, hid_t* dsid_ptr, hid_t *msid_ptr) {
@@ -73,7 +69,7 @@ static int wrap_hdf5_spaces(int total_requests, hsize_t *start, hsize_t *end, hi
 
     dsid = H5Dget_space(did);
     H5Sget_simple_extent_dims(dsid, old_dims, max_dims);
-    
+
     max_offset = end[0];
     for ( i = 1; i < total_requests; ++i ) {
         if ( max_offset < end[i] ) {
@@ -103,203 +99,110 @@ static int wrap_hdf5_spaces(int total_requests, hsize_t *start, hsize_t *end, hi
     return 0;
 }
 
-int register_multidataset_request(const char *name, hid_t gid, void *buf, hsize_t start, hsize_t end, hid_t mtype) {
-    std::string s(name);
-    char *temp_mem;
+int register_multidataset_request(multidataset_map& multi_datasets, const char *name, hid_t gid, void *buf, hsize_t start, hsize_t end, hid_t mtype) {
     size_t esize = H5Tget_size (mtype) * (end - start);
-    std::map<std::string, multidataset_array*>::iterator it;
+    multidataset_array& multi_dataset = get_dataset(multi_datasets, name, gid);
 
-    it = multi_datasets.find(s);
-    if ( it == multi_datasets.end()) {
-        multidataset_array *multi_dataset = (multidataset_array *) malloc(sizeof(multidataset_array));
-	multi_dataset->start = new std::vector<hsize_t>;
-	multi_dataset->end =new std::vector<hsize_t>;
-	multi_dataset->temp_mem = new std::vector<char*>;
-        multi_datasets[s] = multi_dataset;
-	it = multi_datasets.find(s);
-	it->second->did = -1;
-    }
-    if (it->second->did == -1 ) {
-        it->second->did = H5Dopen2(gid, name, H5P_DEFAULT);
-    }
-    it->second->start->push_back(start);
-    it->second->end->push_back(end);
-    temp_mem = (char*) malloc(esize);
-    it->second->temp_mem->push_back(temp_mem);
-    memcpy(temp_mem, buf, esize);
-    it->second->last_end = end;
-    it->second->mtype = mtype;
+    multi_dataset.start.push_back(start);
+    multi_dataset.end.push_back(end);
+    multi_dataset.buffer.insert(multi_dataset.buffer.end(), (char*) buf, (char*) buf + esize);
+    multi_dataset.last_end = end;
+    multi_dataset.mtype = mtype;
 
     return 0;
 }
 
-int register_multidataset_request_append(const char *name, hid_t gid, void *buf, hsize_t data_size, hid_t mtype) {
-    std::string s(name);
-    std::map<std::string, multidataset_array*>::iterator it;
-    hsize_t start, end;
-    it = multi_datasets.find(s);
-    if ( it != multi_datasets.end() ){
-        start = it->second->last_end;
-        end = it->second->last_end + data_size;
-    } else {
-        start = 0;
-        end = data_size;
-    }
-    register_multidataset_request(name, gid, buf, start, end, mtype);
+int register_multidataset_request_append(multidataset_map& multi_datasets, const char *name, hid_t gid, void *buf, hsize_t data_size, hid_t mtype) {
+    hsize_t start = get_dataset(multi_datasets, name, gid).last_end;
+    register_multidataset_request(multi_datasets, name, gid, buf, start, start + data_size, mtype);
     return 0;
 }
 
-static int merge_requests(std::vector<hsize_t> *start, std::vector<hsize_t> *end, int request_size, std::vector<char*> *buf, hsize_t **new_start, hsize_t **new_end, char** new_buf, hid_t mtype, int *request_size_ptr) {
-    int i, index;
-    int merged_requests = request_size;
-    char* ptr;
-    size_t esize = H5Tget_size (mtype);
-    size_t total_data_size = end[0][0] - start[0][0];
-
-    for ( i = 1; i < request_size; ++i ) {
-        total_data_size += end[0][i] - start[0][i];
-        if ( end[0][i-1] == start[0][i] ) {
-            merged_requests--;
+/* The buffer already holds the requests back to back so only the
+   file ranges of contiguous requests need to be combined. */
+static int merge_requests(std::vector<hsize_t> const& start, std::vector<hsize_t> const& end, std::vector<hsize_t>& new_start, std::vector<hsize_t>& new_end) {
+    size_t i;
+    new_start.clear();
+    new_end.clear();
+    new_start.push_back(start[0]);
+    new_end.push_back(end[0]);
+    for ( i = 1; i < start.size(); ++i ) {
+        if ( new_end.back() == start[i] ) {
+            new_end.back() = end[i];
+        } else {
+            new_start.push_back(start[i]);
+            new_end.push_back(end[i]);
         }
     }
-
-    *new_start = (hsize_t*) malloc(sizeof(hsize_t) * merged_requests * 2);
-    *new_end = new_start[0] + merged_requests;
-
-    index = 0;
-    new_start[0][0] = start[0][0];
-    new_end[0][0] = end[0][0];
-
-    *new_buf = (char*) malloc(esize * total_data_size);
-    ptr = *new_buf;
-    memcpy(ptr, buf[0][0], (end[0][0] - start[0][0]) * esize);
-    ptr += (end[0][0] - start[0][0]) * esize;
-    free(buf[0][0]);
-    for ( i = 1; i < request_size; ++i ) {
-        memcpy(ptr, buf[0][i], (end[0][i] - start[0][i]) * esize);
-        ptr += (end[0][i] - start[0][i]) * esize;
-        free(buf[0][i]);
-
-        if ( end[0][i-1] < start[0][i] ) {
-            index++;
-            new_start[0][index] = start[0][i];
-        }
-        new_end[0][index] = end[0][i];
-    }
-    *request_size_ptr = merged_requests;
     return 0;
 }
 
-int flush_multidatasets() {
-    int i;
-    size_t esize;
-    hsize_t dims[H5S_MAX_RANK], mdims[H5S_MAX_RANK];
-    H5D_rw_multi_t *multi_datasets_temp;
-    hsize_t *new_start, *new_end;
-    int new_request_size;
+int flush_multidatasets(multidataset_map& multi_datasets) {
+    std::vector<hsize_t> new_start, new_end;
     hid_t msid, dsid;
-    int dataset_size = multi_datasets.size();
-    std::map<std::string, multidataset_array*>::iterator it;
-    char **temp_buf = (char**) malloc(sizeof(char*) * dataset_size);
-#ifdef H5_TIMING_ENABLE
+    multidataset_map::iterator it;
     double start_time;
-#endif
-    i = 0;
-    //printf("Rank %d number of datasets to be written %d\n", rank, dataset_size);
 #if ENABLE_MULTIDATASET==1
-    #ifdef H5_TIMING_ENABLE
-    increment_H5Dwrite();
-    #endif
-    multi_datasets_temp = (H5D_rw_multi_t*) malloc(sizeof(H5D_rw_multi_t) * dataset_size);
+    std::vector<hid_t> dset_ids, mem_type_ids, mem_space_ids, file_space_ids;
+    std::vector<const void*> bufs;
+    dset_ids.reserve(multi_datasets.size());
+    mem_type_ids.reserve(multi_datasets.size());
+    mem_space_ids.reserve(multi_datasets.size());
+    file_space_ids.reserve(multi_datasets.size());
+    bufs.reserve(multi_datasets.size());
     for ( it = multi_datasets.begin(); it != multi_datasets.end(); ++it ) {
-        if (it->second->did == -1) {
-	    i++;
+        if (it->second.start.empty()) {
             continue;
         }
-
-        //MPI_Barrier(MPI_COMM_WORLD);
-        #ifdef H5_TIMING_ENABLE
         increment_H5Dwrite();
-        #endif
-
-        merge_requests(it->second->start, it->second->end, it->second->start->size(), it->second->temp_mem, &new_start, &new_end, &(temp_buf[i]), it->second->mtype, &new_request_size);
-        multi_datasets_temp[i].dset_id = it->second->did;
-        multi_datasets_temp[i].mem_type_id = it->second->mtype;
-        multi_datasets_temp[i].u.wbuf = temp_buf[i];
-
-        wrap_hdf5_spaces(new_request_size, new_start, new_end, it->second->did, &(multi_datasets_temp[i].dset_space_id), &(multi_datasets_temp[i].mem_space_id));
-	i++;
+        register_timer_start(&start_time);
+        merge_requests(it->second.start, it->second.end, new_start, new_end);
+        register_merge_requests_timer_end(start_time);
+        register_timer_start(&start_time);
+        wrap_hdf5_spaces(new_start.size(), new_start.data(), new_end.data(), it->second.did, &dsid, &msid);
+        register_wrap_requests_timer_end(start_time);
+        dset_ids.push_back(it->second.did);
+        mem_type_ids.push_back(it->second.mtype);
+        mem_space_ids.push_back(msid);
+        file_space_ids.push_back(dsid);
+        bufs.push_back(it->second.buffer.data());
     }
 
-    H5Dwrite_multi(H5P_DEFAULT, dataset_size, multi_datasets_temp);
-
-    for ( it = multi_datasets.begin(); it != multi_datasets.end(); ++it ) {
-        if (it->second->did == -1) {
-            continue;
-        }
-        H5Sclose(multi_datasets_temp[i].dset_space_id);
-        H5Sclose(multi_datasets_temp[i].mem_space_id);
-        H5Dclose(multi_datasets_temp[i].dset_id);
-	delete it->second->start;
-	delete it->second->end;
-	delete it->second->temp_mem;
-        free(temp_buf[i]);
+    if ( not dset_ids.empty() ) {
+        register_timer_start(&start_time);
+        H5Dwrite_multi(dset_ids.size(), dset_ids.data(), mem_type_ids.data(), mem_space_ids.data(), file_space_ids.data(), H5P_DEFAULT, bufs.data());
+        register_H5Dwrite_timer_end(start_time);
     }
 
-    free(multi_datasets_temp);
+    for ( size_t i = 0; i < dset_ids.size(); ++i ) {
+        H5Sclose(file_space_ids[i]);
+        H5Sclose(mem_space_ids[i]);
+    }
 #else
-    //printf("rank %d has dataset_size %lld\n", rank, (long long int) dataset_size);
     for ( it = multi_datasets.begin(); it != multi_datasets.end(); ++it ) {
-        if (it->second->did == -1) {
-	    i++;
+        if (it->second.start.empty()) {
             continue;
         }
-        #ifdef H5_TIMING_ENABLE
         increment_H5Dwrite();
-
-        #endif
-#ifdef H5_TIMING_ENABLE
         register_timer_start(&start_time);
-#endif
-        merge_requests(it->second->start, it->second->end, it->second->start->size(), it->second->temp_mem, &new_start, &new_end, temp_buf + i, it->second->mtype, &new_request_size);
-
-#ifdef H5_TIMING_ENABLE
+        merge_requests(it->second.start, it->second.end, new_start, new_end);
         register_merge_requests_timer_end(start_time);
-#endif
-#ifdef H5_TIMING_ENABLE
         register_timer_start(&start_time);
-#endif
-        wrap_hdf5_spaces(new_request_size, new_start, new_end, it->second->did, &dsid, &msid);
-#ifdef H5_TIMING_ENABLE
+        wrap_hdf5_spaces(new_start.size(), new_start.data(), new_end.data(), it->second.did, &dsid, &msid);
         register_wrap_requests_timer_end(start_time);
-#endif
-
-#ifdef H5_TIMING_ENABLE
         register_timer_start(&start_time);
-#endif
-        H5Dwrite (it->second->did, it->second->mtype, msid, dsid, H5P_DEFAULT, temp_buf[i]);
-#ifdef H5_TIMING_ENABLE
+        H5Dwrite (it->second.did, it->second.mtype, msid, dsid, H5P_DEFAULT, it->second.buffer.data());
         register_H5Dwrite_timer_end(start_time);
-#endif
 
         H5Sclose(dsid);
         H5Sclose(msid);
-#ifdef H5_TIMING_ENABLE
-        register_timer_start(&start_time);
-#endif
-        H5Dclose(it->second->did);
-#ifdef H5_TIMING_ENABLE
-        register_H5Dclose_timer_end(start_time);
-#endif
-	delete it->second->start;
-	delete it->second->end;
-	delete it->second->temp_mem;
-        free(temp_buf[i]);
-	i++;
     }
 #endif
-    multi_datasets.clear();
+    for ( it = multi_datasets.begin(); it != multi_datasets.end(); ++it ) {
+        it->second.start.clear();
+        it->second.end.clear();
+        it->second.buffer.clear();
+    }
 
-    free(temp_buf);
     return 0;
 }
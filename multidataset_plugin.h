@@ -4,39 +4,40 @@
 //#include <mpi.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
+#include <map>
+#include <string>
 #include "hdf5.h"
 #include "H5Timing.h"
-#define ENABLE_MULTIDATASET 0
-#define MULTIDATASET_DEFINE 1
 
-#if MULTIDATASET_DEFINE == 1
-typedef struct H5D_rw_multi_t
-{
-    hid_t dset_id;          /* dataset ID */
-    hid_t dset_space_id;    /* dataset selection dataspace ID */
-    hid_t mem_type_id;      /* memory datatype ID */
-    hid_t mem_space_id;     /* memory selection dataspace ID */
-    union {
-        void *rbuf;         /* pointer to read buffer */
-        const void *wbuf;   /* pointer to write buffer */
-    } u;
-} H5D_rw_multi_t;
+/* H5Dwrite_multi first appeared in HDF5 1.14. Older versions write each
+   dataset in turn while keeping the dataset handles open between flushes. */
+#if H5_VERSION_GE(1,14,0)
+#define ENABLE_MULTIDATASET 1
+#else
+#define ENABLE_MULTIDATASET 0
 #endif
 
 typedef struct multidataset_array {
-    std::vector<hsize_t> *start;
-    std::vector<hsize_t> *end;
+    std::vector<hsize_t> start;
+    std::vector<hsize_t> end;
     hsize_t last_end;
     hid_t did;
     hid_t mtype;      /* memory datatype ID */
-    std::vector<char*> *temp_mem;
+    /* the data of all requests since the last flush, in request order.
+       Cleared but not released by a flush so the memory is reused. */
+    std::vector<char> buffer;
 } multidataset_array;
 
+/* the open datasets of one file with their pending requests, keyed by dataset name.
+   Each writer of a file owns one so handles are never shared between files. */
+typedef std::map<std::string, multidataset_array> multidataset_map;
+
 int set_hdf5_method(int hdf5_method);
 int get_hdf5_method();
 int init_multidataset();
-int finalize_multidataset();
-int register_multidataset_request_append(const char *name, hid_t gid, void *buf, hsize_t data_size, hid_t mtype);
-int flush_multidatasets();
+int finalize_multidataset(multidataset_map& multi_datasets);
+int register_multidataset_request_append(multidataset_map& multi_datasets, const char *name, hid_t gid, void *buf, hsize_t data_size, hid_t mtype);
+int flush_multidatasets(multidataset_map& multi_datasets);
 //int check_write_status();
 #endif
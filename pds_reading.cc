@@ -233,10 +233,14 @@ void pds::deserializeDataProducts(buffer_iterator it, buffer_iterator itEnd, std
 
 
 std::vector<char> pds::uncompressBuffer(pds::Compression compression, std::vector<char> const& buffer, uint32_t uncompressedBufferSize) {
+  return uncompressBuffer(compression, buffer.data(), buffer.size(), uncompressedBufferSize);
+}
+
+std::vector<char> pds::uncompressBuffer(pds::Compression compression, const char* buffer, size_t bufferSize, uint32_t uncompressedBufferSize) {
   std::vector<char> uBuffer(size_t(uncompressedBufferSize), 0);
   if(Compression::kLZ4 == compression) {
-    auto size = LZ4_decompress_safe(&(*(buffer.begin())), uBuffer.data(),
-                                    buffer.size(),
+    auto size = LZ4_decompress_safe(buffer, uBuffer.data(),
+                                    bufferSize,
                                     uncompressedBufferSize);
     if(size != uncompressedBufferSize) {
       if(size > 0) {
@@ -247,10 +251,10 @@ std::vector<char> pds::uncompressBuffer(pds::Compression compression, std::vecto
     }
     assert(size == uncompressedBufferSize);
   } else if(Compression::kZSTD == compression) {
-    ZSTD_decompress(uBuffer.data(), uncompressedBufferSize, &(*(buffer.begin())), buffer.size());
+    ZSTD_decompress(uBuffer.data(), uncompressedBufferSize, buffer, bufferSize);
   } else if(Compression::kNone == compression) {
-    assert(buffer.size() == uBuffer.size());
-    std::copy(buffer.begin(), buffer.begin()+buffer.size(), uBuffer.begin());
+    assert(bufferSize == uBuffer.size());
+    std::copy(buffer, buffer+bufferSize, uBuffer.begin());
   }
   return uBuffer;
 }
@@ -39,6 +39,7 @@ namespace cce::tf::pds {
   void deserializeDataProducts(std::vector<uint32_t>::const_iterator, std::vector<uint32_t>::const_iterator, std::vector<DataProductRetriever>&, DeserializeStrategy const&);
 
   std::vector<char> uncompressBuffer(pds::Compression, std::vector<char> const& buffer, uint32_t uncompressedSize);
+  std::vector<char> uncompressBuffer(pds::Compression, const char* buffer, size_t bufferSize, uint32_t uncompressedSize);
   void deserializeDataProducts(const char* iBufferBegin, const char* iBufferEnd, 
                                std::vector<uint32_t>::const_iterator itTableBegin, std::vector<uint32_t>::const_iterator itTableEnd, 
                                std::vector<DataProductRetriever>&, DeserializeStrategy const&);
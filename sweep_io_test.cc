@@ -0,0 +1,406 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <regex>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "CLI11.hpp"
+
+#include "configKeyValuePairs.h"
+
+//Drives many fresh-process invocations of threaded_io_test over a grid of
+// configurations and records the results of each run as one row of a CSV file.
+
+namespace {
+  struct GridPoint {
+    std::string source;
+    std::string outputer;
+    std::string waiter;
+    int nThreads;
+    int nLanes; //0 means use the number of threads
+  };
+
+  struct RunResult {
+    int exitStatus = -1;
+    long long wallTime = 0; //us
+    long long nEvents = 0;
+    long long peakRSS = 0; //kB
+    long long outputBytes = -1;
+    std::map<std::string, long long> componentTimes; //us
+  };
+
+  //appends each value of a comma separated 'key=v1,v2,...' option to every configuration
+  std::vector<std::string> expandOptions(std::vector<std::string> const& iConfigs, std::vector<std::string> const& iOptions) {
+    std::vector<std::string> configs = iConfigs;
+    for(auto const& option: iOptions) {
+      auto eq = option.find('=');
+      if(eq == std::string::npos) {
+        throw std::runtime_error("option '"+option+"' is not of the form key=v1,v2,...");
+      }
+      auto key = option.substr(0,eq);
+      std::vector<std::string> values;
+      std::istringstream s(option.substr(eq+1));
+      std::string v;
+      while(std::getline(s, v, ',')) {
+        values.push_back(v);
+      }
+      std::vector<std::string> newConfigs;
+      newConfigs.reserve(configs.size()*values.size());
+      for(auto const& c: configs) {
+        auto separator = (c.find_first_of("=:") == std::string::npos) ? '=' : ':';
+        for(auto const& v: values) {
+          newConfigs.push_back(c+separator+key+"="+v);
+        }
+      }
+      configs = std::move(newConfigs);
+    }
+    return configs;
+  }
+
+  std::string componentOptions(std::string const& iConfig) {
+    auto found = iConfig.find_first_of("=:");
+    if(found == std::string::npos) {
+      return std::string();
+    }
+    return iConfig.substr(found+1);
+  }
+
+  long long outputFileSize(std::string const& iOutputerConfig) {
+    auto keyValues = cce::tf::configKeyValuePairs(componentOptions(iOutputerConfig));
+    auto itFound = keyValues.find("fileName");
+    if(itFound == keyValues.end()) {
+      return -1;
+    }
+    std::error_code ec;
+    auto size = std::filesystem::file_size(itFound->second, ec);
+    if(ec) {
+      return -1;
+    }
+    return size;
+  }
+
+  //Times are reported as '<label>: <value>us'. Indented labels belong to the
+  // component named at the start of the last unindented line.
+  void parseSummary(std::string const& iOutput, RunResult& oResult) {
+    static const std::regex timeLine(R"(^(\s*)([^:]+):\s*(-?\d+)us\s*$)");
+    static const std::regex eventsLine(R"(^number events:\s*(-?\d+)\s*$)");
+    std::istringstream s(iOutput);
+    std::string line;
+    std::string header;
+    bool inSummary = false;
+    while(std::getline(s, line)) {
+      if(line == "----------") {
+        inSummary = true;
+        continue;
+      }
+      if(not inSummary or line.empty()) {
+        continue;
+      }
+      std::smatch match;
+      if(std::regex_match(line, match, eventsLine)) {
+        oResult.nEvents = std::stoll(match[1]);
+        continue;
+      }
+      bool indented = std::isspace(static_cast<unsigned char>(line[0]));
+      if(not indented) {
+        header = line.substr(0, line.find_first_of(" :"));
+      }
+      if(std::regex_match(line, match, timeLine)) {
+        std::string label = match[2];
+        if(label == "Event processing time") {
+          oResult.wallTime = std::stoll(match[3]);
+          continue;
+        }
+        if(indented and not header.empty()) {
+          label = header+" "+label;
+        }
+        oResult.componentTimes[label] = std::stoll(match[3]);
+      }
+    }
+  }
+
+  RunResult runOnce(std::string const& iExe, GridPoint const& iPoint, unsigned long long iNEvents) {
+    std::vector<std::string> args = {iExe, "-s", iPoint.source, "-o", iPoint.outputer, "-t", std::to_string(iPoint.nThreads)};
+    if(iPoint.nLanes != 0) {
+      args.insert(args.end(), {"-l", std::to_string(iPoint.nLanes)});
+    }
+    if(not iPoint.waiter.empty()) {
+      args.insert(args.end(), {"-w", iPoint.waiter});
+    }
+    if(iNEvents != 0) {
+      args.insert(args.end(), {"-n", std::to_string(iNEvents)});
+    }
+    std::vector<char*> argv;
+    argv.reserve(args.size()+1);
+    for(auto& a: args) {
+      argv.push_back(a.data());
+    }
+    argv.push_back(nullptr);
+
+    RunResult result;
+    int fds[2];
+    if(0 != pipe(fds)) {
+      throw std::runtime_error("failed to create pipe");
+    }
+    pid_t pid = fork();
+    if(pid < 0) {
+      throw std::runtime_error("failed to fork");
+    }
+    if(pid == 0) {
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      execv(argv[0], argv.data());
+      std::cerr <<"failed to exec "<<argv[0]<<std::endl;
+      _exit(127);
+    }
+    close(fds[1]);
+    std::string output;
+    char buffer[4096];
+    ssize_t nRead;
+    while( (nRead = read(fds[0], buffer, sizeof(buffer))) > 0) {
+      output.append(buffer, nRead);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    result.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+    //on Linux ru_maxrss is in kilobytes
+    result.peakRSS = usage.ru_maxrss;
+    //threaded_io_test catches exceptions and still returns 0
+    if(output.find("Caught exception") != std::string::npos and result.exitStatus == 0) {
+      result.exitStatus = 1;
+    }
+    parseSummary(output, result);
+    result.outputBytes = outputFileSize(iPoint.outputer);
+    return result;
+  }
+
+  double eventsPerSecond(RunResult const& iResult) {
+    if(iResult.wallTime <= 0) {
+      return 0.;
+    }
+    return iResult.nEvents*1.e6/iResult.wallTime;
+  }
+
+  std::string quoteCSV(std::string const& iValue) {
+    if(iValue.find_first_of(",\"\n") == std::string::npos) {
+      return iValue;
+    }
+    std::string quoted = "\"";
+    for(auto c: iValue) {
+      if(c == '"') {
+        quoted.push_back('"');
+      }
+      quoted.push_back(c);
+    }
+    quoted.push_back('"');
+    return quoted;
+  }
+
+  //Fits Amdahl's law, 1/S = f + (1-f)/t, to the measured speedups S(t) to get the serial fraction f.
+  double fitSerialFraction(std::vector<std::pair<int,double>> const& iSpeedups) {
+    double num = 0.;
+    double den = 0.;
+    for(auto const& [threads, speedup]: iSpeedups) {
+      if(threads <= 1 or speedup <= 0.) {
+        continue;
+      }
+      double x = 1./threads;
+      double y = 1./speedup;
+      num += (1.-x)*(y-x);
+      den += (1.-x)*(1.-x);
+    }
+    if(den == 0.) {
+      return std::nan("");
+    }
+    return std::clamp(num/den, 0., 1.);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  try {
+    CLI::App app{"run threaded_io_test over a grid of configurations"};
+
+    std::string exe = (std::filesystem::path(argv[0]).parent_path() / "threaded_io_test").string();
+    app.add_option("--exe", exe, "path to threaded_io_test.\nDefault is threaded_io_test next to this executable.");
+
+    std::vector<std::string> sources;
+    app.add_option("-s,--source", sources, "Source configurations to sweep over.")->required();
+
+    std::vector<std::string> outputers = {"DummyOutputer"};
+    app.add_option("-o,--outputer", outputers, "Outputer configurations to sweep over.\nDefault is 'DummyOutputer'.");
+
+    std::vector<std::string> waiters = {""};
+    app.add_option("-w,--waiter", waiters, "Waiter configurations to sweep over.\nDefault is no waiter.");
+
+    std::vector<std::string> sourceOptions;
+    app.add_option("--source-option", sourceOptions, "'key=v1,v2,...' added to each Source configuration, one run per value.");
+
+    std::vector<std::string> outputerOptions;
+    app.add_option("--outputer-option", outputerOptions, "'key=v1,v2,...' added to each Outputer configuration, one run per value,\ne.g. compressionLevel=1,5,9 or batchSize=1,10,100.");
+
+    std::vector<int> threads = {1};
+    app.add_option("-t,--num-threads", threads, "numbers of threads to sweep over, e.g. 1,2,4,8.")->delimiter(',');
+
+    std::vector<int> lanes;
+    app.add_option("-l,--num-lanes", lanes, "numbers of Lanes to sweep over.\nDefault is to use the number of threads.")->delimiter(',');
+
+    unsigned long long nEvents = 0;
+    app.add_option("-n,--num-events", nEvents, "Number of events for each run.\nDefault is to let threaded_io_test decide.");
+
+    unsigned int nRepeats = 3;
+    app.add_option("-r,--repeat", nRepeats, "Number of runs, each in a fresh process, for each grid point.\nDefault is 3.");
+
+    std::string csvFile = "sweep.csv";
+    app.add_option("--csv", csvFile, "CSV file holding one row per run.\nDefault is 'sweep.csv'.");
+
+    std::string fitFile;
+    app.add_option("--fit-csv", fitFile, "CSV file holding the parallel efficiency fit for each configuration.\nDefault is to only print the fit.");
+
+    CLI11_PARSE(app, argc, argv);
+
+    if(lanes.empty()) {
+      lanes.push_back(0);
+    }
+    sources = expandOptions(sources, sourceOptions);
+    outputers = expandOptions(outputers, outputerOptions);
+
+    std::vector<GridPoint> points;
+    for(auto const& s: sources) {
+      for(auto const& o: outputers) {
+        for(auto const& w: waiters) {
+          for(auto l: lanes) {
+            for(auto t: threads) {
+              points.push_back({s, o, w, t, l});
+            }
+          }
+        }
+      }
+    }
+
+    std::vector<std::pair<GridPoint, RunResult>> results;
+    results.reserve(points.size()*nRepeats);
+    std::vector<std::string> componentLabels;
+    std::set<std::string> seenLabels;
+    for(auto const& p: points) {
+      for(unsigned int r = 0; r < nRepeats; ++r) {
+        std::cout <<"running -s "<<p.source<<" -o "<<p.outputer<<" -t "<<p.nThreads;
+        if(p.nLanes) {
+          std::cout <<" -l "<<p.nLanes;
+        }
+        if(not p.waiter.empty()) {
+          std::cout <<" -w "<<p.waiter;
+        }
+        std::cout <<" ("<<r+1<<"/"<<nRepeats<<")"<<std::endl;
+        auto result = runOnce(exe, p, nEvents);
+        if(result.exitStatus != 0) {
+          std::cout <<"  failed with status "<<result.exitStatus<<std::endl;
+        }
+        for(auto const& t: result.componentTimes) {
+          if(seenLabels.insert(t.first).second) {
+            componentLabels.push_back(t.first);
+          }
+        }
+        results.emplace_back(p, std::move(result));
+      }
+    }
+
+    {
+      std::ofstream csv(csvFile);
+      if(not csv.is_open()) {
+        std::cout <<"unable to open file "<<csvFile<<std::endl;
+        return 1;
+      }
+      csv <<"source,outputer,waiter,threads,lanes,repeat,status,wall_time_us,events,events_per_s,peak_rss_kB,output_bytes";
+      for(auto const& l: componentLabels) {
+        csv <<","<<quoteCSV(l+" [us]");
+      }
+      csv <<"\n";
+      std::map<std::string,unsigned int> repeatCount;
+      for(auto const& [p, r]: results) {
+        auto lanesUsed = p.nLanes == 0 ? p.nThreads : p.nLanes;
+        csv <<quoteCSV(p.source)<<","<<quoteCSV(p.outputer)<<","<<quoteCSV(p.waiter)<<","
+            <<p.nThreads<<","<<lanesUsed<<","
+            <<repeatCount[p.source+p.outputer+p.waiter+std::to_string(p.nThreads)+"/"+std::to_string(p.nLanes)]++<<","
+            <<r.exitStatus<<","<<r.wallTime<<","<<r.nEvents<<","<<eventsPerSecond(r)<<","
+            <<r.peakRSS<<","<<r.outputBytes;
+        for(auto const& l: componentLabels) {
+          csv <<",";
+          auto itFound = r.componentTimes.find(l);
+          if(itFound != r.componentTimes.end()) {
+            csv <<itFound->second;
+          }
+        }
+        csv <<"\n";
+      }
+    }
+
+    //Efficiency is relative to the fewest number of threads measured for each configuration
+    // and uses the mean throughput of the successful repeats.
+    std::map<std::tuple<std::string,std::string,std::string,int>, std::map<int, std::pair<double,unsigned int>>> throughput;
+    for(auto const& [p, r]: results) {
+      if(r.exitStatus != 0 or r.wallTime <= 0) {
+        continue;
+      }
+      auto& sum = throughput[std::make_tuple(p.source, p.outputer, p.waiter, p.nLanes)][p.nThreads];
+      sum.first += eventsPerSecond(r);
+      ++sum.second;
+    }
+
+    std::ofstream fit;
+    if(not fitFile.empty()) {
+      fit.open(fitFile);
+      if(not fit.is_open()) {
+        std::cout <<"unable to open file "<<fitFile<<std::endl;
+        return 1;
+      }
+      fit <<"source,outputer,waiter,lanes,threads,events_per_s,speedup,efficiency,serial_fraction,max_speedup\n";
+    }
+    std::cout <<"----------"<<std::endl;
+    for(auto const& [key, perThreads]: throughput) {
+      auto const& [source, outputer, waiter, nLanes] = key;
+      auto const& base = *perThreads.begin();
+      double baseRate = base.second.first/base.second.second;
+      std::vector<std::pair<int,double>> speedups;
+      for(auto const& [t, sum]: perThreads) {
+        speedups.emplace_back(t, base.first*(sum.first/sum.second)/baseRate);
+      }
+      double serialFraction = fitSerialFraction(speedups);
+      std::cout <<"Source "<<source<<"\nOutputer "<<outputer<<"\nWaiter "<<waiter<<"\n";
+      if(nLanes != 0) {
+        std::cout <<"# concurrent events "<<nLanes<<"\n";
+      }
+      std::cout <<"  threads  events/s  speedup  efficiency\n";
+      auto itSpeedup = speedups.begin();
+      for(auto const& [t, sum]: perThreads) {
+        double rate = sum.first/sum.second;
+        double efficiency = itSpeedup->second/t;
+        std::cout <<"  "<<t<<"  "<<rate<<"  "<<itSpeedup->second<<"  "<<efficiency<<"\n";
+        if(fit.is_open()) {
+          fit <<quoteCSV(source)<<","<<quoteCSV(outputer)<<","<<quoteCSV(waiter)<<","<<(nLanes==0? t: nLanes)<<","
+              <<t<<","<<rate<<","<<itSpeedup->second<<","<<efficiency<<","<<serialFraction<<","<<1./serialFraction<<"\n";
+        }
+        ++itSpeedup;
+      }
+      std::cout <<"  fitted serial fraction: "<<serialFraction<<"  max speedup: "<<1./serialFraction<<"\n"<<std::endl;
+    }
+  } catch(std::exception const& e) {
+    std::cout <<"Caught exception "<<e.what()<<std::endl;
+    return 1;
+  }
+  return 0;
+}